@@ -0,0 +1,34 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/allocation_counter.h"
+
+namespace mjmech {
+namespace base {
+
+namespace detail {
+thread_local int64_t g_allocation_count = 0;
+bool g_allocation_counting_enabled = false;
+}
+
+int64_t GetAllocationCount() {
+  return detail::g_allocation_count;
+}
+
+bool IsAllocationCountingEnabled() {
+  return detail::g_allocation_counting_enabled;
+}
+
+}
+}
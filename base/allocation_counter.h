@@ -0,0 +1,36 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+namespace mjmech {
+namespace base {
+
+/// Return the number of heap allocations made through operator new by
+/// the calling thread.  Allocations are only tracked in binaries that
+/// link //base:allocation_counter_hooks, otherwise this is always 0.
+int64_t GetAllocationCount();
+
+/// Return true if this binary is tracking allocations.
+bool IsAllocationCountingEnabled();
+
+namespace detail {
+extern thread_local int64_t g_allocation_count;
+extern bool g_allocation_counting_enabled;
+}
+
+}
+}
@@ -0,0 +1,146 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Replacements for the global allocation functions which count every
+/// allocation made on each thread.  Link this into a binary to make
+/// base::GetAllocationCount() meaningful.
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "base/allocation_counter.h"
+
+namespace {
+using mjmech::base::detail::g_allocation_count;
+
+struct EnableCounting {
+  EnableCounting() {
+    mjmech::base::detail::g_allocation_counting_enabled = true;
+  }
+};
+
+EnableCounting g_enable_counting;
+
+void* Allocate(std::size_t size) {
+  g_allocation_count++;
+  if (size == 0) { size = 1; }
+
+  while (true) {
+    void* const result = std::malloc(size);
+    if (result) { return result; }
+
+    auto handler = std::get_new_handler();
+    if (!handler) { throw std::bad_alloc(); }
+    handler();
+  }
+}
+
+void* AllocateAligned(std::size_t size, std::align_val_t align) {
+  g_allocation_count++;
+  if (size == 0) { size = 1; }
+
+  const auto alignment = std::max(static_cast<std::size_t>(align),
+                                  sizeof(void*));
+  while (true) {
+    void* result = nullptr;
+    if (::posix_memalign(&result, alignment, size) == 0) { return result; }
+
+    auto handler = std::get_new_handler();
+    if (!handler) { throw std::bad_alloc(); }
+    handler();
+  }
+}
+}
+
+void* operator new(std::size_t size) {
+  return Allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+  return Allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return Allocate(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return Allocate(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+  return AllocateAligned(size, align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+  return AllocateAligned(size, align);
+}
+
+void* operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t&) noexcept {
+  try {
+    return AllocateAligned(size, align);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void* operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t&) noexcept {
+  try {
+    return AllocateAligned(size, align);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
@@ -0,0 +1,69 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "mjlib/base/assert.h"
+
+namespace mjmech {
+namespace base {
+
+/// Maps small non-negative integer ids (servo ids, leg ids) to dense
+/// slot indices with a single array lookup.  It is intended to be
+/// populated once from configuration and then queried every control
+/// cycle.
+template <int MaxId>
+class DenseIdMap {
+ public:
+  static constexpr int kMaxId = MaxId;
+
+  DenseIdMap() {
+    slots_.fill(-1);
+  }
+
+  void Insert(int id, int slot) {
+    MJ_ASSERT(id >= 0 && id < MaxId);
+    MJ_ASSERT(slot >= 0);
+    MJ_ASSERT(slots_[id] < 0);
+    slots_[id] = static_cast<int16_t>(slot);
+    size_++;
+  }
+
+  /// Return the slot for @p id, or -1 if it is not present.
+  int Find(int id) const {
+    if (id < 0 || id >= MaxId) { return -1; }
+    return slots_[id];
+  }
+
+  bool contains(int id) const { return Find(id) >= 0; }
+
+  /// Return the slot for @p id, which must be present.
+  int operator[](int id) const {
+    const int result = Find(id);
+    MJ_ASSERT(result >= 0);
+    return result;
+  }
+
+  int size() const { return size_; }
+
+ private:
+  std::array<int16_t, MaxId> slots_;
+  int size_ = 0;
+};
+
+}
+}
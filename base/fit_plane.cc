@@ -35,5 +35,81 @@ Plane FitPlane(const std::vector<Eigen::Vector3d>& points) {
   return Plane{result(0), result(1), result(2)};
 }
 
+namespace {
+double Weight(const double* weights, size_t i) {
+  return weights ? weights[i] : 1.0;
+}
+
+Plane FitPlaneNormalEquations(const Eigen::Vector3d* points,
+                              const double* weights,
+                              size_t size) {
+  // Accumulate A^T * W * A and A^T * W * B, where each row of A is
+  // [x, y, 1] and B is z.
+  Eigen::Matrix3d ata = Eigen::Matrix3d::Zero();
+  Eigen::Vector3d atb = Eigen::Vector3d::Zero();
+
+  for (size_t i = 0; i < size; i++) {
+    const double w = Weight(weights, i);
+    const Eigen::Vector3d row(points[i].x(), points[i].y(), 1.0);
+    ata += w * row * row.transpose();
+    atb += w * row * points[i].z();
+  }
+
+  // This gives the minimum norm solution if the points are
+  // degenerate, matching the SVD solution.
+  const Eigen::Vector3d result =
+      ata.completeOrthogonalDecomposition().solve(atb);
+  return Plane{result(0), result(1), result(2)};
+}
+}
+
+Plane FitPlane(const Eigen::Vector3d* points, size_t size) {
+  return FitPlane(points, nullptr, size);
+}
+
+Plane FitPlane(const Eigen::Vector3d* points, const double* weights,
+               size_t size) {
+  double sw = 0.0;
+  Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+  for (size_t i = 0; i < size; i++) {
+    const double w = Weight(weights, i);
+    sw += w;
+    sum += w * points[i];
+  }
+  if (sw <= 0.0) { return {}; }
+
+  const Eigen::Vector3d mean = sum / sw;
+
+  double sxx = 0.0;
+  double sxy = 0.0;
+  double syy = 0.0;
+  double sxz = 0.0;
+  double syz = 0.0;
+  for (size_t i = 0; i < size; i++) {
+    const double w = Weight(weights, i);
+    const Eigen::Vector3d d = points[i] - mean;
+    sxx += w * d.x() * d.x();
+    sxy += w * d.x() * d.y();
+    syy += w * d.y() * d.y();
+    sxz += w * d.x() * d.z();
+    syz += w * d.y() * d.z();
+  }
+
+  // If the points do not span both x and y, the slopes are not
+  // uniquely determined.
+  constexpr double kDegenerate = 1e-12;
+  const double det = sxx * syy - sxy * sxy;
+  const double scale = sxx + syy;
+  if (!(det > kDegenerate * scale * scale)) {
+    return FitPlaneNormalEquations(points, weights, size);
+  }
+
+  Plane result;
+  result.a = (sxz * syy - syz * sxy) / det;
+  result.b = (syz * sxx - sxz * sxy) / det;
+  result.c = mean.z() - result.a * mean.x() - result.b * mean.y();
+  return result;
+}
+
 }
 }
@@ -32,5 +32,24 @@ struct Plane {
 
 Plane FitPlane(const std::vector<Eigen::Vector3d>& points);
 
+/// Fit a plane to @p size points without allocating.  This is
+/// intended for small sets of points, like the feet of a walking
+/// robot.
+///
+/// The points are centered, after which the least squares slopes are
+/// the solution of a 2x2 system, solved in closed form.  If the
+/// points are collinear or coincident in x and y, this falls back to
+/// the minimum norm solution of the 3x3 normal equations, matching
+/// the SVD version above.
+Plane FitPlane(const Eigen::Vector3d* points, size_t size);
+
+/// The same as above, but each point is weighted in the least
+/// squares problem by the corresponding entry of @p weights, for
+/// instance the contact confidence of each foot.  Weights must be
+/// non-negative.  If they are all zero, a level plane at z = 0 is
+/// returned.
+Plane FitPlane(const Eigen::Vector3d* points, const double* weights,
+               size_t size);
+
 }
 }
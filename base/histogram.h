@@ -0,0 +1,158 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+
+#include "mjlib/base/visitor.h"
+
+namespace mjmech {
+namespace base {
+
+/// A fixed size histogram of non-negative integer values, with
+/// buckets whose width is proportional to their magnitude, in the
+/// style of HdrHistogram.  Every value up to 2^31 is recorded with a
+/// relative error of no more than 1/8.  Recording is a handful of
+/// integer operations and never allocates, so it is suitable for use
+/// in the control loop.
+class Histogram {
+ public:
+  static constexpr int kSubBucketBits = 3;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+  static constexpr int kMaxShift = 31 - kSubBucketBits;
+  static constexpr int kNumBuckets = kSubBuckets * (kMaxShift + 2);
+
+  void Add(int64_t value) {
+    if (value < 0) { value = 0; }
+
+    buckets_[Index(value)]++;
+    count_++;
+    total_ += value;
+    if (count_ == 1 || value < min_) { min_ = value; }
+    if (value > max_) { max_ = value; }
+  }
+
+  void Merge(const Histogram& rhs) {
+    if (rhs.count_ == 0) { return; }
+    for (int i = 0; i < kNumBuckets; i++) { buckets_[i] += rhs.buckets_[i]; }
+    min_ = (count_ == 0) ? rhs.min_ : std::min(min_, rhs.min_);
+    max_ = std::max(max_, rhs.max_);
+    count_ += rhs.count_;
+    total_ += rhs.total_;
+  }
+
+  void Clear() { *this = Histogram(); }
+
+  uint64_t count() const { return count_; }
+  int64_t min() const { return min_; }
+  int64_t max() const { return max_; }
+  double mean() const {
+    return count_ ? static_cast<double>(total_) / count_ : 0.0;
+  }
+
+  /// Return a value which at least @p fraction (0 to 1) of the
+  /// recorded values are less than or equal to.  The result is the
+  /// upper bound of the containing bucket, limited to the largest
+  /// value actually seen.
+  int64_t Percentile(double fraction) const {
+    if (count_ == 0) { return 0; }
+    const uint64_t threshold = std::max<uint64_t>(
+        1, static_cast<uint64_t>(fraction * count_ + 0.5));
+    uint64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; i++) {
+      seen += buckets_[i];
+      if (seen >= threshold) {
+        return std::min(UpperBound(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  /// The commonly reported percentiles, for display.
+  struct Summary {
+    uint64_t count = 0;
+    int64_t p50 = 0;
+    int64_t p99 = 0;
+    int64_t p999 = 0;
+    int64_t max = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(count));
+      a->Visit(MJ_NVP(p50));
+      a->Visit(MJ_NVP(p99));
+      a->Visit(MJ_NVP(p999));
+      a->Visit(MJ_NVP(max));
+    }
+  };
+
+  Summary summary() const {
+    Summary result;
+    result.count = count_;
+    result.p50 = Percentile(0.50);
+    result.p99 = Percentile(0.99);
+    result.p999 = Percentile(0.999);
+    result.max = max_;
+    return result;
+  }
+
+  /// The bucket which @p value is counted in.
+  static int Index(int64_t value) {
+    if (value < 2 * kSubBuckets) { return static_cast<int>(value); }
+    const int msb = 63 - __builtin_clzll(static_cast<uint64_t>(value));
+    const int shift = msb - kSubBucketBits;
+    if (shift > kMaxShift) { return kNumBuckets - 1; }
+    return kSubBuckets * shift + static_cast<int>(value >> shift);
+  }
+
+  /// The smallest value counted in bucket @p index.
+  static int64_t LowerBound(int index) {
+    if (index < 2 * kSubBuckets) { return index; }
+    const int shift = index / kSubBuckets - 1;
+    return static_cast<int64_t>(index % kSubBuckets + kSubBuckets) << shift;
+  }
+
+  /// The largest value counted in bucket @p index.
+  static int64_t UpperBound(int index) {
+    if (index == kNumBuckets - 1) {
+      return std::numeric_limits<int64_t>::max();
+    }
+    return LowerBound(index + 1) - 1;
+  }
+
+  const std::array<uint32_t, kNumBuckets>& buckets() const { return buckets_; }
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(mjlib::base::MakeNameValuePair(&count_, "count"));
+    a->Visit(mjlib::base::MakeNameValuePair(&total_, "total"));
+    a->Visit(mjlib::base::MakeNameValuePair(&min_, "min"));
+    a->Visit(mjlib::base::MakeNameValuePair(&max_, "max"));
+    a->Visit(mjlib::base::MakeNameValuePair(&buckets_, "buckets"));
+  }
+
+ private:
+  uint64_t count_ = 0;
+  int64_t total_ = 0;
+  int64_t min_ = 0;
+  int64_t max_ = 0;
+  std::array<uint32_t, kNumBuckets> buckets_ = {};
+};
+
+}
+}
@@ -0,0 +1,126 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/min_max_pyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace mjmech {
+namespace base {
+
+namespace {
+constexpr size_t kGroup = 4;
+
+bool IsNonDecreasing(const double* x, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (!std::isfinite(x[i])) { return false; }
+    if (i > 0 && x[i] < x[i - 1]) { return false; }
+  }
+  return true;
+}
+
+/// Reduce each group of kGroup points to exactly two.
+void Reduce(const double* x, const double* y, size_t size,
+            std::vector<double>* out_x, std::vector<double>* out_y) {
+  const size_t groups = (size + kGroup - 1) / kGroup;
+  out_x->resize(2 * groups);
+  out_y->resize(2 * groups);
+
+  for (size_t group = 0; group < groups; group++) {
+    const size_t start = group * kGroup;
+    const size_t end = std::min(size, start + kGroup);
+
+    size_t min_index = end;
+    size_t max_index = end;
+    for (size_t i = start; i < end; i++) {
+      // NaN marks a gap, and is only kept if the whole group is one.
+      if (std::isnan(y[i])) { continue; }
+      if (min_index == end || y[i] < y[min_index]) { min_index = i; }
+      if (max_index == end || y[i] > y[max_index]) { max_index = i; }
+    }
+
+    double* const gx = out_x->data() + 2 * group;
+    double* const gy = out_y->data() + 2 * group;
+    if (min_index == end) {
+      gx[0] = x[start];
+      gx[1] = x[end - 1];
+      gy[0] = gy[1] = std::numeric_limits<double>::quiet_NaN();
+      continue;
+    }
+
+    const size_t first = std::min(min_index, max_index);
+    const size_t second = std::max(min_index, max_index);
+    gx[0] = x[first];
+    gy[0] = y[first];
+    gx[1] = x[second];
+    gy[1] = y[second];
+  }
+}
+}
+
+MinMaxPyramid::MinMaxPyramid(const double* x, const double* y, size_t size,
+                             size_t min_points) {
+  if (!IsNonDecreasing(x, size)) { return; }
+
+  const double* level_x = x;
+  const double* level_y = y;
+  size_t level_size = size;
+  while (level_size > min_points && level_size > kGroup) {
+    levels_.push_back({});
+    auto& level = levels_.back();
+    Reduce(level_x, level_y, level_size, &level.x, &level.y);
+
+    level_x = level.x.data();
+    level_y = level.y.data();
+    level_size = level.x.size();
+  }
+}
+
+MinMaxPyramid::View MinMaxPyramid::Select(
+    const double* x, const double* y, size_t size,
+    double x_min, double x_max, size_t max_points) const {
+  if (levels_.empty() || !(x_max > x_min)) {
+    return {x, y, size};
+  }
+
+  // The visible source range, with one point beyond each end.
+  const size_t lo = static_cast<size_t>(std::max<std::ptrdiff_t>(
+      0, std::lower_bound(x, x + size, x_min) - x - 1));
+  const size_t hi = std::min<size_t>(
+      size, std::upper_bound(x, x + size, x_max) - x + 1);
+  if (hi <= lo) { return {x, y, 0}; }
+  if (hi - lo <= max_points) {
+    return {x + lo, y + lo, hi - lo};
+  }
+
+  // levels_[k] has one pair for every 2^(k+2) source points.
+  size_t bucket = 2;
+  for (size_t k = 0; k < levels_.size(); k++) {
+    bucket *= 2;
+    const auto& level = levels_[k];
+    const size_t start = 2 * (lo / bucket);
+    const size_t end = std::min(level.x.size(),
+                                2 * ((hi + bucket - 1) / bucket));
+    if (end - start <= max_points || k + 1 == levels_.size()) {
+      return {level.x.data() + start, level.y.data() + start, end - start};
+    }
+  }
+
+  return {x + lo, y + lo, hi - lo};
+}
+
+}
+}
@@ -0,0 +1,72 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace mjmech {
+namespace base {
+
+/// Successively coarser versions of a line series, for drawing long
+/// series with a bounded number of points.
+///
+/// Each level reduces every group of 4 points from the level below
+/// to 2, the minimum and maximum y value in their original order, so
+/// level k holds one min/max pair for each 2^(k+1) source points.
+/// When at least one pair is drawn per pixel column, the result looks
+/// the same as drawing every point.
+///
+/// Level 0 is the source series itself, which is not copied.  It is
+/// passed again to Select, so that its storage can move after
+/// construction.
+class MinMaxPyramid {
+ public:
+  MinMaxPyramid() {}
+
+  /// Build levels until one has no more than @p min_points points.
+  /// If @p x is not non-decreasing, no levels are built, and Select
+  /// always returns the whole series.
+  MinMaxPyramid(const double* x, const double* y, size_t size,
+                size_t min_points = 1024);
+
+  struct View {
+    const double* x = nullptr;
+    const double* y = nullptr;
+    size_t size = 0;
+  };
+
+  /// Return the finest level whose view of [@p x_min, @p x_max] has
+  /// no more than @p max_points points, or the coarsest level if none
+  /// does.  A point beyond each end is included, so lines leave the
+  /// visible region.  @p x and @p y must be the series this was built
+  /// from.
+  View Select(const double* x, const double* y, size_t size,
+              double x_min, double x_max, size_t max_points) const;
+
+  /// The number of levels above the source series.
+  size_t levels() const { return levels_.size(); }
+
+ private:
+  struct Level {
+    std::vector<double> x;
+    std::vector<double> y;
+  };
+
+  std::vector<Level> levels_;
+};
+
+}
+}
@@ -31,6 +31,7 @@
 #include "base/git_info.h"
 #include "base/handler_util.h"
 #include "base/logging.h"
+#include "base/realtime.h"
 #include "base/timestamped_log.h"
 
 namespace mjmech {
@@ -48,6 +49,7 @@ int safe_main(int argc, char**argv) {
   double event_timeout_s = 0;
   double idle_timeout_s = 0;
   int cpu_affinity = -1;
+  RealtimeOptions rt;
 
   auto group = clipp::group(
       (clipp::option("c", "config") & clipp::value("", config_file)) %
@@ -60,7 +62,23 @@ int safe_main(int argc, char**argv) {
       "disable real-time signals and other debugging hindrances",
       (clipp::option("rt.event_timeout_s") & clipp::value("", event_timeout_s)),
       (clipp::option("rt.idle_timeout_s") & clipp::value("", idle_timeout_s)),
-      (clipp::option("rt.cpu_affinity") & clipp::value("", cpu_affinity))
+      (clipp::option("rt.cpu_affinity") & clipp::value("", cpu_affinity)),
+      (clipp::option("rt.priority") & clipp::value("", rt.main_priority)) %
+      "SCHED_FIFO priority of the main thread, 0 for SCHED_OTHER",
+      (clipp::option("rt.pi3hat_priority") &
+       clipp::value("", rt.pi3hat_priority)),
+      (clipp::option("rt.web_priority") & clipp::value("", rt.web_priority)),
+      (clipp::option("rt.log_priority") & clipp::value("", rt.log_priority)),
+      (clipp::option("rt.mlockall").set(rt.mlockall)) %
+      "lock all memory",
+      (clipp::option("rt.prefault_heap_mb") &
+       clipp::value("", rt.prefault_heap_mb)),
+      (clipp::option("rt.prefault_stack_kb") &
+       clipp::value("", rt.prefault_stack_kb)),
+      (clipp::option("rt.check_isolation").set(rt.check_isolation)) %
+      "warn if threads are bound to CPUs that are not isolated",
+      (clipp::option("rt.report_cycles") & clipp::value("", rt.report_cycles)) %
+      "report faults and context switches over this many control cycles"
   );
 
   group.push_back(MakeLoggingOptions());
@@ -84,8 +102,16 @@ int safe_main(int argc, char**argv) {
     mjlib::base::ClippParse(argc, argv, group);
   }
 
+  if (debug) {
+    // Leave scheduling and memory alone, so that a debugger works as
+    // expected.
+    rt = {};
+  }
+  SetRealtimeOptions(rt);
+  PrepareRealtimeMemory();
+
   if (!log_file.empty()) {
-    OpenMaybeTimestampedLog(context.telemetry_log.get(),
+    OpenMaybeTimestampedLog(context.telemetry_registry->log(),
                             log_file,
                             log_short_name ? kShort : kTimestamped);
   }
@@ -122,6 +148,7 @@ int safe_main(int argc, char**argv) {
               mjlib::base::system_error::throw_if(
                   ::sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) < 0);
             }
+            ConfigureRealtimeThread(RealtimeThread::kMain, cpu_affinity);
 
             GitInfo git_info;
             LogRef log = GetLogInstance("");
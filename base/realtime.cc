@@ -0,0 +1,191 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/realtime.h"
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+#include <boost/algorithm/string.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/system_error.h"
+
+#include "base/logging.h"
+
+namespace mjmech {
+namespace base {
+
+namespace {
+RealtimeOptions g_options;
+
+const char* ThreadName(RealtimeThread thread) {
+  switch (thread) {
+    case RealtimeThread::kMain: { return "main"; }
+    case RealtimeThread::kPi3hat: { return "pi3hat"; }
+    case RealtimeThread::kWeb: { return "web"; }
+    case RealtimeThread::kLog: { return "log"; }
+  }
+  return "unknown";
+}
+
+int ThreadPriority(RealtimeThread thread) {
+  switch (thread) {
+    case RealtimeThread::kMain: { return g_options.main_priority; }
+    case RealtimeThread::kPi3hat: { return g_options.pi3hat_priority; }
+    case RealtimeThread::kWeb: { return g_options.web_priority; }
+    case RealtimeThread::kLog: { return g_options.log_priority; }
+  }
+  return -1;
+}
+
+void __attribute__((noinline)) PrefaultStack(int kb) {
+  // alloca is used so that the frame really is this large, and the
+  // volatile write keeps the touches from being optimized out.
+  const size_t size = static_cast<size_t>(kb) * 1024;
+  volatile char* const stack = static_cast<volatile char*>(alloca(size));
+  const long page = ::sysconf(_SC_PAGESIZE);
+  for (size_t i = 0; i < size; i += page) { stack[i] = 0; }
+}
+
+void PrefaultHeap(int mb) {
+  // Keep freed memory in the heap, rather than returning it to the
+  // kernel, and satisfy even large allocations from it.
+  mjlib::base::system_error::throw_if(
+      ::mallopt(M_TRIM_THRESHOLD, -1) == 0, "setting M_TRIM_THRESHOLD");
+  mjlib::base::system_error::throw_if(
+      ::mallopt(M_MMAP_MAX, 0) == 0, "setting M_MMAP_MAX");
+
+  const size_t size = static_cast<size_t>(mb) * 1024 * 1024;
+  std::unique_ptr<char[]> heap(new char[size]);
+  const long page = ::sysconf(_SC_PAGESIZE);
+  for (size_t i = 0; i < size; i += page) {
+    static_cast<volatile char*>(heap.get())[i] = 0;
+  }
+}
+}
+
+void SetRealtimeOptions(const RealtimeOptions& options) {
+  g_options = options;
+}
+
+const RealtimeOptions& GetRealtimeOptions() {
+  return g_options;
+}
+
+void ConfigureRealtimeThread(RealtimeThread thread, int cpu) {
+  const char* const name = ThreadName(thread);
+  if (thread != RealtimeThread::kMain) {
+    // Renaming the main thread would rename the process.
+    ::pthread_setname_np(::pthread_self(), name);
+  }
+
+  const int priority = ThreadPriority(thread);
+  if (priority >= 0) {
+    struct sched_param param = {};
+    param.sched_priority = priority;
+    const int err = ::pthread_setschedparam(
+        ::pthread_self(), priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+    mjlib::base::system_error::throw_if(
+        err != 0, fmt::format("setting {} thread priority to {}: {}",
+                              name, priority, std::strerror(err)));
+  }
+
+  if (g_options.check_isolation && cpu >= 0) {
+    const auto isolated = IsolatedCpus();
+    if (std::find(isolated.begin(), isolated.end(), cpu) == isolated.end()) {
+      GetLogInstance("realtime").warn(
+          fmt::format("{} thread is bound to CPU {}, which is not isolated",
+                      name, cpu));
+    }
+  }
+}
+
+void PrepareRealtimeMemory() {
+  if (g_options.mlockall) {
+    mjlib::base::system_error::throw_if(
+        ::mlockall(MCL_CURRENT | MCL_FUTURE) < 0, "mlockall");
+  }
+  if (g_options.prefault_heap_mb > 0) {
+    PrefaultHeap(g_options.prefault_heap_mb);
+  }
+  if (g_options.prefault_stack_kb > 0) {
+    PrefaultStack(g_options.prefault_stack_kb);
+  }
+}
+
+std::vector<int> ParseCpuList(const std::string& list) {
+  std::vector<int> result;
+  std::vector<std::string> ranges;
+  boost::split(ranges, boost::trim_copy(list), boost::is_any_of(","));
+  for (const auto& range : ranges) {
+    if (range.empty()) { continue; }
+    const auto dash = range.find('-');
+    const int first = std::stoi(range.substr(0, dash));
+    const int last =
+        (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; cpu++) { result.push_back(cpu); }
+  }
+  return result;
+}
+
+std::vector<int> IsolatedCpus() {
+  std::ifstream inf("/sys/devices/system/cpu/isolated");
+  std::string list;
+  std::getline(inf, list);
+  return ParseCpuList(list);
+}
+
+ThreadUsage ThreadUsage::Get() {
+  struct rusage usage = {};
+  mjlib::base::system_error::throw_if(
+      ::getrusage(RUSAGE_THREAD, &usage) < 0, "getrusage");
+
+  ThreadUsage result;
+  result.minor_faults = usage.ru_minflt;
+  result.major_faults = usage.ru_majflt;
+  result.voluntary_switches = usage.ru_nvcsw;
+  result.involuntary_switches = usage.ru_nivcsw;
+  return result;
+}
+
+void RealtimeStartupReport::Cycle() {
+  const int report_cycles = g_options.report_cycles;
+  if (report_cycles <= 0 || cycles_ > report_cycles) { return; }
+
+  if (cycles_ == 0) { start_ = ThreadUsage::Get(); }
+  cycles_++;
+  if (cycles_ <= report_cycles) { return; }
+
+  const auto delta = ThreadUsage::Get() - start_;
+  GetLogInstance("realtime").warn(
+      fmt::format("{} first {} cycles: {} minor faults, {} major faults, "
+                  "{} voluntary and {} involuntary context switches",
+                  name_, report_cycles,
+                  delta.minor_faults, delta.major_faults,
+                  delta.voluntary_switches, delta.involuntary_switches));
+}
+
+}
+}
@@ -0,0 +1,112 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mjmech {
+namespace base {
+
+/// Process wide real-time configuration, set once from safe_main
+/// before any threads are started.
+struct RealtimeOptions {
+  // The SCHED_FIFO priority for each class of thread.  0 selects
+  // SCHED_OTHER, and a negative value leaves the thread with
+  // whatever it inherited.
+  int main_priority = -1;
+  int pi3hat_priority = -1;
+  int web_priority = -1;
+  int log_priority = -1;
+
+  // Lock all current and future pages into memory.
+  bool mlockall = false;
+
+  // Touch this much heap, and main thread stack, at startup so that
+  // the pages are already resident when the control loop needs them.
+  int prefault_heap_mb = 0;
+  int prefault_stack_kb = 0;
+
+  // Warn if any thread is bound to a CPU the kernel has not isolated.
+  bool check_isolation = false;
+
+  // If non-zero, report the page faults and context switches seen by
+  // the control thread over its first this many cycles.
+  int report_cycles = 0;
+};
+
+enum class RealtimeThread {
+  kMain,
+  kPi3hat,
+  kWeb,
+  kLog,
+};
+
+void SetRealtimeOptions(const RealtimeOptions&);
+const RealtimeOptions& GetRealtimeOptions();
+
+/// Apply the configured scheduling policy to the calling thread.
+/// @p cpu is the CPU the thread has been bound to, if any, and is
+/// used only for the isolation check.
+void ConfigureRealtimeThread(RealtimeThread, int cpu = -1);
+
+/// Lock and prefault memory as configured.  Call once, from the main
+/// thread.
+void PrepareRealtimeMemory();
+
+/// Parse a kernel CPU list, like "1-3,5".
+std::vector<int> ParseCpuList(const std::string&);
+
+/// The CPUs named by the isolcpus kernel parameter.
+std::vector<int> IsolatedCpus();
+
+/// Scheduling counters for the calling thread.
+struct ThreadUsage {
+  int64_t minor_faults = 0;
+  int64_t major_faults = 0;
+  int64_t voluntary_switches = 0;
+  int64_t involuntary_switches = 0;
+
+  static ThreadUsage Get();
+
+  ThreadUsage operator-(const ThreadUsage& rhs) const {
+    ThreadUsage result;
+    result.minor_faults = minor_faults - rhs.minor_faults;
+    result.major_faults = major_faults - rhs.major_faults;
+    result.voluntary_switches = voluntary_switches - rhs.voluntary_switches;
+    result.involuntary_switches =
+        involuntary_switches - rhs.involuntary_switches;
+    return result;
+  }
+};
+
+/// Logs the page faults and context switches of a control thread
+/// over its first RealtimeOptions::report_cycles cycles.
+class RealtimeStartupReport {
+ public:
+  RealtimeStartupReport(const std::string& name) : name_(name) {}
+
+  /// Call once per control cycle, from the control thread.
+  void Cycle();
+
+ private:
+  const std::string name_;
+  int cycles_ = 0;
+  ThreadUsage start_;
+};
+
+}
+}
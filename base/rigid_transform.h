@@ -0,0 +1,193 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <sophus/se3.hpp>
+
+namespace mjmech {
+namespace base {
+
+/// The rotation matrix of a quaternion which is already unit length.
+/// No normalization is performed.
+template <typename Scalar>
+Eigen::Matrix<Scalar, 3, 3> UnitQuaternionMatrix(
+    const Eigen::Quaternion<Scalar>& q) {
+  const Scalar w = q.w();
+  const Scalar x = q.x();
+  const Scalar y = q.y();
+  const Scalar z = q.z();
+
+  const Scalar tx = 2 * x;
+  const Scalar ty = 2 * y;
+  const Scalar tz = 2 * z;
+  const Scalar twx = tx * w;
+  const Scalar twy = ty * w;
+  const Scalar twz = tz * w;
+  const Scalar txx = tx * x;
+  const Scalar txy = ty * x;
+  const Scalar txz = tz * x;
+  const Scalar tyy = ty * y;
+  const Scalar tyz = tz * y;
+  const Scalar tzz = tz * z;
+
+  Eigen::Matrix<Scalar, 3, 3> result;
+  result <<
+      1 - (tyy + tzz), txy - twz, txz + twy,
+      txy + twz, 1 - (txx + tzz), tyz - twx,
+      txz - twy, tyz + twx, 1 - (txx + tyy);
+  return result;
+}
+
+/// Spherical linear interpolation between two unit quaternions,
+/// taking the shortest path, as Eigen::Quaternion::slerp does.
+///
+/// When filtering, the two inputs are usually within a fraction of a
+/// degree of each other.  There a second order expansion of the
+/// spherical weights is exact to the precision of Scalar, so the
+/// acos and sin calls are skipped.
+template <typename Scalar>
+Eigen::Quaternion<Scalar> Slerp(const Eigen::Quaternion<Scalar>& a,
+                                const Eigen::Quaternion<Scalar>& b,
+                                Scalar t) {
+  const Scalar d = a.coeffs().dot(b.coeffs());
+  const Scalar abs_d = std::abs(d);
+
+  // 1 - cos(theta) ~= theta^2 / 2
+  const Scalar one_minus_d = 1 - abs_d;
+  const Scalar kSmall =
+      std::sqrt(Eigen::NumTraits<Scalar>::epsilon()) / 2;
+
+  Scalar scale0 = 0;
+  Scalar scale1 = 0;
+  if (one_minus_d > kSmall) {
+    const Scalar theta = std::acos(abs_d);
+    const Scalar inv_sin_theta = 1 / std::sin(theta);
+    scale0 = std::sin((1 - t) * theta) * inv_sin_theta;
+    scale1 = std::sin(t * theta) * inv_sin_theta;
+  } else {
+    // sin(s * theta) / sin(theta) ~= s * (1 + theta^2 / 6 * (1 - s^2))
+    const Scalar theta2_6 = one_minus_d / 3;
+    const Scalar s0 = 1 - t;
+    scale0 = s0 * (1 + theta2_6 * (1 - s0 * s0));
+    scale1 = t * (1 + theta2_6 * (1 - t * t));
+  }
+  if (d < 0) { scale1 = -scale1; }
+
+  Eigen::Quaternion<Scalar> result;
+  result.coeffs() = scale0 * a.coeffs() + scale1 * b.coeffs();
+  return result;
+}
+
+/// Store @p q into @p so3 without the normalization and checks that
+/// the Sophus constructors and setQuaternion perform.  @p q must
+/// already be unit length.
+template <typename Scalar>
+void SetUnitQuaternion(Sophus::SO3<Scalar>* so3,
+                       const Eigen::Quaternion<Scalar>& q) {
+  // Sophus stores the quaternion as x, y, z, w, the same as Eigen.
+  Scalar* const data = so3->data();
+  data[0] = q.x();
+  data[1] = q.y();
+  data[2] = q.z();
+  data[3] = q.w();
+}
+
+/// A rigid body transform, stored as a rotation matrix and a
+/// translation.
+///
+/// Converting from a Sophus pose costs one quaternion to matrix
+/// conversion, after which every point or vector transformed costs a
+/// 3x3 matrix multiply instead of a quaternion rotation.  It is meant
+/// to be built once per control cycle and then applied to each of the
+/// legs.
+template <typename Scalar>
+class RigidTransform {
+ public:
+  using Vector3 = Eigen::Matrix<Scalar, 3, 1>;
+  using Matrix3 = Eigen::Matrix<Scalar, 3, 3>;
+
+  RigidTransform()
+      : rotation_(Matrix3::Identity()),
+        translation_(Vector3::Zero()) {}
+
+  RigidTransform(const Matrix3& rotation, const Vector3& translation)
+      : rotation_(rotation),
+        translation_(translation) {}
+
+  template <typename Other>
+  explicit RigidTransform(const Sophus::SE3<Other>& pose)
+      : rotation_(UnitQuaternionMatrix(
+                      pose.so3().unit_quaternion().template cast<Scalar>())),
+        translation_(pose.translation().template cast<Scalar>()) {}
+
+  static RigidTransform FromQuaternion(
+      const Eigen::Quaternion<Scalar>& rotation,
+      const Vector3& translation = Vector3::Zero()) {
+    return RigidTransform(UnitQuaternionMatrix(rotation), translation);
+  }
+
+  const Matrix3& rotation() const { return rotation_; }
+  const Vector3& translation() const { return translation_; }
+
+  /// Transform a point.
+  Vector3 operator*(const Vector3& point) const {
+    return rotation_ * point + translation_;
+  }
+
+  /// Transform a free vector, like a velocity or force.
+  Vector3 Rotate(const Vector3& vector) const {
+    return rotation_ * vector;
+  }
+
+  RigidTransform operator*(const RigidTransform& rhs) const {
+    return RigidTransform(rotation_ * rhs.rotation_,
+                          rotation_ * rhs.translation_ + translation_);
+  }
+
+  RigidTransform inverse() const {
+    const Matrix3 rt = rotation_.transpose();
+    return RigidTransform(rt, -(rt * translation_));
+  }
+
+  /// Transform @p size points from @p in to @p out, which may alias.
+  void Transform(const Vector3* in, Vector3* out, std::size_t size) const {
+    for (std::size_t i = 0; i < size; i++) {
+      out[i] = rotation_ * in[i] + translation_;
+    }
+  }
+
+  /// Rotate @p size vectors from @p in to @p out, which may alias.
+  void Rotate(const Vector3* in, Vector3* out, std::size_t size) const {
+    for (std::size_t i = 0; i < size; i++) {
+      out[i] = rotation_ * in[i];
+    }
+  }
+
+ private:
+  Matrix3 rotation_;
+  Vector3 translation_;
+};
+
+using RigidTransformd = RigidTransform<double>;
+using RigidTransformf = RigidTransform<float>;
+
+}
+}
@@ -0,0 +1,88 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace mjmech {
+namespace base {
+
+/// A fixed capacity, lock-free, single producer single consumer
+/// ring.  All N slots are default constructed up front and are
+/// reused, so a producer which copy assigns into a slot does not
+/// allocate once the slot's own storage has grown to size.
+///
+/// The producer calls push_slot() and then commit_push(), and the
+/// consumer front() and then pop().  Each side may only be used from
+/// one thread at a time.
+template <typename T, std::size_t N>
+class SpscRing {
+ public:
+  static_assert(N >= 2, "one slot is always kept empty");
+
+  /// Return the slot to fill next, or nullptr if the ring is full.
+  T* push_slot() {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (Next(tail) == head_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &data_[tail];
+  }
+
+  /// Publish the slot most recently returned by push_slot().
+  void commit_push() {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    tail_.store(Next(tail), std::memory_order_release);
+  }
+
+  /// Return the oldest published slot, or nullptr if empty.
+  T* front() {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &data_[head];
+  }
+
+  /// Release the slot returned by front() back to the producer.
+  void pop() {
+    const auto head = head_.load(std::memory_order_relaxed);
+    head_.store(Next(head), std::memory_order_release);
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) ==
+        tail_.load(std::memory_order_acquire);
+  }
+
+  static constexpr std::size_t capacity() { return N - 1; }
+
+ private:
+  static std::size_t Next(std::size_t index) {
+    return (index + 1) == N ? 0 : (index + 1);
+  }
+
+  std::array<T, N> data_ = {};
+
+  // The producer and consumer indices live on separate cache lines
+  // so that the two threads do not contend.
+  alignas(64) std::atomic<std::size_t> head_{0};
+  alignas(64) std::atomic<std::size_t> tail_{0};
+};
+
+}
+}
@@ -0,0 +1,121 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <utility>
+
+#include "mjlib/base/assert.h"
+
+namespace mjmech {
+namespace base {
+
+/// A vector-like container with a fixed maximum capacity and inline
+/// storage.  It never allocates, which makes it suitable for use in
+/// the real-time control loop.  All N elements are default
+/// constructed up front, so T must be default constructible and
+/// cheap to copy.
+template <typename T, std::size_t N>
+class StaticVector {
+ public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using reference = T&;
+  using const_reference = const T&;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  StaticVector() {}
+
+  StaticVector(std::initializer_list<T> values) {
+    assign(values.begin(), values.end());
+  }
+
+  template <typename Iterator>
+  StaticVector(Iterator begin, Iterator end) {
+    assign(begin, end);
+  }
+
+  template <typename Iterator>
+  void assign(Iterator begin, Iterator end) {
+    clear();
+    for (auto it = begin; it != end; ++it) {
+      push_back(*it);
+    }
+  }
+
+  void push_back(const T& value) {
+    MJ_ASSERT(size_ < N);
+    data_[size_++] = value;
+  }
+
+  void push_back(T&& value) {
+    MJ_ASSERT(size_ < N);
+    data_[size_++] = std::move(value);
+  }
+
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    MJ_ASSERT(size_ < N);
+    data_[size_] = T(std::forward<Args>(args)...);
+    return data_[size_++];
+  }
+
+  void pop_back() {
+    MJ_ASSERT(size_ > 0);
+    size_--;
+  }
+
+  /// Newly exposed elements are value initialized.
+  void resize(size_type size) {
+    MJ_ASSERT(size <= N);
+    for (size_type i = size_; i < size; i++) {
+      data_[i] = T();
+    }
+    size_ = size;
+  }
+
+  void clear() { size_ = 0; }
+
+  size_type size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == N; }
+  static constexpr size_type capacity() { return N; }
+
+  T& operator[](size_type index) { return data_[index]; }
+  const T& operator[](size_type index) const { return data_[index]; }
+
+  T& front() { return data_[0]; }
+  const T& front() const { return data_[0]; }
+  T& back() { return data_[size_ - 1]; }
+  const T& back() const { return data_[size_ - 1]; }
+
+  T* data() { return data_.data(); }
+  const T* data() const { return data_.data(); }
+
+  iterator begin() { return data_.data(); }
+  iterator end() { return data_.data() + size_; }
+  const_iterator begin() const { return data_.data(); }
+  const_iterator end() const { return data_.data() + size_; }
+
+ private:
+  std::array<T, N> data_ = {};
+  size_type size_ = 0;
+};
+
+}
+}
@@ -26,8 +26,9 @@ class SystemMmap {
  public:
   SystemMmap() {}
 
-  SystemMmap(int fd, size_t size, uint64_t offset) {
-    ptr_ = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+  SystemMmap(int fd, size_t size, uint64_t offset,
+             int prot = PROT_READ | PROT_WRITE) {
+    ptr_ = ::mmap(0, size, prot, MAP_SHARED, fd, offset);
     size_ = size;
     mjlib::base::system_error::throw_if(ptr_ == MAP_FAILED);
   }
@@ -53,6 +54,8 @@ class SystemMmap {
   SystemMmap& operator=(const SystemMmap&) = delete;
 
   void* ptr() { return ptr_; }
+  const void* ptr() const { return ptr_; }
+  size_t size() const { return size_; }
 
   // Since this is intended to be whatever, we just allow it to be
   // converted to any old pointer at will without extra hoops.
@@ -0,0 +1,175 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_log_registrar.h"
+
+#include <chrono>
+
+#include "base/realtime.h"
+
+namespace mjmech {
+namespace base {
+
+namespace {
+/// How long the logging thread sleeps when it finds nothing to do.
+constexpr auto kIdlePeriod = std::chrono::milliseconds(2);
+
+/// How often, in log time, the drop statistics are recorded.
+const auto kStatsPeriod = boost::posix_time::seconds(1);
+}
+
+TelemetryLogRegistrar::TelemetryLogRegistrar(
+    boost::asio::io_context& context,
+    mjlib::telemetry::FileWriter* telemetry_log)
+    : context_(context),
+      telemetry_log_(telemetry_log),
+      open_(telemetry_log->IsOpen()) {
+  stats_identifier_ = telemetry_log_->AllocateIdentifier("telemetry_log");
+  telemetry_log_->WriteSchema(
+      stats_identifier_,
+      mjlib::telemetry::BinarySchemaArchive::template schema<Stats>());
+}
+
+TelemetryLogRegistrar::~TelemetryLogRegistrar() {
+  done_.store(true);
+  if (thread_.joinable()) { thread_.join(); }
+}
+
+TelemetryLogRegistrar::Stats TelemetryLogRegistrar::stats() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return StatsLocked();
+}
+
+TelemetryLogRegistrar::Stats TelemetryLogRegistrar::StatsLocked() const {
+  Stats result;
+
+  for (const auto& channel : channels_) {
+    RecordStats record;
+    record.name = channel->name;
+    record.written = channel->written.load(std::memory_order_relaxed);
+    record.dropped = channel->dropped.load(std::memory_order_relaxed);
+    result.written += record.written;
+    result.dropped += record.dropped;
+    result.records.push_back(record);
+  }
+
+  return result;
+}
+
+void TelemetryLogRegistrar::Open(std::string_view filename) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  telemetry_log_->Open(filename);
+  open_.store(true, std::memory_order_release);
+}
+
+void TelemetryLogRegistrar::Close() {
+  open_.store(false, std::memory_order_release);
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  while (WriteOldest()) {}
+  // The log always ends with the final counts.
+  if (!last_timestamp_.is_not_a_date_time()) { WriteStats(); }
+  telemetry_log_->Close();
+}
+
+void TelemetryLogRegistrar::AddChannel(std::unique_ptr<ChannelBase> channel) {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    channel->identifier = telemetry_log_->AllocateIdentifier(channel->name);
+    channel->WriteSchema(telemetry_log_);
+    channels_.push_back(std::move(channel));
+  }
+
+  // The thread is only started once there is something to log, so
+  // that contexts which never register anything stay single
+  // threaded.
+  if (!thread_.joinable()) {
+    thread_ = std::thread(std::bind(&TelemetryLogRegistrar::Run, this));
+  }
+}
+
+void TelemetryLogRegistrar::Run() {
+  ConfigureRealtimeThread(RealtimeThread::kLog);
+
+  while (!done_.load()) {
+    const auto count = DrainAll();
+
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (!last_timestamp_.is_not_a_date_time() &&
+          (last_stats_timestamp_.is_not_a_date_time() ||
+           (last_timestamp_ - last_stats_timestamp_) >= kStatsPeriod)) {
+        WriteStats();
+      }
+    }
+
+    if (count == 0) { std::this_thread::sleep_for(kIdlePeriod); }
+  }
+
+  // Write anything which arrived before we were asked to stop.
+  DrainAll();
+}
+
+size_t TelemetryLogRegistrar::DrainAll() {
+  size_t count = 0;
+
+  // The lock is taken for each instance, so that Open and Close
+  // never wait for a whole backlog.
+  while (true) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!WriteOldest()) { break; }
+    count++;
+  }
+
+  return count;
+}
+
+bool TelemetryLogRegistrar::WriteOldest() {
+  // Each ring is in timestamp order, so merging their heads keeps
+  // the log in timestamp order across records.
+  ChannelBase* oldest = nullptr;
+  boost::posix_time::ptime oldest_timestamp;
+  for (auto& channel : channels_) {
+    const auto timestamp = channel->front_timestamp();
+    if (timestamp.is_not_a_date_time()) { continue; }
+    if (!oldest || timestamp < oldest_timestamp) {
+      oldest = channel.get();
+      oldest_timestamp = timestamp;
+    }
+  }
+  if (!oldest) { return false; }
+
+  // Instances which were queued as the log was closed are discarded.
+  oldest->WriteFront(telemetry_log_->IsOpen() ? telemetry_log_ : nullptr);
+  if (last_timestamp_.is_not_a_date_time() ||
+      oldest_timestamp > last_timestamp_) {
+    last_timestamp_ = oldest_timestamp;
+  }
+  return true;
+}
+
+void TelemetryLogRegistrar::WriteStats() {
+  last_stats_timestamp_ = last_timestamp_;
+
+  if (!telemetry_log_->IsOpen()) { return; }
+
+  const auto current = StatsLocked();
+  auto buffer = telemetry_log_->GetBuffer();
+  mjlib::telemetry::BinaryWriteArchive(*buffer).Accept(&current);
+  telemetry_log_->WriteData(
+      last_timestamp_, stats_identifier_, std::move(buffer));
+}
+
+}
+}
@@ -14,13 +14,24 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
 #include <boost/asio/io_context.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/signals2/signal.hpp>
 
+#include "mjlib/base/visitor.h"
 #include "mjlib/io/now.h"
 #include "mjlib/telemetry/binary_write_archive.h"
 #include "mjlib/telemetry/file_writer.h"
 
+#include "base/spsc_ring.h"
 
 namespace mjmech {
 namespace base {
@@ -28,44 +39,183 @@ namespace base {
 /// TelemetryLog instance using the TelemetryArchive for
 /// serialization.
 ///
-/// NOTE: Ideally this would be noncopyable, but std::tuple doesn't
-/// currently allow construction of noncopyable members.
+/// The emitting thread only copies each record into a preallocated
+/// slot of a per-record lock-free ring.  A separate logging thread
+/// performs all serialization, and writes the queued instances of all
+/// records in timestamp order.  If a ring is full when a record is
+/// emitted, that instance is dropped and counted.  The counts are
+/// written to the log as the "telemetry_log" record, and are
+/// available from stats().
 ///
-/// NOTE: In the future, this could have policies around which records
-/// are written to the log and at what rate.
-class TelemetryLogRegistrar {
+/// Every access to the FileWriter is made under one mutex, so once
+/// the registrar is constructed, the log must only be opened and
+/// closed through Open() and Close(), and any other direct use must
+/// go through WithLog().
+class TelemetryLogRegistrar : boost::noncopyable {
  public:
+  /// How many unwritten instances of each record may be queued.
+  static constexpr size_t kQueueSize = 64;
+
   TelemetryLogRegistrar(boost::asio::io_context& context,
-                        mjlib::telemetry::FileWriter* telemetry_log)
-      : context_(context),
-        telemetry_log_(telemetry_log) {}
+                        mjlib::telemetry::FileWriter* telemetry_log);
+  ~TelemetryLogRegistrar();
 
   template <typename T>
   void Register(const std::string& name,
                 boost::signals2::signal<void (const T*)>* signal) {
-    const auto identifier = telemetry_log_->AllocateIdentifier(name);
-    telemetry_log_->WriteSchema(
-        identifier,
-        mjlib::telemetry::BinarySchemaArchive::template schema<T>());
+    auto channel = std::make_unique<Channel<T>>(name);
+    auto* const ptr = channel.get();
+    AddChannel(std::move(channel));
     signal->connect(std::bind(&TelemetryLogRegistrar::HandleData<T>,
-                              this, identifier,
-                              std::placeholders::_1));
+                              this, ptr, std::placeholders::_1));
   }
 
+  struct RecordStats {
+    std::string name;
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(name));
+      a->Visit(MJ_NVP(written));
+      a->Visit(MJ_NVP(dropped));
+    }
+  };
+
+  struct Stats {
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    std::vector<RecordStats> records;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(written));
+      a->Visit(MJ_NVP(dropped));
+      a->Visit(MJ_NVP(records));
+    }
+  };
+
+  /// This may be called from any thread.
+  Stats stats() const;
+
+  /// Open the log, which starts recording emitted records.  This may
+  /// be called from any thread.
+  void Open(std::string_view filename);
+
+  /// Write everything queued so far and the current statistics, then
+  /// close the log.  This may be
+  /// called from any thread.
+  void Close();
+
+  bool IsOpen() const { return open_.load(std::memory_order_acquire); }
+
+  /// Call @p operation with the FileWriter, while no other thread may
+  /// use it.
+  template <typename Operation>
+  auto WithLog(Operation operation) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return operation(telemetry_log_);
+  }
+
+ private:
+  class ChannelBase : boost::noncopyable {
+   public:
+    ChannelBase(const std::string& name_in) : name(name_in) {}
+    virtual ~ChannelBase() {}
+
+    /// The timestamp of the oldest queued instance, or
+    /// not_a_date_time if there is none.
+    virtual boost::posix_time::ptime front_timestamp() = 0;
+
+    /// Serialize and write the oldest queued instance, or just
+    /// discard it if @p log is nullptr.
+    virtual void WriteFront(mjlib::telemetry::FileWriter* log) = 0;
+
+    virtual void WriteSchema(mjlib::telemetry::FileWriter*) = 0;
+
+    const std::string name;
+    mjlib::telemetry::FileWriter::Identifier identifier = {};
+
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> dropped{0};
+  };
+
   template <typename T>
-  void HandleData(mjlib::telemetry::FileWriter::Identifier identifier,
-                  const T* data) {
-    // If the log isn't open, don't even bother serializing things.
-    if (!telemetry_log_->IsOpen()) { return; }
-
-    auto buffer = telemetry_log_->GetBuffer();
-    mjlib::telemetry::BinaryWriteArchive(*buffer).Accept(data);
-    telemetry_log_->WriteData(
-        mjlib::io::Now(context_), identifier, std::move(buffer));
+  class Channel : public ChannelBase {
+   public:
+    Channel(const std::string& name) : ChannelBase(name) {}
+    ~Channel() override {}
+
+    boost::posix_time::ptime front_timestamp() override {
+      const auto* const entry = ring.front();
+      return entry ? entry->timestamp : boost::posix_time::ptime();
+    }
+
+    void WriteFront(mjlib::telemetry::FileWriter* log) override {
+      auto* const entry = ring.front();
+      if (log) {
+        auto buffer = log->GetBuffer();
+        mjlib::telemetry::BinaryWriteArchive(*buffer).Accept(&entry->data);
+        log->WriteData(entry->timestamp, identifier, std::move(buffer));
+        written.fetch_add(1, std::memory_order_relaxed);
+      }
+      ring.pop();
+    }
+
+    void WriteSchema(mjlib::telemetry::FileWriter* log) override {
+      log->WriteSchema(
+          identifier,
+          mjlib::telemetry::BinarySchemaArchive::template schema<T>());
+    }
+
+    struct Entry {
+      boost::posix_time::ptime timestamp;
+      T data;
+    };
+
+    SpscRing<Entry, kQueueSize + 1> ring;
+  };
+
+  template <typename T>
+  void HandleData(Channel<T>* channel, const T* data) {
+    // If the log isn't open, don't even bother copying things.
+    if (!IsOpen()) { return; }
+
+    auto* const entry = channel->ring.push_slot();
+    if (!entry) {
+      channel->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    entry->timestamp = mjlib::io::Now(context_);
+    // Assigning into the reused slot lets any containers keep their
+    // storage, so this does not allocate in the steady state.
+    entry->data = *data;
+    channel->ring.commit_push();
   }
 
+  void AddChannel(std::unique_ptr<ChannelBase>);
+  void Run();
+  size_t DrainAll();
+  bool WriteOldest();
+  void WriteStats();
+  Stats StatsLocked() const;
+
   boost::asio::io_context& context_;
+
+  // This guards telemetry_log_, channels_, and the consumer side of
+  // every channel's ring.
+  mutable std::mutex mutex_;
   mjlib::telemetry::FileWriter* const telemetry_log_;
+  std::vector<std::unique_ptr<ChannelBase>> channels_;
+  mjlib::telemetry::FileWriter::Identifier stats_identifier_ = {};
+  boost::posix_time::ptime last_timestamp_;
+  boost::posix_time::ptime last_stats_timestamp_;
+
+  std::atomic<bool> open_{false};
+  std::atomic<bool> done_{false};
+  std::thread thread_;
 };
 }
 }
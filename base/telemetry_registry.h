@@ -64,6 +64,9 @@ class TelemetryRegistry : boost::noncopyable {
     signal->connect(Register<DataObject>(record_name));
   }
 
+  /// The log is opened and closed through this.
+  TelemetryLogRegistrar* log() { return &log_; }
+
  private:
   struct Base {
     virtual ~Base() {}
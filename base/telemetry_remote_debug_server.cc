@@ -14,11 +14,14 @@
 
 #include "telemetry_remote_debug_server.h"
 
+#include <algorithm>
+
 #include <boost/asio/post.hpp>
 
 #include "mjlib/base/json5_read_archive.h"
 #include "mjlib/base/json5_write_archive.h"
 #include "mjlib/base/fail.h"
+#include "mjlib/io/now.h"
 
 namespace mjmech {
 namespace base {
@@ -51,11 +54,13 @@ class TelemetryRemoteDebugServer::Impl : boost::noncopyable {
   struct Message {
     std::string command;
     std::vector<std::string> names;
+    double rate_hz = 0.0;
 
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(command));
       a->Visit(MJ_NVP(names));
+      a->Visit(MJ_NVP(rate_hz));
     }
   };
 
@@ -65,7 +70,21 @@ class TelemetryRemoteDebugServer::Impl : boost::noncopyable {
     if (message.command == "enumerate") {
       DoEnumerate(from);
     } else if (message.command == "get") {
-      DoGet(message, from);
+      ForEachHandler(message, [&](auto* handler) {
+          handler->Respond(from);
+        });
+    } else if (message.command == "subscribe") {
+      ForEachHandler(message, [&](auto* handler) {
+          handler->Subscribe(from, message.rate_hz);
+        });
+    } else if (message.command == "stream") {
+      ForEachHandler(message, [&](auto* handler) {
+          handler->Stream(from, message.rate_hz);
+        });
+    } else if (message.command == "unsubscribe") {
+      ForEachHandler(message, [&](auto* handler) {
+          handler->Unsubscribe(from);
+        });
     } else {
       std::cerr << "unknown remote debug command: '"
                 << message.command << "'\n";
@@ -99,8 +118,8 @@ class TelemetryRemoteDebugServer::Impl : boost::noncopyable {
                                     std::placeholders::_1));
   }
 
-  void DoGet(const Message& message,
-             const udp::endpoint& from) {
+  template <typename Operation>
+  void ForEachHandler(const Message& message, Operation operation) {
     for (const auto& name : message.names) {
       auto it = handlers_.find(name);
       if (it == handlers_.end()) {
@@ -108,7 +127,7 @@ class TelemetryRemoteDebugServer::Impl : boost::noncopyable {
         continue;
       }
 
-      it->second->Respond(from);
+      operation(it->second.get());
     }
   }
 
@@ -124,8 +143,120 @@ class TelemetryRemoteDebugServer::Impl : boost::noncopyable {
   udp::endpoint receive_endpoint_;
 
   std::map<std::string, std::unique_ptr<Handler> > handlers_;
+  uint32_t next_identifier_ = 1;
 };
 
+void TelemetryRemoteDebugServer::Handler::Respond(
+    const udp::endpoint& endpoint) {
+  if (std::find(pending_.begin(), pending_.end(), endpoint) !=
+      pending_.end()) {
+    return;
+  }
+  pending_.push_back(endpoint);
+}
+
+void TelemetryRemoteDebugServer::Handler::Subscribe(
+    const udp::endpoint& endpoint, double rate_hz) {
+  AddSubscription(endpoint, rate_hz,
+                  parent_->impl_->parameters_.max_rate_hz, false);
+}
+
+void TelemetryRemoteDebugServer::Handler::Stream(
+    const udp::endpoint& endpoint, double rate_hz) {
+  AddSubscription(endpoint, rate_hz,
+                  parent_->impl_->parameters_.max_stream_rate_hz, true);
+
+  mjlib::base::FastOStringStream stream;
+  TelemetryStreamFrame::WriteSchemaHeader(stream, identifier_, name_);
+  const auto schema_data = schema();
+  stream.write(schema_data);
+  parent_->SendResponse(stream.str(), endpoint);
+}
+
+void TelemetryRemoteDebugServer::Handler::AddSubscription(
+    const udp::endpoint& endpoint, double rate_hz, double max_rate_hz,
+    bool binary) {
+  const auto& parameters = parent_->impl_->parameters_;
+  const double limited_hz =
+      (rate_hz <= 0.0 || rate_hz > max_rate_hz) ? max_rate_hz : rate_hz;
+  const auto now = parent_->Now();
+
+  // An endpoint may hold both a JSON and a binary subscription, so
+  // only one of the same kind is replaced.
+  subscriptions_.erase(
+      std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+                     [&](const auto& subscription) {
+                       return subscription.endpoint == endpoint &&
+                           subscription.binary == binary;
+                     }),
+      subscriptions_.end());
+
+  Subscription subscription;
+  subscription.endpoint = endpoint;
+  subscription.binary = binary;
+  subscription.period =
+      boost::posix_time::microseconds(static_cast<int64_t>(1e6 / limited_hz));
+  subscription.next_send = now;
+  subscription.expiration = now + boost::posix_time::microseconds(
+      static_cast<int64_t>(1e6 * parameters.subscription_timeout_s));
+  subscriptions_.push_back(subscription);
+}
+
+void TelemetryRemoteDebugServer::Handler::Unsubscribe(
+    const udp::endpoint& endpoint) {
+  subscriptions_.erase(
+      std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+                     [&](const auto& subscription) {
+                       return subscription.endpoint == endpoint;
+                     }),
+      subscriptions_.end());
+}
+
+bool TelemetryRemoteDebugServer::Handler::CollectDue() {
+  due_.clear();
+  due_.swap(pending_);
+  binary_due_.clear();
+
+  if (!subscriptions_.empty()) {
+    const auto now = parent_->Now();
+
+    subscriptions_.erase(
+        std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+                       [&](const auto& subscription) {
+                         return now >= subscription.expiration;
+                       }),
+        subscriptions_.end());
+
+    for (auto& subscription : subscriptions_) {
+      if (now < subscription.next_send) { continue; }
+      // Advance from the previous deadline where possible, so that
+      // the average rate matches the requested one.
+      subscription.next_send += subscription.period;
+      if (subscription.next_send < now) { subscription.next_send = now; }
+
+      auto& due = subscription.binary ? binary_due_ : due_;
+      if (std::find(due.begin(), due.end(), subscription.endpoint) ==
+          due.end()) {
+        due.push_back(subscription.endpoint);
+      }
+    }
+  }
+
+  return !due_.empty() || !binary_due_.empty();
+}
+
+void TelemetryRemoteDebugServer::Handler::Send(const std::string& data) {
+  for (const auto& endpoint : due_) {
+    parent_->SendResponse(data, endpoint);
+  }
+}
+
+void TelemetryRemoteDebugServer::Handler::SendBinary(const std::string& data) {
+  for (const auto& endpoint : binary_due_) {
+    parent_->SendResponse(data, endpoint);
+  }
+}
+
 TelemetryRemoteDebugServer::TelemetryRemoteDebugServer(
     const boost::asio::any_io_executor& executor)
     : impl_(new Impl(executor)) {}
@@ -137,6 +268,19 @@ TelemetryRemoteDebugServer::parameters() {
   return &impl_->parameters_;
 }
 
+TelemetryRemoteDebugServer::udp::endpoint
+TelemetryRemoteDebugServer::local_endpoint() const {
+  return impl_->socket_.local_endpoint();
+}
+
+boost::posix_time::ptime TelemetryRemoteDebugServer::Now() const {
+  return mjlib::io::Now(impl_->executor_.context());
+}
+
+uint32_t TelemetryRemoteDebugServer::AllocateIdentifier() {
+  return impl_->next_identifier_++;
+}
+
 void TelemetryRemoteDebugServer::AsyncStart(mjlib::io::ErrorCallback handler) {
   impl_->socket_.open(udp::v4());
   udp::endpoint endpoint(udp::v4(), impl_->parameters_.port);
@@ -14,16 +14,48 @@
 
 #pragma once
 
+#include <vector>
+
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/udp.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/signals2/signal.hpp>
 
+#include "mjlib/base/fast_stream.h"
 #include "mjlib/base/json5_write_archive.h"
 #include "mjlib/io/async_types.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+
+#include "base/telemetry_stream_frame.h"
 
 namespace mjmech {
 namespace base {
 
+/// Serves registered telemetry records over UDP, either as JSON, or
+/// as a binary stream using the same schema and encoding as the
+/// telemetry log.
+///
+/// Clients may send:
+///  * {"command":"enumerate"} - list the available names
+///  * {"command":"get","names":[...]} - reply once with the next
+///    emission of each name
+///  * {"command":"subscribe","names":[...],"rate_hz":N} - reply with
+///    emissions of each name at no more than N Hz, until
+///    subscription_timeout_s passes without the subscription being
+///    renewed
+///  * {"command":"stream","names":[...],"rate_hz":N} - like
+///    subscribe, but reply with binary TelemetryStreamFrame
+///    datagrams, capped at max_stream_rate_hz.  The schema of each
+///    name is sent first, and again each time the stream is renewed,
+///    so a client that misses it can recover.
+///  * {"command":"unsubscribe","names":[...]} - end both
+///    subscriptions and streams
+///
+/// Each record has a fixed identifier, assigned in registration
+/// order, which its schema and data frames share.
+///
+/// Records are only serialized when some client has asked for them,
+/// so an idle server costs a single branch per emission.
 class TelemetryRemoteDebugServer : boost::noncopyable {
  public:
   typedef boost::asio::ip::udp udp;
@@ -34,14 +66,30 @@ class TelemetryRemoteDebugServer : boost::noncopyable {
   struct Parameters {
     int port = 13380;
 
+    /// Subscriptions are capped at this rate, regardless of what the
+    /// client requests.
+    double max_rate_hz = 50.0;
+
+    /// The binary stream costs no formatting on the robot, so it may
+    /// run faster than JSON subscriptions.
+    double max_stream_rate_hz = 400.0;
+
+    double subscription_timeout_s = 10.0;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(port));
+      a->Visit(MJ_NVP(max_rate_hz));
+      a->Visit(MJ_NVP(max_stream_rate_hz));
+      a->Visit(MJ_NVP(subscription_timeout_s));
     }
   };
 
   Parameters* parameters();
 
+  /// Only valid after AsyncStart.
+  udp::endpoint local_endpoint() const;
+
   void AsyncStart(mjlib::io::ErrorCallback handler);
 
   template <typename T>
@@ -55,12 +103,67 @@ class TelemetryRemoteDebugServer : boost::noncopyable {
  private:
   class Handler : boost::noncopyable {
    public:
+    Handler(TelemetryRemoteDebugServer* parent, const std::string& name)
+        : parent_(parent),
+          name_(name),
+          identifier_(parent->AllocateIdentifier()) {}
     virtual ~Handler() {}
 
-    /// Send now, or in the future, the contents of this registration
-    /// to the given UDP endpoint.  If a request is still outstanding,
-    /// this will be a noop.
-    virtual void Respond(const udp::endpoint&) = 0;
+    /// Send the next emission of this registration to the given UDP
+    /// endpoint.  If a request is still outstanding, this will be a
+    /// noop.
+    void Respond(const udp::endpoint&);
+
+    /// Send emissions to the given endpoint at no more than the given
+    /// rate, replacing any existing subscription from it.
+    void Subscribe(const udp::endpoint&, double rate_hz);
+
+    /// Like Subscribe, but with binary frames.  The schema is sent
+    /// immediately.
+    void Stream(const udp::endpoint&, double rate_hz);
+
+    void Unsubscribe(const udp::endpoint&);
+
+   protected:
+    /// True if any emission could possibly need to be sent.  This is
+    /// checked on every emission, so must be cheap.
+    bool active() const {
+      return !pending_.empty() || !subscriptions_.empty();
+    }
+
+    /// Determine the endpoints which should receive the current
+    /// emission, retiring one-shot requests and expired
+    /// subscriptions.  Return true if there are any.
+    bool CollectDue();
+
+    bool json_due() const { return !due_.empty(); }
+    bool binary_due() const { return !binary_due_.empty(); }
+
+    void Send(const std::string& data);
+    void SendBinary(const std::string& data);
+
+    virtual std::string schema() const = 0;
+
+    TelemetryRemoteDebugServer* const parent_;
+    const std::string name_;
+    const uint32_t identifier_;
+
+   private:
+    struct Subscription {
+      udp::endpoint endpoint;
+      bool binary = false;
+      boost::posix_time::time_duration period;
+      boost::posix_time::ptime next_send;
+      boost::posix_time::ptime expiration;
+    };
+
+    void AddSubscription(const udp::endpoint&, double rate_hz,
+                         double max_rate_hz, bool binary);
+
+    std::vector<udp::endpoint> pending_;
+    std::vector<Subscription> subscriptions_;
+    std::vector<udp::endpoint> due_;
+    std::vector<udp::endpoint> binary_due_;
   };
 
   template <typename T>
@@ -97,38 +200,46 @@ class TelemetryRemoteDebugServer : boost::noncopyable {
     std::string name;
   };
 
-  /// This is the handler for classes which are default and
-  /// copy-constructable.
-  ///
-  /// TODO jpieper: Make an implementation for classes which do not
-  /// have these properties, which just waits for a signal to come in
-  /// before responding.
+  /// Nothing is copied or serialized at emission time unless some
+  /// client is waiting for this record.
   template <typename T>
   class ConcreteHandler : public Handler {
    public:
     ConcreteHandler(TelemetryRemoteDebugServer* parent,
                     const std::string& name,
                     boost::signals2::signal<void (const T*)>* signal)
-        : parent_(parent),
-          name_(name) {
+        : Handler(parent, name) {
       signal->connect(std::bind(&ConcreteHandler::HandleData, this,
                                 std::placeholders::_1));
     }
-    virtual ~ConcreteHandler() {}
+    ~ConcreteHandler() override {}
+
+    void HandleData(const T* data) {
+      if (!active()) { return; }
+      if (!CollectDue()) { return; }
 
+      if (json_due()) {
+        // The archive only reads through this pointer.
+        Response<T> response(const_cast<T*>(data), name_);
+        Send(mjlib::base::Json5WriteArchive::Write(response));
+      }
+      if (binary_due()) {
+        mjlib::base::FastOStringStream stream;
+        TelemetryStreamFrame::WriteDataHeader(
+            stream, identifier_, parent_->Now());
+        mjlib::telemetry::BinaryWriteArchive(stream).Accept(data);
+        SendBinary(stream.str());
+      }
+    }
 
-    virtual void Respond(const udp::endpoint& endpoint) {
-      Response<T> response(&data_, name_);
-      parent_->SendResponse(mjlib::base::Json5WriteArchive::Write(response),
-                            endpoint);
+    std::string schema() const override {
+      return mjlib::telemetry::BinarySchemaArchive::template schema<T>();
     }
+  };
 
-    void HandleData(const T* data) { data_ = *data; }
+  boost::posix_time::ptime Now() const;
 
-    TelemetryRemoteDebugServer* const parent_;
-    const std::string name_;
-    T data_;
-  };
+  uint32_t AllocateIdentifier();
 
   void RegisterHandler(const std::string&, std::unique_ptr<Handler>);
 
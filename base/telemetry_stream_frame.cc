@@ -0,0 +1,94 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_stream_frame.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/telemetry/format.h"
+
+namespace mjmech {
+namespace base {
+
+namespace {
+const boost::posix_time::ptime kEpoch(boost::gregorian::date(1970, 1, 1));
+}
+
+void TelemetryStreamFrame::WriteSchemaHeader(
+    mjlib::base::WriteStream& stream,
+    uint32_t identifier,
+    std::string_view name) {
+  mjlib::telemetry::WriteStream ts{stream};
+  ts.Write(static_cast<uint8_t>(kSchema));
+  ts.Write(identifier);
+  const auto size = std::min<size_t>(
+      name.size(), std::numeric_limits<uint16_t>::max());
+  ts.Write(static_cast<uint16_t>(size));
+  stream.write({name.data(), size});
+}
+
+void TelemetryStreamFrame::WriteDataHeader(
+    mjlib::base::WriteStream& stream,
+    uint32_t identifier,
+    boost::posix_time::ptime timestamp) {
+  mjlib::telemetry::WriteStream ts{stream};
+  ts.Write(static_cast<uint8_t>(kData));
+  ts.Write(identifier);
+  ts.Write(static_cast<int64_t>((timestamp - kEpoch).total_microseconds()));
+}
+
+std::optional<TelemetryStreamFrame> TelemetryStreamFrame::Parse(
+    std::string_view datagram) {
+  mjlib::base::BufferReadStream bs{datagram};
+  mjlib::telemetry::ReadStream ts{bs};
+
+  // Every field read below has a fixed size, so the payload starts at
+  // a known offset.
+  size_t offset = 0;
+  const auto type = ts.Read<uint8_t>();
+  const auto identifier = ts.Read<uint32_t>();
+  if (!type || !identifier) { return {}; }
+  offset += sizeof(uint8_t) + sizeof(uint32_t);
+
+  TelemetryStreamFrame result;
+  result.identifier = *identifier;
+
+  if (*type == kSchema) {
+    const auto size = ts.Read<uint16_t>();
+    if (!size) { return {}; }
+    offset += sizeof(uint16_t);
+    if (offset + *size > datagram.size()) { return {}; }
+    result.type = kSchema;
+    result.name = std::string(datagram.substr(offset, *size));
+    offset += *size;
+  } else if (*type == kData) {
+    const auto timestamp_us = ts.Read<int64_t>();
+    if (!timestamp_us) { return {}; }
+    offset += sizeof(int64_t);
+    result.type = kData;
+    result.timestamp =
+        mjlib::base::ConvertEpochMicrosecondsToPtime(*timestamp_us);
+  } else {
+    return {};
+  }
+
+  result.payload = datagram.substr(offset);
+  return result;
+}
+
+}
+}
@@ -0,0 +1,77 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/base/stream.h"
+
+namespace mjmech {
+namespace base {
+
+/// One datagram of the binary telemetry stream served by
+/// TelemetryRemoteDebugServer.
+///
+/// All integers are little endian.  A schema frame is:
+///  * uint8 kSchema
+///  * uint32 identifier
+///  * uint16 name size, then the name
+///  * the record's BinarySchemaArchive schema
+///
+/// A data frame is:
+///  * uint8 kData
+///  * uint32 identifier
+///  * int64 timestamp, in microseconds since the epoch
+///  * the record, as written by BinaryWriteArchive
+///
+/// The schema and data are encoded exactly as in a telemetry log, so
+/// the same parsers read both.
+struct TelemetryStreamFrame {
+  enum Type : uint8_t {
+    kSchema = 1,
+    kData = 2,
+  };
+
+  Type type = kData;
+  uint32_t identifier = 0;
+
+  /// Only set for schema frames.
+  std::string name;
+
+  /// Only set for data frames.
+  boost::posix_time::ptime timestamp;
+
+  /// The schema or the data.  This references the parsed datagram.
+  std::string_view payload;
+
+  static void WriteSchemaHeader(mjlib::base::WriteStream&,
+                                uint32_t identifier,
+                                std::string_view name);
+
+  static void WriteDataHeader(mjlib::base::WriteStream&,
+                              uint32_t identifier,
+                              boost::posix_time::ptime timestamp);
+
+  /// Return nothing if @p datagram is not a valid frame.
+  static std::optional<TelemetryStreamFrame> Parse(std::string_view datagram);
+};
+
+}
+}
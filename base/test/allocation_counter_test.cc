@@ -0,0 +1,53 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/allocation_counter.h"
+
+#include <vector>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "base/static_vector.h"
+
+namespace base = mjmech::base;
+
+BOOST_AUTO_TEST_CASE(AllocationCounterTest) {
+  BOOST_TEST_REQUIRE(base::IsAllocationCountingEnabled());
+
+  {
+    const auto start = base::GetAllocationCount();
+    // Call the allocation function directly, since new-expressions
+    // may be elided by the optimizer.
+    void* const ptr = ::operator new(16);
+    BOOST_TEST(base::GetAllocationCount() == start + 1);
+    ::operator delete(ptr);
+  }
+
+  {
+    const auto start = base::GetAllocationCount();
+    base::StaticVector<int, 8> dut;
+    for (int i = 0; i < 8; i++) { dut.push_back(i); }
+    BOOST_TEST(base::GetAllocationCount() == start);
+  }
+
+  {
+    std::vector<int> dut;
+    dut.reserve(8);
+    const auto start = base::GetAllocationCount();
+    for (int i = 0; i < 8; i++) { dut.push_back(i); }
+    dut.clear();
+    for (int i = 0; i < 8; i++) { dut.push_back(i); }
+    BOOST_TEST(base::GetAllocationCount() == start);
+  }
+}
@@ -0,0 +1,41 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/dense_id_map.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::DenseIdMap;
+
+BOOST_AUTO_TEST_CASE(DenseIdMapBasic) {
+  DenseIdMap<16> dut;
+  BOOST_TEST(dut.size() == 0);
+  BOOST_TEST(dut.Find(3) == -1);
+
+  dut.Insert(3, 0);
+  dut.Insert(12, 1);
+  dut.Insert(1, 2);
+
+  BOOST_TEST(dut.size() == 3);
+  BOOST_TEST(dut[3] == 0);
+  BOOST_TEST(dut[12] == 1);
+  BOOST_TEST(dut[1] == 2);
+  BOOST_TEST(dut.contains(12));
+  BOOST_TEST(!dut.contains(2));
+
+  // Out of range ids are simply not present.
+  BOOST_TEST(dut.Find(-1) == -1);
+  BOOST_TEST(dut.Find(16) == -1);
+  BOOST_TEST(dut.Find(1000) == -1);
+}
@@ -47,3 +47,100 @@ BOOST_AUTO_TEST_CASE(BasicFitPlane, * boost::unit_test::tolerance(1e-4)) {
     BOOST_TEST(result.b == 0.5);
   }
 }
+
+BOOST_AUTO_TEST_CASE(FitPlaneNormalEquations,
+                     * boost::unit_test::tolerance(1e-6)) {
+  const std::vector<std::vector<Eigen::Vector3d>> tests = {
+    { { -2, -2, -1 }, { -2, 2, -1 }, { 2, -2, 1 }, { 2, 2, 1 }, },
+    { { 0.1, 0.2, 0.25 }, { -0.15, 0.12, 0.21 },
+      { 0.12, -0.18, 0.2 }, { -0.13, -0.11, 0.18 }, },
+    { { 0.1, 0.2, 0.25 }, { -0.15, 0.12, 0.21 }, { 0.12, -0.18, 0.2 }, },
+  };
+
+  for (const auto& points : tests) {
+    const auto expected = FitPlane(points);
+    const auto result = FitPlane(points.data(), points.size());
+    BOOST_TEST(result.a == expected.a);
+    BOOST_TEST(result.b == expected.b);
+    BOOST_TEST(result.c == expected.c);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FitPlaneDegenerate,
+                     * boost::unit_test::tolerance(1e-6)) {
+  const std::vector<std::vector<Eigen::Vector3d>> tests = {
+    // Collinear in x and y.
+    { { 0.1, 0.1, 0.2 }, { 0.2, 0.2, 0.3 }, { 0.3, 0.3, 0.4 }, },
+    // Coincident in x and y.
+    { { 0.1, 0.1, 0.2 }, { 0.1, 0.1, 0.3 }, },
+    { { 0.1, -0.1, 0.2 }, },
+  };
+
+  for (const auto& points : tests) {
+    const auto expected = FitPlane(points);
+    const auto result = FitPlane(points.data(), points.size());
+    BOOST_TEST(result.a == expected.a);
+    BOOST_TEST(result.b == expected.b);
+    BOOST_TEST(result.c == expected.c);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FitPlaneWeighted, * boost::unit_test::tolerance(1e-9)) {
+  const std::vector<Eigen::Vector3d> points = {
+    { 0.2, 0.15, 0.01 },
+    { 0.2, -0.15, -0.01 },
+    { -0.2, 0.15, 0.005 },
+    { -0.2, -0.15, 0.03 },
+  };
+
+  {
+    // Uniform weights of any scale are the same as no weights.
+    const double weights[] = {2.5, 2.5, 2.5, 2.5};
+    const auto expected = FitPlane(points.data(), points.size());
+    const auto result = FitPlane(points.data(), weights, points.size());
+    BOOST_TEST(result.a == expected.a);
+    BOOST_TEST(result.b == expected.b);
+    BOOST_TEST(result.c == expected.c);
+  }
+
+  {
+    // A zero weight removes the point, and three points are fit
+    // exactly.
+    const double weights[] = {1.0, 1.0, 1.0, 0.0};
+    const auto expected = FitPlane(points.data(), 3);
+    const auto result = FitPlane(points.data(), weights, points.size());
+    BOOST_TEST(result.a == expected.a);
+    BOOST_TEST(result.b == expected.b);
+    BOOST_TEST(result.c == expected.c);
+
+    for (size_t i = 0; i < 3; i++) {
+      const auto& p = points[i];
+      BOOST_TEST(result.a * p.x() + result.b * p.y() + result.c == p.z());
+    }
+  }
+
+  {
+    // A weighted fit is the same as an unweighted one with the points
+    // repeated.
+    const double weights[] = {1.0, 2.0, 1.0, 3.0};
+    std::vector<Eigen::Vector3d> repeated;
+    for (size_t i = 0; i < points.size(); i++) {
+      for (int j = 0; j < weights[i]; j++) {
+        repeated.push_back(points[i]);
+      }
+    }
+    const auto expected = FitPlane(repeated);
+    const auto result = FitPlane(points.data(), weights, points.size());
+    BOOST_TEST(result.a == expected.a);
+    BOOST_TEST(result.b == expected.b);
+    BOOST_TEST(result.c == expected.c);
+  }
+
+  {
+    const double weights[] = {0.0, 0.0, 0.0, 0.0};
+    const auto result = FitPlane(points.data(), weights, points.size());
+    BOOST_TEST(result.a == 0.0);
+    BOOST_TEST(result.b == 0.0);
+    BOOST_TEST(result.c == 0.0);
+  }
+}
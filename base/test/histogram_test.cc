@@ -0,0 +1,86 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/histogram.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::Histogram;
+
+BOOST_AUTO_TEST_CASE(HistogramBuckets) {
+  // Every bucket should be contiguous with its neighbors.
+  for (int i = 0; i + 1 < Histogram::kNumBuckets; i++) {
+    BOOST_TEST_REQUIRE(Histogram::UpperBound(i) + 1 ==
+                       Histogram::LowerBound(i + 1));
+    BOOST_TEST_REQUIRE(Histogram::Index(Histogram::LowerBound(i)) == i);
+    BOOST_TEST_REQUIRE(Histogram::Index(Histogram::UpperBound(i)) == i);
+  }
+
+  // And relatively narrow.
+  for (int i = 2 * Histogram::kSubBuckets; i < Histogram::kNumBuckets - 1; i++) {
+    const double lower = Histogram::LowerBound(i);
+    const double width = Histogram::UpperBound(i) - lower + 1;
+    BOOST_TEST(width / lower <= 1.0 / Histogram::kSubBuckets);
+  }
+
+  BOOST_TEST(Histogram::Index(int64_t(1) << 40) == Histogram::kNumBuckets - 1);
+}
+
+BOOST_AUTO_TEST_CASE(HistogramStatistics) {
+  Histogram dut;
+  BOOST_TEST(dut.count() == 0);
+  BOOST_TEST(dut.Percentile(0.5) == 0);
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int64_t> dist(0, 100000);
+  std::vector<int64_t> values;
+  for (int i = 0; i < 10000; i++) {
+    values.push_back(dist(rng));
+    dut.Add(values.back());
+  }
+  std::sort(values.begin(), values.end());
+
+  BOOST_TEST(dut.count() == 10000);
+  BOOST_TEST(dut.min() == values.front());
+  BOOST_TEST(dut.max() == values.back());
+
+  for (const double fraction : {0.5, 0.9, 0.99, 0.999}) {
+    const double expected = values[static_cast<size_t>(fraction * 10000) - 1];
+    const double actual = dut.Percentile(fraction);
+    BOOST_TEST(actual >= expected);
+    BOOST_TEST(actual <= expected * 1.125 + 1);
+  }
+  BOOST_TEST(dut.Percentile(1.0) == values.back());
+
+  const auto summary = dut.summary();
+  BOOST_TEST(summary.count == 10000);
+  BOOST_TEST(summary.p50 == dut.Percentile(0.5));
+  BOOST_TEST(summary.p999 == dut.Percentile(0.999));
+  BOOST_TEST(summary.max == values.back());
+
+  Histogram other;
+  other.Add(5);
+  other.Add(1000000);
+  dut.Merge(other);
+  BOOST_TEST(dut.count() == 10002);
+  BOOST_TEST(dut.min() == std::min<int64_t>(5, values.front()));
+  BOOST_TEST(dut.max() == 1000000);
+
+  dut.Clear();
+  BOOST_TEST(dut.count() == 0);
+}
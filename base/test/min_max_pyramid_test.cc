@@ -0,0 +1,139 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/min_max_pyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::base;
+
+namespace {
+struct Series {
+  std::vector<double> x;
+  std::vector<double> y;
+};
+
+Series MakeSeries(size_t size) {
+  std::mt19937 rng(0);
+  std::normal_distribution<double> noise(0.0, 1.0);
+  Series result;
+  for (size_t i = 0; i < size; i++) {
+    result.x.push_back(0.0025 * i);
+    result.y.push_back(std::sin(0.001 * i) + noise(rng));
+  }
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(MinMaxPyramidBounded) {
+  const auto series = MakeSeries(720000);
+  const MinMaxPyramid dut(series.x.data(), series.y.data(), series.x.size());
+  BOOST_TEST(dut.levels() > 8);
+
+  for (const double x_min : {0.0, 10.0, 1000.0}) {
+    for (const double width : {0.5, 30.0, 2000.0}) {
+      const auto view = dut.Select(
+          series.x.data(), series.y.data(), series.x.size(),
+          x_min, x_min + width, 2000);
+      BOOST_TEST(view.size > 0);
+      BOOST_TEST(view.size <= 2000);
+
+      // Every point in the visible range has its extremes preserved.
+      const auto lo = std::lower_bound(
+          series.x.begin(), series.x.end(), x_min) - series.x.begin();
+      const auto hi = std::upper_bound(
+          series.x.begin(), series.x.end(), x_min + width) - series.x.begin();
+      const double expected_min = *std::min_element(
+          series.y.begin() + lo, series.y.begin() + hi);
+      const double expected_max = *std::max_element(
+          series.y.begin() + lo, series.y.begin() + hi);
+      const double actual_min = *std::min_element(
+          view.y, view.y + view.size);
+      const double actual_max = *std::max_element(
+          view.y, view.y + view.size);
+      BOOST_TEST(actual_min <= expected_min);
+      BOOST_TEST(actual_max >= expected_max);
+
+      // And the view covers the visible range, to within one pair,
+      // since the extremes of the end groups need not be at their
+      // edges.
+      const double tolerance = 4 * width / 2000;
+      BOOST_TEST(view.x[0] <= x_min + tolerance);
+      BOOST_TEST(view.x[view.size - 1] >=
+                 std::min(x_min + width, series.x.back()) - tolerance);
+
+      // With points in order.
+      BOOST_TEST(std::is_sorted(view.x, view.x + view.size));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(MinMaxPyramidSmall) {
+  const auto series = MakeSeries(1000);
+  const MinMaxPyramid dut(series.x.data(), series.y.data(), series.x.size());
+  BOOST_TEST(dut.levels() == 0);
+
+  const auto view = dut.Select(
+      series.x.data(), series.y.data(), series.x.size(), 0.0, 1.0, 10);
+  BOOST_TEST(view.x == series.x.data());
+  BOOST_TEST(view.size == series.x.size());
+}
+
+BOOST_AUTO_TEST_CASE(MinMaxPyramidZoomedIn) {
+  const auto series = MakeSeries(100000);
+  const MinMaxPyramid dut(series.x.data(), series.y.data(), series.x.size());
+
+  // Few enough points are visible that the source is drawn directly.
+  const auto view = dut.Select(
+      series.x.data(), series.y.data(), series.x.size(), 1.0, 1.1, 2000);
+  BOOST_TEST(view.x == series.x.data() + 399);
+  BOOST_TEST(view.size == 43);
+}
+
+BOOST_AUTO_TEST_CASE(MinMaxPyramidGaps) {
+  auto series = MakeSeries(10000);
+  std::fill(series.y.begin() + 4000, series.y.begin() + 6000,
+            std::numeric_limits<double>::quiet_NaN());
+  series.y[100] = 50.0;
+
+  const MinMaxPyramid dut(series.x.data(), series.y.data(), series.x.size(),
+                          100);
+  const auto view = dut.Select(
+      series.x.data(), series.y.data(), series.x.size(), 0.0, 25.0, 200);
+  BOOST_TEST(view.size <= 200);
+  BOOST_TEST(std::count_if(view.y, view.y + view.size,
+                           [](double v) { return std::isnan(v); }) > 0);
+  BOOST_TEST(*std::max_element(view.y, view.y + view.size,
+                               [](double a, double b) {
+                                 return std::isnan(a) || a < b;
+                               }) == 50.0);
+}
+
+BOOST_AUTO_TEST_CASE(MinMaxPyramidUnsorted) {
+  Series series;
+  for (int i = 0; i < 5000; i++) {
+    series.x.push_back(std::sin(i));
+    series.y.push_back(std::cos(i));
+  }
+  const MinMaxPyramid dut(series.x.data(), series.y.data(), series.x.size());
+  BOOST_TEST(dut.levels() == 0);
+  const auto view = dut.Select(
+      series.x.data(), series.y.data(), series.x.size(), -1.0, 1.0, 10);
+  BOOST_TEST(view.size == series.x.size());
+}
@@ -0,0 +1,35 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/realtime.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::base;
+
+BOOST_AUTO_TEST_CASE(RealtimeParseCpuList) {
+  BOOST_TEST(ParseCpuList("").empty());
+  BOOST_TEST(ParseCpuList("\n").empty());
+  BOOST_TEST(ParseCpuList("3") == std::vector<int>({3}));
+  BOOST_TEST(ParseCpuList("1-3\n") == std::vector<int>({1, 2, 3}));
+  BOOST_TEST(ParseCpuList("0,2-3,7") == std::vector<int>({0, 2, 3, 7}));
+}
+
+BOOST_AUTO_TEST_CASE(RealtimeThreadUsage) {
+  const auto start = ThreadUsage::Get();
+  const auto delta = ThreadUsage::Get() - start;
+  BOOST_TEST(delta.minor_faults >= 0);
+  BOOST_TEST(delta.major_faults >= 0);
+  BOOST_TEST(delta.voluntary_switches >= 0);
+}
@@ -0,0 +1,148 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/rigid_transform.h"
+
+#include <array>
+#include <random>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::base;
+
+namespace {
+class PoseGenerator {
+ public:
+  Eigen::Quaterniond quaternion() {
+    return Eigen::Quaterniond(
+        dist_(rng_), dist_(rng_), dist_(rng_), dist_(rng_)).normalized();
+  }
+
+  Eigen::Vector3d vector() {
+    return Eigen::Vector3d(dist_(rng_), dist_(rng_), dist_(rng_));
+  }
+
+  Sophus::SE3d pose() {
+    return Sophus::SE3d(Sophus::SO3d(quaternion()), vector());
+  }
+
+ private:
+  std::mt19937 rng_{1234};
+  std::uniform_real_distribution<double> dist_{-1.0, 1.0};
+};
+
+double QuaternionError(const Eigen::Quaterniond& a,
+                       const Eigen::Quaterniond& b) {
+  // q and -q are the same rotation.
+  return std::min((a.coeffs() - b.coeffs()).norm(),
+                  (a.coeffs() + b.coeffs()).norm());
+}
+}
+
+BOOST_AUTO_TEST_CASE(RigidTransformMatchesSophus) {
+  PoseGenerator gen;
+
+  for (int i = 0; i < 100; i++) {
+    const auto pose_AB = gen.pose();
+    const auto pose_BC = gen.pose();
+    const RigidTransformd tf_AB(pose_AB);
+    const RigidTransformd tf_BC(pose_BC);
+
+    const auto p_B = gen.vector();
+    const auto v_B = gen.vector();
+
+    BOOST_TEST((tf_AB * p_B - pose_AB * p_B).norm() < 1e-12);
+    BOOST_TEST((tf_AB.Rotate(v_B) - pose_AB.so3() * v_B).norm() < 1e-12);
+
+    const auto p_C = gen.vector();
+    BOOST_TEST(((tf_AB * tf_BC) * p_C - (pose_AB * pose_BC) * p_C).norm()
+               < 1e-12);
+
+    const auto p_A = gen.vector();
+    BOOST_TEST((tf_AB.inverse() * p_A - pose_AB.inverse() * p_A).norm()
+               < 1e-12);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(RigidTransformBatch) {
+  PoseGenerator gen;
+  const auto pose_AB = gen.pose();
+  const RigidTransformd tf_AB(pose_AB);
+
+  std::array<Eigen::Vector3d, 4> points_B;
+  for (auto& point : points_B) { point = gen.vector(); }
+
+  std::array<Eigen::Vector3d, 4> points_A;
+  tf_AB.Transform(points_B.data(), points_A.data(), points_B.size());
+
+  std::array<Eigen::Vector3d, 4> vectors_A = points_B;
+  tf_AB.Rotate(vectors_A.data(), vectors_A.data(), vectors_A.size());
+
+  for (size_t i = 0; i < points_B.size(); i++) {
+    BOOST_TEST((points_A[i] - pose_AB * points_B[i]).norm() < 1e-12);
+    BOOST_TEST((vectors_A[i] - pose_AB.so3() * points_B[i]).norm() < 1e-12);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(RigidTransformFloat) {
+  PoseGenerator gen;
+
+  for (int i = 0; i < 100; i++) {
+    const auto pose_AB = gen.pose();
+    const RigidTransformf tf_AB(pose_AB);
+    const auto p_B = gen.vector();
+
+    const Eigen::Vector3d actual = (tf_AB * p_B.cast<float>()).cast<double>();
+    BOOST_TEST((actual - pose_AB * p_B).norm() < 1e-5);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(RigidTransformSlerp) {
+  PoseGenerator gen;
+
+  for (int i = 0; i < 100; i++) {
+    const auto a = gen.quaternion();
+    for (const double scale : {1.0, 1e-2, 1e-4, 1e-6, 1e-9, 0.0}) {
+      // Rotate b away from a by a random amount, scaled down to
+      // exercise the small angle path.
+      const auto axis = gen.vector().normalized();
+      const double angle = scale * gen.vector().x() * M_PI;
+      Eigen::Quaterniond b = a * Eigen::Quaterniond(
+          Eigen::AngleAxisd(angle, axis));
+      // The same rotation from the other hemisphere.
+      if (i % 2) { b.coeffs() = -b.coeffs(); }
+
+      for (const double t : {0.0, 0.01, 0.3, 0.5, 1.0}) {
+        const auto expected = a.slerp(t, b);
+        const auto actual = Slerp(a, b, t);
+        BOOST_TEST(QuaternionError(actual, expected) < 1e-12);
+        BOOST_TEST(std::abs(actual.norm() - 1.0) < 1e-12);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(RigidTransformSetUnitQuaternion) {
+  PoseGenerator gen;
+  const auto q = gen.quaternion();
+
+  Sophus::SO3d so3;
+  SetUnitQuaternion(&so3, q);
+  BOOST_TEST(QuaternionError(so3.unit_quaternion(), q) == 0.0);
+
+  const auto v = gen.vector();
+  BOOST_TEST((so3 * v - Sophus::SO3d(q) * v).norm() < 1e-12);
+  BOOST_TEST((UnitQuaternionMatrix(q) - q.toRotationMatrix()).norm()
+             < 1e-12);
+}
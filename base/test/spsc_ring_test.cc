@@ -0,0 +1,83 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/spsc_ring.h"
+
+#include <thread>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::base;
+
+BOOST_AUTO_TEST_CASE(SpscRingBasic) {
+  SpscRing<int, 4> dut;
+  BOOST_TEST(dut.capacity() == 3);
+  BOOST_TEST(dut.empty());
+  BOOST_TEST(dut.front() == nullptr);
+
+  for (int i = 0; i < 3; i++) {
+    auto* slot = dut.push_slot();
+    BOOST_TEST_REQUIRE(slot != nullptr);
+    *slot = i;
+    dut.commit_push();
+  }
+  BOOST_TEST(dut.push_slot() == nullptr);
+
+  for (int i = 0; i < 3; i++) {
+    auto* slot = dut.front();
+    BOOST_TEST_REQUIRE(slot != nullptr);
+    BOOST_TEST(*slot == i);
+    dut.pop();
+  }
+  BOOST_TEST(dut.empty());
+
+  // Wrap around.
+  for (int i = 0; i < 10; i++) {
+    *dut.push_slot() = i;
+    dut.commit_push();
+    BOOST_TEST(*dut.front() == i);
+    dut.pop();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SpscRingThreaded) {
+  SpscRing<int, 16> dut;
+  constexpr int kCount = 100000;
+
+  std::thread producer([&]() {
+      for (int i = 0; i < kCount; i++) {
+        int* slot = nullptr;
+        while ((slot = dut.push_slot()) == nullptr) {
+          std::this_thread::yield();
+        }
+        *slot = i;
+        dut.commit_push();
+      }
+    });
+
+  int expected = 0;
+  while (expected < kCount) {
+    auto* slot = dut.front();
+    if (!slot) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (*slot != expected) { break; }
+    dut.pop();
+    expected++;
+  }
+  producer.join();
+
+  BOOST_TEST(expected == kCount);
+}
@@ -0,0 +1,71 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/static_vector.h"
+
+#include <vector>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::StaticVector;
+
+BOOST_AUTO_TEST_CASE(StaticVectorBasic) {
+  StaticVector<int, 4> dut;
+  BOOST_TEST(dut.empty());
+  BOOST_TEST(dut.size() == 0);
+  BOOST_TEST(dut.capacity() == 4);
+
+  dut.push_back(3);
+  dut.push_back(5);
+  BOOST_TEST(dut.size() == 2);
+  BOOST_TEST(dut[0] == 3);
+  BOOST_TEST(dut.back() == 5);
+
+  dut.emplace_back(7);
+  dut.push_back(9);
+  BOOST_TEST(dut.full());
+
+  int sum = 0;
+  for (auto value : dut) { sum += value; }
+  BOOST_TEST(sum == 24);
+
+  dut.pop_back();
+  BOOST_TEST(dut.size() == 3);
+
+  dut.clear();
+  BOOST_TEST(dut.empty());
+  BOOST_TEST((dut.begin() == dut.end()));
+}
+
+BOOST_AUTO_TEST_CASE(StaticVectorConstruct) {
+  const StaticVector<int, 4> init = {1, 2, 3};
+  BOOST_TEST(init.size() == 3);
+  BOOST_TEST(init[2] == 3);
+
+  const std::vector<int> source = {4, 5};
+  StaticVector<int, 4> dut(source.begin(), source.end());
+  BOOST_TEST(dut.size() == 2);
+  BOOST_TEST(dut.front() == 4);
+
+  dut.assign(init.begin(), init.end());
+  BOOST_TEST(dut.size() == 3);
+  BOOST_TEST(dut[0] == 1);
+
+  // Growing always value initializes the new elements, even if they
+  // were previously in use.
+  dut.resize(1);
+  dut.resize(3);
+  BOOST_TEST(dut[1] == 0);
+  BOOST_TEST(dut[2] == 0);
+}
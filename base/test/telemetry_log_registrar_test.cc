@@ -14,11 +14,15 @@
 
 #include "base/telemetry_log_registrar.h"
 
+#include <chrono>
+#include <thread>
+
+#include <boost/filesystem.hpp>
 #include <boost/test/auto_unit_test.hpp>
 
 #include "mjlib/base/visitor.h"
-
-#include "base/telemetry_registry.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/mapped_binary_reader.h"
 
 namespace {
 struct TestData {
@@ -30,14 +34,180 @@ struct TestData {
   }
 };
 
+struct OtherData {
+  int32_t count = 0;
+  std::vector<double> values;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(count));
+    a->Visit(MJ_NVP(values));
+  }
+};
+
 using namespace mjmech::base;
+namespace fs = boost::filesystem;
+using mjlib::telemetry::FileReader;
+using mjlib::telemetry::MappedBinaryReader;
+
+std::string TempLog() {
+  return (fs::temp_directory_path() /
+          fs::unique_path("telemetry_log_registrar_%%%%%%%%.log")).string();
+}
+
+std::vector<FileReader::Item> ReadItems(FileReader* reader,
+                                        const std::string& record) {
+  FileReader::ItemsOptions options;
+  options.records.push_back(record);
+  std::vector<FileReader::Item> result;
+  for (const auto& item : reader->items(options)) {
+    result.push_back(item);
+  }
+  return result;
+}
 }
 
 BOOST_AUTO_TEST_CASE(TelemetryLogRegistrarTest) {
-  // TelemetryLog log;
-  // TelemetryRegistry<TelemetryLogRegistrar> registry(&log);
-  // auto callable = registry.Register<TestData>("test1");
+  const auto filename = TempLog();
+
+  boost::asio::io_context context;
+  mjlib::telemetry::FileWriter writer;
+  {
+    TelemetryLogRegistrar dut{context, &writer};
+
+    boost::signals2::signal<void (const TestData*)> test_signal;
+    boost::signals2::signal<void (const OtherData*)> other_signal;
+    dut.Register("test1", &test_signal);
+    dut.Register("test2", &other_signal);
+
+    // Nothing is queued while the log is closed.
+    TestData test;
+    test_signal(&test);
+    BOOST_TEST(dut.stats().written == 0);
+
+    dut.Open(filename);
+    BOOST_TEST(dut.IsOpen());
+
+    constexpr int kCount = 20;
+    for (int i = 0; i < kCount; i++) {
+      test.value = i;
+      test_signal(&test);
+
+      OtherData other;
+      other.count = i;
+      other.values.resize(i % 3, 1.5 * i);
+      other_signal(&other);
+    }
+
+    // Closing writes everything which was queued.
+    dut.Close();
+    BOOST_TEST(!dut.IsOpen());
+
+    const auto stats = dut.stats();
+    BOOST_TEST(stats.written == 2 * kCount);
+    BOOST_TEST(stats.dropped == 0);
+    BOOST_TEST_REQUIRE(stats.records.size() == 2);
+    BOOST_TEST(stats.records[0].name == "test1");
+    BOOST_TEST(stats.records[0].written == kCount);
+    BOOST_TEST(stats.records[1].name == "test2");
+    BOOST_TEST(stats.records[1].written == kCount);
+  }
+
+  FileReader reader{filename};
+  BOOST_TEST_REQUIRE(reader.record("test1") != nullptr);
+  BOOST_TEST_REQUIRE(reader.record("test2") != nullptr);
+  BOOST_TEST(reader.record("telemetry_log") != nullptr);
+
+  MappedBinaryReader<TestData> test_reader(
+      reader.record("test1")->schema->root());
+  const auto test_items = ReadItems(&reader, "test1");
+  BOOST_TEST_REQUIRE(test_items.size() == 20);
+  for (size_t i = 0; i < test_items.size(); i++) {
+    BOOST_TEST(test_reader.Read(test_items[i].data).value == i);
+  }
+
+  MappedBinaryReader<OtherData> other_reader(
+      reader.record("test2")->schema->root());
+  const auto other_items = ReadItems(&reader, "test2");
+  BOOST_TEST_REQUIRE(other_items.size() == 20);
+  for (size_t i = 0; i < other_items.size(); i++) {
+    const auto other = other_reader.Read(other_items[i].data);
+    BOOST_TEST(other.count == static_cast<int>(i));
+    BOOST_TEST_REQUIRE(other.values.size() == i % 3);
+    for (const auto value : other.values) { BOOST_TEST(value == 1.5 * i); }
+  }
+
+  // Instances of different records are written in timestamp order.
+  boost::posix_time::ptime last;
+  for (const auto& item : reader.items()) {
+    if (!last.is_not_a_date_time()) { BOOST_TEST(item.timestamp >= last); }
+    last = item.timestamp;
+  }
+
+  fs::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryLogRegistrarDropTest) {
+  const auto filename = TempLog();
+  constexpr int kExtra = 10;
+  constexpr int kQueueSize = TelemetryLogRegistrar::kQueueSize;
+
+  boost::asio::io_context context;
+  mjlib::telemetry::FileWriter writer;
+  {
+    TelemetryLogRegistrar dut{context, &writer};
+
+    boost::signals2::signal<void (const TestData*)> test_signal;
+    dut.Register("test1", &test_signal);
+    dut.Open(filename);
+
+    // Holding the log keeps the logging thread from draining, so
+    // the ring fills.
+    dut.WithLog([&](auto*) {
+        TestData test;
+        for (int i = 0; i < kQueueSize + kExtra; i++) {
+          test.value = i;
+          test_signal(&test);
+        }
+      });
+
+    const auto start = std::chrono::steady_clock::now();
+    while (dut.stats().written < kQueueSize &&
+           std::chrono::steady_clock::now() - start <
+           std::chrono::seconds(10)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    const auto stats = dut.stats();
+    BOOST_TEST(stats.written == kQueueSize);
+    BOOST_TEST(stats.dropped == kExtra);
+    BOOST_TEST_REQUIRE(stats.records.size() == 1);
+    BOOST_TEST(stats.records[0].dropped == kExtra);
+
+    dut.Close();
+  }
+
+  FileReader reader{filename};
+
+  // The first instances are kept, and the later ones dropped.
+  MappedBinaryReader<TestData> test_reader(
+      reader.record("test1")->schema->root());
+  const auto test_items = ReadItems(&reader, "test1");
+  BOOST_TEST_REQUIRE(test_items.size() == kQueueSize);
+  BOOST_TEST(test_reader.Read(test_items.back().data).value ==
+             kQueueSize - 1);
 
-  // // This should have resulted in a schema being written.
+  // The drops are recorded in the log too.
+  BOOST_TEST_REQUIRE(reader.record("telemetry_log") != nullptr);
+  MappedBinaryReader<TelemetryLogRegistrar::Stats> stats_reader(
+      reader.record("telemetry_log")->schema->root());
+  const auto stats_items = ReadItems(&reader, "telemetry_log");
+  BOOST_TEST_REQUIRE(stats_items.size() >= 1);
+  const auto logged = stats_reader.Read(stats_items.back().data);
+  BOOST_TEST(logged.dropped == kExtra);
+  BOOST_TEST_REQUIRE(logged.records.size() == 1);
+  BOOST_TEST(logged.records[0].name == "test1");
+  BOOST_TEST(logged.records[0].dropped == kExtra);
 
+  fs::remove(filename);
 }
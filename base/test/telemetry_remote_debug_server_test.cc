@@ -0,0 +1,211 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_remote_debug_server.h"
+
+#include <cstring>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/visitor.h"
+
+namespace {
+int g_copies = 0;
+
+struct TestData {
+  TestData() {}
+  TestData(const TestData& rhs) : value(rhs.value) { g_copies++; }
+  TestData& operator=(const TestData& rhs) {
+    value = rhs.value;
+    g_copies++;
+    return *this;
+  }
+
+  int value = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(value));
+  }
+};
+
+using namespace mjmech::base;
+using udp = boost::asio::ip::udp;
+
+struct Fixture {
+  Fixture() {
+    dut.parameters()->port = 0;
+    dut.AsyncStart([](const auto& ec) { BOOST_TEST(!ec); });
+    context.poll();
+    context.reset();
+
+    dut.Register("test", &signal);
+
+    client.open(udp::v4());
+    client.non_blocking(true);
+    server = udp::endpoint(
+        boost::asio::ip::address_v4::loopback(), dut.local_endpoint().port());
+  }
+
+  void Send(const std::string& message) {
+    client.send_to(boost::asio::buffer(message), server);
+    // Give the server a chance to see it.
+    for (int i = 0; i < 10; i++) { context.poll(); context.reset(); }
+  }
+
+  std::vector<std::string> ReceiveAll() {
+    for (int i = 0; i < 10; i++) { context.poll(); context.reset(); }
+
+    std::vector<std::string> result;
+    char buffer[3000] = {};
+    while (true) {
+      boost::system::error_code ec;
+      udp::endpoint from;
+      const auto size = client.receive_from(
+          boost::asio::buffer(buffer), from, 0, ec);
+      if (ec) { break; }
+      result.push_back(std::string(buffer, size));
+    }
+    return result;
+  }
+
+  int Receive() {
+    const auto all = ReceiveAll();
+    for (const auto& data : all) {
+      BOOST_TEST(data.find("\"test\"") != std::string::npos);
+    }
+    return all.size();
+  }
+
+  void Emit(int value) {
+    TestData data;
+    data.value = value;
+    signal(&data);
+  }
+
+  boost::asio::io_context context;
+  TelemetryRemoteDebugServer dut{context.get_executor()};
+  boost::signals2::signal<void (const TestData*)> signal;
+
+  udp::socket client{context};
+  udp::endpoint server;
+};
+}
+
+BOOST_FIXTURE_TEST_CASE(RemoteDebugIdleDoesNotCopy, Fixture) {
+  g_copies = 0;
+  for (int i = 0; i < 100; i++) { Emit(i); }
+  BOOST_TEST(g_copies == 0);
+  BOOST_TEST(Receive() == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(RemoteDebugGet, Fixture) {
+  Send("{\"command\":\"get\",\"names\":[\"test\"]}");
+
+  // Nothing is sent until the next emission.
+  BOOST_TEST(Receive() == 0);
+
+  g_copies = 0;
+  Emit(3);
+  BOOST_TEST(g_copies == 0);
+  BOOST_TEST(Receive() == 1);
+
+  // A get is only answered once.
+  Emit(4);
+  BOOST_TEST(Receive() == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(RemoteDebugSubscribe, Fixture) {
+  // The debug server uses the wall clock here, and 1Hz means only the
+  // first of these emissions should be sent.
+  Send("{\"command\":\"subscribe\",\"names\":[\"test\"],\"rate_hz\":1}");
+
+  for (int i = 0; i < 20; i++) { Emit(i); }
+  BOOST_TEST(Receive() == 1);
+
+  Send("{\"command\":\"unsubscribe\",\"names\":[\"test\"]}");
+  for (int i = 0; i < 20; i++) { Emit(i); }
+  BOOST_TEST(Receive() == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(RemoteDebugStream, Fixture) {
+  Send("{\"command\":\"stream\",\"names\":[\"test\"],\"rate_hz\":1}");
+
+  // The schema is sent right away.
+  {
+    const auto datagrams = ReceiveAll();
+    BOOST_TEST_REQUIRE(datagrams.size() == 1);
+    const auto frame = TelemetryStreamFrame::Parse(datagrams[0]);
+    BOOST_TEST_REQUIRE(!!frame);
+    BOOST_TEST(frame->type == TelemetryStreamFrame::kSchema);
+    BOOST_TEST(frame->identifier == 1);
+    BOOST_TEST(frame->name == "test");
+    BOOST_TEST(frame->payload ==
+               mjlib::telemetry::BinarySchemaArchive::schema<TestData>());
+  }
+
+  // Then data, in the log's binary encoding, at the requested rate.
+  g_copies = 0;
+  for (int i = 0; i < 20; i++) { Emit(i + 5); }
+  BOOST_TEST(g_copies == 0);
+  {
+    const auto datagrams = ReceiveAll();
+    BOOST_TEST_REQUIRE(datagrams.size() == 1);
+    const auto frame = TelemetryStreamFrame::Parse(datagrams[0]);
+    BOOST_TEST_REQUIRE(!!frame);
+    BOOST_TEST(frame->type == TelemetryStreamFrame::kData);
+    BOOST_TEST(frame->identifier == 1);
+    BOOST_TEST_REQUIRE(frame->payload.size() == sizeof(int32_t));
+    int32_t value = 0;
+    std::memcpy(&value, frame->payload.data(), sizeof(value));
+    BOOST_TEST(value == 5);
+  }
+
+  Send("{\"command\":\"unsubscribe\",\"names\":[\"test\"]}");
+  for (int i = 0; i < 20; i++) { Emit(i); }
+  BOOST_TEST(ReceiveAll().size() == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(RemoteDebugSubscribeAndStream, Fixture) {
+  // A JSON subscription and a binary stream from the same client
+  // coexist, in either order.
+  Send("{\"command\":\"subscribe\",\"names\":[\"test\"],\"rate_hz\":1}");
+  Send("{\"command\":\"stream\",\"names\":[\"test\"],\"rate_hz\":1}");
+  // The schema.
+  BOOST_TEST(ReceiveAll().size() == 1);
+
+  // Renewing the subscription does not cancel the stream.
+  Send("{\"command\":\"subscribe\",\"names\":[\"test\"],\"rate_hz\":1}");
+
+  Emit(1);
+  const auto datagrams = ReceiveAll();
+  BOOST_TEST_REQUIRE(datagrams.size() == 2);
+  int json = 0;
+  int binary = 0;
+  for (const auto& datagram : datagrams) {
+    const auto frame = TelemetryStreamFrame::Parse(datagram);
+    if (frame && frame->type == TelemetryStreamFrame::kData) {
+      binary++;
+    } else {
+      json++;
+    }
+  }
+  BOOST_TEST(json == 1);
+  BOOST_TEST(binary == 1);
+
+  // Unsubscribing removes both.
+  Send("{\"command\":\"unsubscribe\",\"names\":[\"test\"]}");
+  for (int i = 0; i < 20; i++) { Emit(i); }
+  BOOST_TEST(ReceiveAll().size() == 0);
+}
@@ -0,0 +1,56 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_stream_frame.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/fast_stream.h"
+
+using namespace mjmech::base;
+
+BOOST_AUTO_TEST_CASE(TelemetryStreamFrameRoundTrip) {
+  const boost::posix_time::ptime timestamp(
+      boost::gregorian::date(2020, 6, 1),
+      boost::posix_time::microseconds(1234567));
+
+  {
+    mjlib::base::FastOStringStream stream;
+    TelemetryStreamFrame::WriteDataHeader(stream, 7, timestamp);
+    stream.write(std::string_view("abc"));
+    const auto frame = TelemetryStreamFrame::Parse(stream.str());
+    BOOST_TEST_REQUIRE(!!frame);
+    BOOST_TEST(frame->type == TelemetryStreamFrame::kData);
+    BOOST_TEST(frame->identifier == 7);
+    BOOST_TEST(frame->timestamp == timestamp);
+    BOOST_TEST(frame->payload == "abc");
+  }
+
+  {
+    mjlib::base::FastOStringStream stream;
+    TelemetryStreamFrame::WriteSchemaHeader(stream, 3, "qc_status");
+    stream.write(std::string_view("schema"));
+    const auto frame = TelemetryStreamFrame::Parse(stream.str());
+    BOOST_TEST_REQUIRE(!!frame);
+    BOOST_TEST(frame->type == TelemetryStreamFrame::kSchema);
+    BOOST_TEST(frame->identifier == 3);
+    BOOST_TEST(frame->name == "qc_status");
+    BOOST_TEST(frame->payload == "schema");
+
+    // Truncated frames are rejected.
+    BOOST_TEST(!TelemetryStreamFrame::Parse(stream.str().substr(0, 8)));
+  }
+
+  BOOST_TEST(!TelemetryStreamFrame::Parse(std::string_view("\x09\0\0\0\0", 5)));
+}
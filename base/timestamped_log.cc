@@ -23,7 +23,7 @@
 namespace mjmech {
 namespace base {
 
-void OpenMaybeTimestampedLog(mjlib::telemetry::FileWriter* writer,
+void OpenMaybeTimestampedLog(TelemetryLogRegistrar* writer,
                              std::string_view filename,
                              TimestampMode mode) {
   // Make sure that the log file has a date and timestamp somewhere
@@ -16,7 +16,7 @@
 
 #include <string>
 
-#include "mjlib/telemetry/file_writer.h"
+#include "base/telemetry_log_registrar.h"
 
 namespace mjmech {
 namespace base {
@@ -26,7 +26,7 @@ enum TimestampMode {
   kShort,
 };
 
-void OpenMaybeTimestampedLog(mjlib::telemetry::FileWriter* writer,
+void OpenMaybeTimestampedLog(TelemetryLogRegistrar* writer,
                              std::string_view filename,
                              TimestampMode);
 
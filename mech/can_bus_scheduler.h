@@ -0,0 +1,87 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+namespace mjmech {
+namespace mech {
+
+/// Decides the order in which a set of CAN frames spread across
+/// several independent buses should be handed to the hardware.
+///
+/// Frames for a single bus must go out one after another, but the
+/// buses themselves run in parallel.  Interleaving the frames round
+/// robin, starting with the most heavily loaded bus, gets every bus
+/// transmitting as early as possible so that replies on all of them
+/// overlap.  Within a bus, frames retain the order they were added
+/// in.
+///
+/// Once storage has grown to the largest set of frames seen, no
+/// further allocations are made.
+class CanBusScheduler {
+ public:
+  static constexpr int kNumBuses = 6;
+
+  void Clear() {
+    for (auto& queue : queues_) { queue.clear(); }
+    expected_replies_ = {};
+    count_ = 0;
+  }
+
+  /// Add the frame with index @p frame, which will be sent on @p bus.
+  void Add(int frame, int bus, bool expect_reply) {
+    BOOST_ASSERT(bus >= 0 && bus < kNumBuses);
+    queues_[bus].push_back(frame);
+    if (expect_reply) { expected_replies_[bus]++; }
+    count_++;
+  }
+
+  /// Return the frame indices in the order they should be sent.
+  const std::vector<int>& Schedule() {
+    for (int i = 0; i < kNumBuses; i++) { buses_[i] = i; }
+    std::stable_sort(
+        buses_.begin(), buses_.end(), [&](int lhs, int rhs) {
+          return queues_[lhs].size() > queues_[rhs].size();
+        });
+
+    order_.clear();
+    for (size_t round = 0; order_.size() < count_; round++) {
+      for (const int bus : buses_) {
+        if (round < queues_[bus].size()) {
+          order_.push_back(queues_[bus][round]);
+        }
+      }
+    }
+    return order_;
+  }
+
+  int frames(int bus) const { return queues_[bus].size(); }
+  int expected_replies(int bus) const { return expected_replies_[bus]; }
+
+ private:
+  std::array<std::vector<int>, kNumBuses> queues_;
+  std::array<int, kNumBuses> expected_replies_ = {};
+  std::array<int, kNumBuses> buses_ = {};
+  std::vector<int> order_;
+  size_t count_ = 0;
+};
+
+}
+}
@@ -0,0 +1,693 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Microbenchmarks for the pieces of the quadruped control loop.  To
+/// record results for comparison between commits, run with:
+///
+///   bazel run -c opt //mech:control_benchmarks -- \
+///      --benchmark_out=control_benchmarks.json \
+///      --benchmark_out_format=json
+
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <variant>
+
+#include <benchmark/benchmark.h>
+
+#include <boost/asio/post.hpp>
+
+#include "mjlib/base/fail.h"
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/io/debug_deadline_service.h"
+#include "mjlib/io/now.h"
+
+#include "base/common.h"
+#include "base/context.h"
+#include "base/fit_plane.h"
+#include "base/rigid_transform.h"
+#include "base/runfiles.h"
+
+#include "mech/mammal_ik.h"
+#include "mech/mammal_ik_batch.h"
+#include "mech/moteus.h"
+#include "mech/quadruped_context.h"
+#include "mech/quadruped_control.h"
+#include "mech/quadruped_trot.h"
+#include "mech/swing_trajectory.h"
+#include "mech/trajectory.h"
+#include "mech/valid_leg_region.h"
+
+namespace base = mjmech::base;
+namespace moteus = mjmech::mech::moteus;
+using namespace mjmech::mech;
+
+namespace {
+using QC = QuadrupedCommand;
+
+const std::string& ConfigPath() {
+  static const std::string result =
+      base::Runfiles().Rlocation("configs/quada1.cfg");
+  return result;
+}
+
+const QuadrupedConfig& GetConfig() {
+  static const QuadrupedConfig result = []() {
+    QuadrupedConfig config;
+    std::ifstream inf(ConfigPath());
+    mjlib::base::system_error::throw_if(
+        !inf.is_open(), "could not open " + ConfigPath());
+    mjlib::base::Json5ReadArchive(inf).Accept(&config);
+    return config;
+  }();
+  return result;
+}
+
+/// Joint angles which put each leg in a typical, non-singular, stance
+/// configuration.
+double JointAngle_deg(int id) {
+  switch ((id - 1) % 3) {
+    case 0: { return 0.0; }
+    case 1: { return 30.0; }
+    case 2: { return -60.0; }
+  }
+  return 0.0;
+}
+
+IkSolver::JointAngles MakeJointAngles(const MammalIk::Config& config) {
+  IkSolver::JointAngles result;
+  for (const auto* joint : {&config.shoulder, &config.femur, &config.tibia}) {
+    IkSolver::Joint ik_joint;
+    ik_joint.id = joint->id;
+    ik_joint.angle_deg = JointAngle_deg(joint->id);
+    ik_joint.velocity_dps = 10.0;
+    ik_joint.torque_Nm = 1.0;
+    result.push_back(ik_joint);
+  }
+  return result;
+}
+
+void BM_MammalIkForward(benchmark::State& state) {
+  const auto& leg = GetConfig().legs.front();
+  const MammalIk ik(leg.ik);
+  const auto joints = MakeJointAngles(leg.ik);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ik.Forward_G(joints));
+  }
+}
+BENCHMARK(BM_MammalIkForward);
+
+void BM_MammalIkInverse(benchmark::State& state) {
+  const auto& leg = GetConfig().legs.front();
+  const MammalIk ik(leg.ik);
+  const auto joints = MakeJointAngles(leg.ik);
+  auto effector_G = ik.Forward_G(joints);
+  effector_G.force_N = base::Point3D(0, 0, 20.0);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ik.Inverse(effector_G, joints));
+  }
+}
+BENCHMARK(BM_MammalIkInverse);
+
+std::vector<MammalIk::Config> GetIkConfigs() {
+  std::vector<MammalIk::Config> result;
+  for (const auto& leg : GetConfig().legs) {
+    result.push_back(leg.ik);
+  }
+  return result;
+}
+
+MammalIkBatch::Joints MakeBatchJoints(
+    const std::vector<MammalIk::Config>& configs) {
+  MammalIkBatch::Joints result;
+  for (size_t i = 0; i < configs.size(); i++) {
+    const auto joints = MakeJointAngles(configs[i]);
+    result.shoulder.Set(i, joints[0]);
+    result.femur.Set(i, joints[1]);
+    result.tibia.Set(i, joints[2]);
+  }
+  return result;
+}
+
+void BM_MammalIkForwardScalar4(benchmark::State& state) {
+  const auto configs = GetIkConfigs();
+  // MammalIk is not movable, so it cannot live in a vector.
+  std::deque<MammalIk> iks;
+  std::vector<IkSolver::JointAngles> joints;
+  for (const auto& config : configs) {
+    iks.emplace_back(config);
+    joints.push_back(MakeJointAngles(config));
+  }
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < iks.size(); i++) {
+      benchmark::DoNotOptimize(iks[i].Forward_G(joints[i]));
+    }
+  }
+}
+BENCHMARK(BM_MammalIkForwardScalar4);
+
+void BM_MammalIkForwardBatch(benchmark::State& state) {
+  const auto configs = GetIkConfigs();
+  const MammalIkBatch ik(configs);
+  const auto joints = MakeBatchJoints(configs);
+  MammalIkBatch::Effectors effectors_G;
+
+  for (auto _ : state) {
+    ik.Forward_G(joints, &effectors_G);
+    benchmark::DoNotOptimize(effectors_G);
+  }
+}
+BENCHMARK(BM_MammalIkForwardBatch);
+
+void BM_MammalIkInverseScalar4(benchmark::State& state) {
+  const auto configs = GetIkConfigs();
+  std::deque<MammalIk> iks;
+  std::vector<IkSolver::JointAngles> joints;
+  std::vector<IkSolver::Effector> effectors_G;
+  for (const auto& config : configs) {
+    iks.emplace_back(config);
+    joints.push_back(MakeJointAngles(config));
+    effectors_G.push_back(iks.back().Forward_G(joints.back()));
+    effectors_G.back().force_N = base::Point3D(0, 0, 20.0);
+  }
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < iks.size(); i++) {
+      benchmark::DoNotOptimize(iks[i].Inverse(effectors_G[i], joints[i]));
+    }
+  }
+}
+BENCHMARK(BM_MammalIkInverseScalar4);
+
+void BM_MammalIkInverseBatch(benchmark::State& state) {
+  const auto configs = GetIkConfigs();
+  const MammalIkBatch ik(configs);
+  const auto joints = MakeBatchJoints(configs);
+  MammalIkBatch::Effectors effectors_G;
+  ik.Forward_G(joints, &effectors_G);
+  effectors_G.force_N.z.setConstant(20.0);
+  MammalIkBatch::Joints result;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ik.Inverse(effectors_G, &joints, &result));
+  }
+}
+BENCHMARK(BM_MammalIkInverseBatch);
+
+void BM_QuadrupedTrot(benchmark::State& state) {
+  QC command;
+  command.mode = QC::Mode::kWalk;
+  command.v_R = base::Point3D(0.2, 0, 0);
+  command.w_R = base::Point3D(0, 0, 0.2);
+  QuadrupedState quadruped_state;
+  QuadrupedContext context(GetConfig(), &command, &quadruped_state);
+
+  std::vector<QC::Leg> legs_R;
+  for (const auto& leg : context.legs) {
+    QC::Leg leg_R;
+    leg_R.leg_id = leg.leg;
+    leg_R.power = true;
+    leg_R.position = leg.idle_R;
+    leg_R.stance = 1.0;
+    legs_R.push_back(leg_R);
+  }
+
+  for (auto _ : state) {
+    const auto result = QuadrupedTrot(&context, legs_R);
+    legs_R.assign(result.legs_R.begin(), result.legs_R.end());
+  }
+}
+BENCHMARK(BM_QuadrupedTrot);
+
+class TimeToLeaveFixture {
+ public:
+  TimeToLeaveFixture(double omega) {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> position(-0.02, 0.02);
+    std::uniform_real_distribution<double> speed(-0.3, 0.3);
+
+    const auto& leg = context.legs.front();
+    const base::Point3D idle_G = leg.pose_BG.inverse() * leg.idle_R;
+    for (auto& query : queries) {
+      query.region = &context.valid_regions.front();
+      query.point_G = idle_G.head<2>() +
+          Eigen::Vector2d(position(rng), position(rng));
+      query.velocity = Eigen::Vector2d(speed(rng), speed(rng));
+      query.omega = omega;
+    }
+  }
+
+  QC command;
+  QuadrupedState quadruped_state;
+  QuadrupedContext context{GetConfig(), &command, &quadruped_state};
+  std::array<ValidLegRegion::Query, 4> queries;
+};
+
+void BM_TimeToLeaveReference(benchmark::State& state) {
+  TimeToLeaveFixture fixture(state.range(0) * 0.1);
+  for (auto _ : state) {
+    for (const auto& query : fixture.queries) {
+      benchmark::DoNotOptimize(query.region->ReferenceTimeToLeave_G(
+                                   query.point_G, query.velocity,
+                                   query.omega));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * fixture.queries.size());
+}
+BENCHMARK(BM_TimeToLeaveReference)->Arg(0)->Arg(5);
+
+void BM_TimeToLeave(benchmark::State& state) {
+  TimeToLeaveFixture fixture(state.range(0) * 0.1);
+  std::array<double, 4> result = {};
+  for (auto _ : state) {
+    ValidLegRegion::TimeToLeave_G(
+        fixture.queries.data(), result.data(), fixture.queries.size());
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations() * fixture.queries.size());
+}
+BENCHMARK(BM_TimeToLeave)->Arg(0)->Arg(5);
+
+std::vector<base::Point3D> MakeStancePoints() {
+  return {
+    {0.2, 0.15, 0.01},
+    {0.2, -0.15, -0.01},
+    {-0.2, 0.15, 0.005},
+    {-0.2, -0.15, 0.0},
+  };
+}
+
+void BM_FitPlaneSvd(benchmark::State& state) {
+  const auto points = MakeStancePoints();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(base::FitPlane(points));
+  }
+}
+BENCHMARK(BM_FitPlaneSvd);
+
+void BM_FitPlane(benchmark::State& state) {
+  const auto points = MakeStancePoints();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(base::FitPlane(points.data(), points.size()));
+  }
+}
+BENCHMARK(BM_FitPlane);
+
+void BM_FitPlaneWeighted(benchmark::State& state) {
+  const auto points = MakeStancePoints();
+  const double weights[] = {1.0, 0.5, 1.0, 0.25};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        base::FitPlane(points.data(), weights, points.size()));
+  }
+}
+BENCHMARK(BM_FitPlaneWeighted);
+
+/// Three collinear feet, which takes the normal equation fallback.
+void BM_FitPlaneDegenerate(benchmark::State& state) {
+  const std::vector<base::Point3D> points = {
+    {0.2, 0.15, 0.01},
+    {0.0, 0.0, 0.0},
+    {-0.2, -0.15, 0.005},
+  };
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(base::FitPlane(points.data(), points.size()));
+  }
+}
+BENCHMARK(BM_FitPlaneDegenerate);
+
+class LegTransformFixture {
+ public:
+  LegTransformFixture() {
+    pose_RB = Sophus::SE3d(
+        Sophus::SO3d(Eigen::Quaterniond(
+                         Eigen::AngleAxisd(0.1, Eigen::Vector3d(1, 2, 3)
+                                           .normalized()))),
+        Eigen::Vector3d(0.01, -0.02, 0.03));
+
+    for (const auto& leg : GetConfig().legs) {
+      QC::Leg leg_R;
+      leg_R.leg_id = leg.leg;
+      leg_R.power = true;
+      leg_R.position = base::Point3D(0.15, 0.1, 0.2);
+      leg_R.velocity = base::Point3D(0.1, 0, 0);
+      leg_R.force_N = base::Point3D(0, 0, 30.0);
+      leg_R.kp_N_m = base::Point3D(500, 500, 500);
+      leg_R.kd_N_m_s = base::Point3D(10, 10, 10);
+      legs_R.push_back(leg_R);
+    }
+  }
+
+  Sophus::SE3d pose_RB;
+  std::vector<QC::Leg> legs_R;
+  std::vector<QC::Leg> legs_B;
+};
+
+void BM_LegTransformSophus(benchmark::State& state) {
+  LegTransformFixture fixture;
+  for (auto _ : state) {
+    const Sophus::SE3d pose_BR = fixture.pose_RB.inverse();
+    fixture.legs_B.clear();
+    for (const auto& leg_R : fixture.legs_R) {
+      fixture.legs_B.push_back(pose_BR * leg_R);
+    }
+    benchmark::DoNotOptimize(fixture.legs_B.data());
+  }
+  state.SetItemsProcessed(state.iterations() * fixture.legs_R.size());
+}
+BENCHMARK(BM_LegTransformSophus);
+
+void BM_LegTransform(benchmark::State& state) {
+  LegTransformFixture fixture;
+  for (auto _ : state) {
+    const auto pose_BR = base::RigidTransformd(fixture.pose_RB).inverse();
+    fixture.legs_B.clear();
+    for (const auto& leg_R : fixture.legs_R) {
+      fixture.legs_B.push_back(pose_BR * leg_R);
+    }
+    benchmark::DoNotOptimize(fixture.legs_B.data());
+  }
+  state.SetItemsProcessed(state.iterations() * fixture.legs_R.size());
+}
+BENCHMARK(BM_LegTransform);
+
+/// The per-cycle RB filter, where the two orientations are usually
+/// close together.  Arg is the angle between them in millidegrees.
+void BM_RbSlerpSophus(benchmark::State& state) {
+  const Eigen::Quaterniond desired(
+      Eigen::AngleAxisd(base::Radians(state.range(0) * 0.001),
+                        Eigen::Vector3d::UnitX()));
+  Sophus::SO3d current;
+  for (auto _ : state) {
+    current = Sophus::SO3d(current.unit_quaternion().slerp(0.0, desired));
+    benchmark::DoNotOptimize(current);
+  }
+}
+BENCHMARK(BM_RbSlerpSophus)->Arg(0)->Arg(1)->Arg(1000);
+
+void BM_RbSlerp(benchmark::State& state) {
+  const Eigen::Quaterniond desired(
+      Eigen::AngleAxisd(base::Radians(state.range(0) * 0.001),
+                        Eigen::Vector3d::UnitX()));
+  Sophus::SO3d current;
+  for (auto _ : state) {
+    base::SetUnitQuaternion(
+        &current, base::Slerp(current.unit_quaternion(), desired, 0.0));
+    benchmark::DoNotOptimize(current);
+  }
+}
+BENCHMARK(BM_RbSlerp)->Arg(0)->Arg(1)->Arg(1000);
+
+void BM_SwingTrajectoryAdvance(benchmark::State& state) {
+  const double period_s = GetConfig().period_s;
+  const Eigen::Vector3d world_velocity(0.2, 0, 0);
+  auto make_trajectory = [&]() {
+    return SwingTrajectory(
+        Eigen::Vector3d(0.1, 0.1, 0.2), Eigen::Vector3d(-0.2, 0, 0),
+        Eigen::Vector3d(0.15, 0.1, 0.2), 0.03, 0.1, 0.2);
+  };
+
+  auto trajectory = make_trajectory();
+  for (auto _ : state) {
+    const auto result = trajectory.Advance(period_s, world_velocity);
+    benchmark::DoNotOptimize(result);
+    if (result.phase >= 1.0) { trajectory = make_trajectory(); }
+  }
+}
+BENCHMARK(BM_SwingTrajectoryAdvance);
+
+void BM_CalculateAccelerationLimitedTrajectory(benchmark::State& state) {
+  const double period_s = GetConfig().period_s;
+  TrajectoryState current{base::Point3D(0, 0, 0), base::Point3D(0, 0, 0)};
+  base::Point3D target(0.1, 0.05, 0.02);
+
+  for (auto _ : state) {
+    const auto result = CalculateAccelerationLimitedTrajectory(
+        current, target, 0.5, 5.0, period_s);
+    current = {result.pose_l, result.velocity_l_s};
+    if ((current.pose_l - target).norm() < 1e-4) { target = -target; }
+    benchmark::DoNotOptimize(current);
+  }
+}
+BENCHMARK(BM_CalculateAccelerationLimitedTrajectory);
+
+/// Replies immediately to every register read as if all the servos
+/// were present and holding a fixed pose.  Commands are accepted and
+/// ignored.
+class FakePi3hat : public Pi3hatInterface {
+ public:
+  FakePi3hat(boost::asio::any_io_executor executor) : executor_(executor) {}
+  ~FakePi3hat() override {}
+
+  void ReadImu(AttitudeData* attitude,
+               mjlib::io::ErrorCallback callback) override {
+    DoAttitude(attitude);
+    Post(std::move(callback));
+  }
+
+  void AsyncWaitForSlot(int*, uint16_t*, mjlib::io::ErrorCallback) override {}
+  Slot rx_slot(int, int) override { return {}; }
+  void tx_slot(int, int, const Slot&) override {}
+  Slot tx_slot(int, int) override { return {}; }
+
+  void AsyncTransmit(const Request*, Reply*,
+                     mjlib::io::ErrorCallback callback) override {
+    Post(std::move(callback));
+  }
+
+  mjlib::io::SharedStream MakeTunnel(
+      uint8_t, uint32_t, const TunnelOptions&) override {
+    return {};
+  }
+
+  void Cycle(AttitudeData* attitude,
+             const Request* request, Reply* reply,
+             mjlib::io::ErrorCallback callback) override {
+    DoAttitude(attitude);
+
+    for (const auto& id_request : *request) {
+      const uint8_t id = id_request.id;
+      ForEachRead(id_request.request, [&](uint32_t start, uint32_t count,
+                                           moteus::RegisterTypes type) {
+          for (uint32_t reg = start; reg < start + count; reg++) {
+            reply->push_back({id, reg, RegisterValue(id, reg, type)});
+          }
+        });
+    }
+
+    Post(std::move(callback));
+  }
+
+  bool supports_raw_replies() const override { return true; }
+
+  void CycleRaw(AttitudeData* attitude,
+                const Request* request, RawReplies* reply,
+                mjlib::io::ErrorCallback callback) override {
+    DoAttitude(attitude);
+    raw_cycles++;
+
+    reply->clear();
+    for (const auto& id_request : *request) {
+      RawReply frame;
+      frame.id = id_request.id;
+      auto append = [&](uint8_t byte) { frame.data[frame.size++] = byte; };
+      auto append_varuint = [&](uint32_t value) {
+        do {
+          append((value & 0x7f) | (value > 0x7f ? 0x80 : 0x00));
+          value >>= 7;
+        } while (value);
+      };
+
+      ForEachRead(id_request.request, [&](uint32_t start, uint32_t count,
+                                          moteus::RegisterTypes type) {
+          append(kReplyBase | (type << 2) | (count <= 3 ? count : 0));
+          if (count > 3) { append_varuint(count); }
+          append_varuint(start);
+          for (uint32_t reg = start; reg < start + count; reg++) {
+            std::visit([&](auto value) {
+                std::memcpy(&frame.data[frame.size], &value, sizeof(value));
+                frame.size += sizeof(value);
+              }, RegisterValue(frame.id, reg, type));
+          }
+        });
+
+      if (frame.size) { reply->push_back(frame); }
+    }
+
+    Post(std::move(callback));
+  }
+
+  int raw_cycles = 0;
+
+ private:
+  static constexpr uint8_t kWriteBase = 0x00;
+  static constexpr uint8_t kReadBase = 0x10;
+  static constexpr uint8_t kReplyBase = 0x20;
+
+  /// Invoke @p handler for each register read subframe in
+  /// @p request.
+  template <typename Handler>
+  static void ForEachRead(const mjlib::multiplex::RegisterRequest& request,
+                          Handler handler) {
+    const auto buffer = request.buffer();
+    const auto* data = reinterpret_cast<const uint8_t*>(buffer.data());
+    size_t offset = 0;
+    auto read_varuint = [&]() {
+      uint32_t result = 0;
+      for (int shift = 0; offset < buffer.size(); shift += 7) {
+        const uint8_t byte = data[offset++];
+        result |= (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) { break; }
+      }
+      return result;
+    };
+
+    while (offset < buffer.size()) {
+      const uint8_t header = data[offset++];
+      const uint8_t base = header & 0xf0;
+      // Anything else is padding.
+      if (base != kWriteBase && base != kReadBase) { return; }
+
+      const auto type = static_cast<moteus::RegisterTypes>((header >> 2) & 3);
+      const uint32_t count = (header & 3) ? (header & 3) : read_varuint();
+      const uint32_t start = read_varuint();
+      if (base == kReadBase) {
+        handler(start, count, type);
+      } else {
+        offset += count * kTypeSize[type];
+      }
+    }
+  }
+
+  static moteus::Value RegisterValue(
+      uint8_t id, uint32_t reg, moteus::RegisterTypes type) {
+    switch (reg) {
+      case moteus::kMode: {
+        return moteus::WriteInt(
+            static_cast<int>(moteus::Mode::kPosition), type);
+      }
+      case moteus::kPosition: {
+        return moteus::WritePosition(JointAngle_deg(id), type);
+      }
+      case moteus::kVelocity: { return moteus::WriteVelocity(0.0, type); }
+      case moteus::kTorque: { return moteus::WriteTorque(0.5, type); }
+      case moteus::kVoltage: { return moteus::WriteVoltage(20.0, type); }
+      case moteus::kTemperature: {
+        return moteus::WriteTemperature(30.0, type);
+      }
+      case moteus::kRezeroState: { return moteus::WriteInt(1, type); }
+      case moteus::kRegisterMapVersion: {
+        return moteus::WriteInt(moteus::kCurrentRegisterMapVersion, type);
+      }
+    }
+    return moteus::WriteInt(0, type);
+  }
+
+  static constexpr int kTypeSize[] = {1, 2, 4, 4};
+
+  void DoAttitude(AttitudeData* attitude) {
+    *attitude = {};
+    attitude->timestamp = mjlib::io::Now(executor_.context());
+  }
+
+  void Post(mjlib::io::ErrorCallback callback) {
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(callback), mjlib::base::error_code()));
+  }
+
+  boost::asio::any_io_executor executor_;
+};
+
+/// One complete timer driven cycle of QuadrupedControl, from the
+/// status request through to the emitted servo commands, in the
+/// cartesian leg control mode.
+void BM_QuadrupedControlCycle(benchmark::State& state) {
+  base::Context context;
+  auto* const debug_time =
+      mjlib::io::DebugDeadlineService::Install(context.context);
+  debug_time->SetTime(boost::posix_time::ptime(
+                          boost::gregorian::date(2020, 1, 1)));
+
+  FakePi3hat pi3hat(context.executor);
+  QuadrupedControl control(context, [&]() { return &pi3hat; });
+  control.parameters()->config = ConfigPath();
+
+  bool started = false;
+  control.AsyncStart([&](const mjlib::base::error_code& ec) {
+      mjlib::base::FailIf(ec);
+      started = true;
+    });
+  context.context.poll();
+  context.context.restart();
+  if (!started) {
+    state.SkipWithError("QuadrupedControl did not start");
+    return;
+  }
+
+  const auto& config = GetConfig();
+  const auto period = mjlib::base::ConvertSecondsToDuration(config.period_s);
+  auto run_cycle = [&]() {
+    debug_time->SetTime(debug_time->now() + period);
+    context.context.poll();
+    context.context.restart();
+  };
+
+  QC command;
+  command.mode = QC::Mode::kLeg;
+  for (const auto& leg : config.legs) {
+    QC::Leg leg_B;
+    leg_B.leg_id = leg.leg;
+    leg_B.power = true;
+    leg_B.position = leg.pose_BG *
+        MammalIk(leg.ik).Forward_G(MakeJointAngles(leg.ik)).pose;
+    leg_B.kp_N_m = config.default_kp_N_m;
+    leg_B.kd_N_m_s = config.default_kd_N_m_s;
+    command.legs_B.push_back(leg_B);
+  }
+  control.Command(command);
+
+  for (int i = 0; i < 10; i++) { run_cycle(); }
+  if (control.status().mode != QC::Mode::kLeg) {
+    state.SkipWithError("QuadrupedControl did not enter leg mode");
+    return;
+  }
+  if (pi3hat.raw_cycles == 0) {
+    state.SkipWithError("QuadrupedControl did not use raw replies");
+    return;
+  }
+  for (const auto& joint : control.status().state.joints) {
+    if (std::abs(std::abs(joint.angle_deg) -
+                 std::abs(JointAngle_deg(joint.id))) > 0.1) {
+      state.SkipWithError("raw replies were decoded incorrectly");
+      return;
+    }
+  }
+
+  for (auto _ : state) {
+    run_cycle();
+  }
+}
+BENCHMARK(BM_QuadrupedControlCycle);
+}
+
+BENCHMARK_MAIN();
@@ -14,6 +14,10 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
 #include <boost/asio/any_io_executor.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 
@@ -21,19 +25,21 @@
 #include "mjlib/base/visitor.h"
 #include "mjlib/io/now.h"
 
+#include "base/histogram.h"
+
 namespace mjmech {
 namespace mech {
 
+/// Measures the phases of each control cycle, and accumulates
+/// histograms of them for the lifetime of the process.
+///
+/// Phase durations are measured with the monotonic clock.  delta_s
+/// alone uses the executor's clock, so that it reflects simulated
+/// time when run under a simulator.
 class ControlTiming {
  public:
-  ControlTiming(const boost::asio::any_io_executor& executor,
-                boost::posix_time::ptime last_cycle_start)
-      : executor_(executor) {
-    timestamps_.last_cycle_start = last_cycle_start;
-    timestamps_.cycle_start = Now();
-    timestamps_.delta_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.cycle_start - timestamps_.last_cycle_start);
-  }
+  ControlTiming(const boost::asio::any_io_executor& executor)
+      : executor_(executor) {}
 
   struct Status {
     double query_s = 0.0;
@@ -54,49 +60,166 @@ class ControlTiming {
     }
   };
 
+  struct Histograms {
+    base::Histogram query_ns;
+    base::Histogram status_ns;
+    base::Histogram control_ns;
+    base::Histogram command_ns;
+    base::Histogram cycle_ns;
+
+    // The interval between the start of consecutive cycles.
+    base::Histogram period_ns;
+
+    // The absolute change in period_ns from one cycle to the next.
+    base::Histogram jitter_ns;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(query_ns));
+      a->Visit(MJ_NVP(status_ns));
+      a->Visit(MJ_NVP(control_ns));
+      a->Visit(MJ_NVP(command_ns));
+      a->Visit(MJ_NVP(cycle_ns));
+      a->Visit(MJ_NVP(period_ns));
+      a->Visit(MJ_NVP(jitter_ns));
+    }
+  };
+
+  /// A low rate summary of all cycles so far.  The histograms are
+  /// cumulative, so the distribution over any interval can be
+  /// recovered from the difference of two reports.
+  struct Report {
+    boost::posix_time::ptime timestamp;
+
+    base::Histogram::Summary query_ns;
+    base::Histogram::Summary status_ns;
+    base::Histogram::Summary control_ns;
+    base::Histogram::Summary command_ns;
+    base::Histogram::Summary cycle_ns;
+    base::Histogram::Summary period_ns;
+    base::Histogram::Summary jitter_ns;
+
+    Histograms histograms;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(timestamp));
+      a->Visit(MJ_NVP(query_ns));
+      a->Visit(MJ_NVP(status_ns));
+      a->Visit(MJ_NVP(control_ns));
+      a->Visit(MJ_NVP(command_ns));
+      a->Visit(MJ_NVP(cycle_ns));
+      a->Visit(MJ_NVP(period_ns));
+      a->Visit(MJ_NVP(jitter_ns));
+      a->Visit(MJ_NVP(histograms));
+    }
+  };
+
+  void StartCycle() {
+    const auto last_cycle_start = cycle_start_;
+    cycle_start_ = Now();
+    delta_s_ = mjlib::base::ConvertDurationToSeconds(
+        cycle_start_ - last_cycle_start);
+
+    const int64_t last_start_ns = timestamps_.cycle_start;
+    timestamps_ = {};
+    timestamps_.cycle_start = NowNs();
+
+    if (last_start_ns != 0) {
+      const int64_t period_ns = timestamps_.cycle_start - last_start_ns;
+      histograms_.period_ns.Add(period_ns);
+      if (last_period_ns_ != 0) {
+        histograms_.jitter_ns.Add(std::abs(period_ns - last_period_ns_));
+      }
+      last_period_ns_ = period_ns;
+    }
+  }
+
   Status status() const {
     Status result;
 
-    result.query_s = mjlib::base::ConvertDurationToSeconds(
+    result.query_s = Seconds(timestamps_.cycle_start, timestamps_.query_done);
+    result.status_s = Seconds(timestamps_.query_done, timestamps_.status_done);
+    result.control_s =
+        Seconds(timestamps_.status_done, timestamps_.control_done);
+    result.command_s =
+        Seconds(timestamps_.control_done, timestamps_.command_done);
+    result.cycle_s = Seconds(timestamps_.cycle_start, timestamps_.command_done);
+    result.delta_s = delta_s_;
+
+    return result;
+  }
+
+  const Histograms& histograms() const { return histograms_; }
+
+  void FillReport(Report* report) const {
+    report->query_ns = histograms_.query_ns.summary();
+    report->status_ns = histograms_.status_ns.summary();
+    report->control_ns = histograms_.control_ns.summary();
+    report->command_ns = histograms_.command_ns.summary();
+    report->cycle_ns = histograms_.cycle_ns.summary();
+    report->period_ns = histograms_.period_ns.summary();
+    report->jitter_ns = histograms_.jitter_ns.summary();
+    report->histograms = histograms_;
+  }
+
+  boost::posix_time::ptime cycle_start() const { return cycle_start_; }
+
+  void finish_query() {
+    timestamps_.query_done = NowNs();
+    histograms_.query_ns.Add(
         timestamps_.query_done - timestamps_.cycle_start);
-    result.status_s = mjlib::base::ConvertDurationToSeconds(
+  }
+
+  void finish_status() {
+    timestamps_.status_done = NowNs();
+    histograms_.status_ns.Add(
         timestamps_.status_done - timestamps_.query_done);
-    result.control_s = mjlib::base::ConvertDurationToSeconds(
+  }
+
+  void finish_control() {
+    timestamps_.control_done = NowNs();
+    histograms_.control_ns.Add(
         timestamps_.control_done - timestamps_.status_done);
-    result.command_s = mjlib::base::ConvertDurationToSeconds(
+  }
+
+  void finish_command() {
+    timestamps_.command_done = NowNs();
+    histograms_.command_ns.Add(
         timestamps_.command_done - timestamps_.control_done);
-    result.cycle_s = mjlib::base::ConvertDurationToSeconds(
+    histograms_.cycle_ns.Add(
         timestamps_.command_done - timestamps_.cycle_start);
-    result.delta_s = timestamps_.delta_s;
-
-    return result;
   }
 
-  boost::posix_time::ptime cycle_start() const { return timestamps_.cycle_start; }
-
-  void finish_query() { timestamps_.query_done = Now(); }
-  void finish_status() { timestamps_.status_done = Now(); }
-  void finish_control() { timestamps_.control_done = Now(); }
-  void finish_command() { timestamps_.command_done = Now(); }
-
  private:
+  // Monotonic times in nanoseconds.
   struct Timestamps {
-    boost::posix_time::ptime last_cycle_start;
-    double delta_s = 0.0;
-
-    boost::posix_time::ptime cycle_start;
-    boost::posix_time::ptime query_done;
-    boost::posix_time::ptime status_done;
-    boost::posix_time::ptime control_done;
-    boost::posix_time::ptime command_done;
+    int64_t cycle_start = 0;
+    int64_t query_done = 0;
+    int64_t status_done = 0;
+    int64_t control_done = 0;
+    int64_t command_done = 0;
   };
 
+  static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static double Seconds(int64_t start_ns, int64_t end_ns) {
+    return (end_ns - start_ns) * 1e-9;
+  }
+
   boost::posix_time::ptime Now() const {
     return mjlib::io::Now(executor_.context());
   }
 
   boost::asio::any_io_executor executor_;
+  boost::posix_time::ptime cycle_start_;
+  double delta_s_ = 0.0;
   Timestamps timestamps_;
+  int64_t last_period_ns_ = 0;
+  Histograms histograms_;
 };
 
 }
@@ -20,6 +20,7 @@
 
 #include "base/point3d.h"
 #include "base/sophus.h"
+#include "base/static_vector.h"
 
 namespace mjmech {
 namespace mech {
@@ -67,7 +68,12 @@ class IkSolver : boost::noncopyable {
     }
   };
 
-  using JointAngles = std::vector<Joint>;
+  /// The most joints that can be passed to or returned from a solver.
+  /// This covers every joint of the robot, so that callers can pass
+  /// the full set without filtering it per leg.
+  static constexpr int kMaxJoints = 12;
+
+  using JointAngles = base::StaticVector<Joint, kMaxJoints>;
   using InverseResult = std::optional<JointAngles>;
 
   // End effector positions are in the leg (G) frame.
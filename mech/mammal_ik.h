@@ -14,8 +14,9 @@
 
 #pragma once
 
-#include <dart/dynamics/BodyNode.hpp>
-#include <dart/dynamics/Skeleton.hpp>
+#include <memory>
+
+#include <Eigen/Core>
 
 #include "mjlib/base/visitor.h"
 
@@ -26,6 +27,9 @@
 namespace mjmech {
 namespace mech {
 
+template <typename Scalar, int Lanes>
+class MammalIkBatchT;
+
 class MammalIk : public IkSolver {
  public:
   struct Config {
@@ -66,21 +70,26 @@ class MammalIk : public IkSolver {
   };
 
   MammalIk(const Config& config);
+  ~MammalIk() override;
 
   Effector Forward_G(const JointAngles& angles) const override;
 
   InverseResult Inverse(const Effector&,
                         const std::optional<JointAngles>&) const override;
 
+  /// Return the foot position in the G frame for the given joint
+  /// angles.  If @p jacobian_G is non-null, it is filled with the
+  /// linear Jacobian of the foot with respect to the shoulder, femur,
+  /// and tibia joints (in that column order), in m/rad.
+  base::Point3D ForwardKinematics_G(
+      double shoulder_rad, double femur_rad, double tibia_rad,
+      Eigen::Matrix3d* jacobian_G = nullptr) const;
+
   const Config config_;
-  dart::dynamics::SkeletonPtr skel_;
-  dart::dynamics::JointPtr shoulder_joint_;
-  dart::dynamics::JointPtr femur_joint_;
-  dart::dynamics::JointPtr tibia_joint_;
-  dart::dynamics::BodyNodePtr shoulder_body_;
-  dart::dynamics::BodyNodePtr femur_body_;
-  dart::dynamics::BodyNodePtr tibia_body_;
-  dart::dynamics::BodyNodePtr foot_body_;
+
+ private:
+  // The single lane batch, which implements all of the kinematics.
+  std::unique_ptr<const MammalIkBatchT<double, 1>> batch_;
 };
 
 }
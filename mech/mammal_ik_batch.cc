@@ -0,0 +1,433 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/mammal_ik_batch.h"
+
+#include <cmath>
+
+#include <Eigen/QR>
+
+#include "mjlib/base/assert.h"
+
+#include "base/common.h"
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+// Below this absolute Jacobian determinant (in m^3), we consider the
+// leg to be at a kinematic singularity, such as when it is fully
+// extended.  In single precision, the rounding error of the
+// determinant alone is around 1e-10 for typical leg lengths.
+template <typename Scalar>
+constexpr double kSingularDeterminant = 1e-12;
+template <>
+constexpr double kSingularDeterminant<float> = 1e-9;
+
+template <typename Lane>
+Lane Atan2(const Lane& y, const Lane& x) {
+  using Scalar = typename Lane::Scalar;
+  return y.binaryExpr(x, [](Scalar a, Scalar b) { return std::atan2(a, b); });
+}
+
+template <typename Lane>
+Lane Wrap(const Lane& value) {
+  using Scalar = typename Lane::Scalar;
+  return value.unaryExpr([](Scalar v) {
+      return static_cast<Scalar>(base::WrapNegPiToPi(v));
+    });
+}
+
+template <typename Lane>
+Lane Sign(const Lane& value) {
+  return (value < 0).select(
+      Lane::Constant(-1),
+      (value > 0).select(Lane::Constant(1), Lane::Zero()));
+}
+
+template <typename Lane>
+Lane Limit1(const Lane& value) {
+  return value.max(-1).min(1);
+}
+
+template <typename Lane>
+Lane Radians(const Lane& degrees) {
+  return degrees * static_cast<typename Lane::Scalar>(base::kPi / 180.0);
+}
+
+template <typename Lane>
+Lane Degrees(const Lane& radians) {
+  return radians * static_cast<typename Lane::Scalar>(180.0 / base::kPi);
+}
+
+template <typename Matrix3, typename Vector3>
+Vector3 Multiply(const Matrix3& a, const Vector3& b) {
+  Vector3 result;
+  result.x = a.m[0][0] * b.x + a.m[0][1] * b.y + a.m[0][2] * b.z;
+  result.y = a.m[1][0] * b.x + a.m[1][1] * b.y + a.m[1][2] * b.z;
+  result.z = a.m[2][0] * b.x + a.m[2][1] * b.y + a.m[2][2] * b.z;
+  return result;
+}
+
+template <typename Matrix3>
+Matrix3 Transpose(const Matrix3& a) {
+  Matrix3 result;
+  for (int r = 0; r < 3; r++) {
+    for (int c = 0; c < 3; c++) {
+      result.m[c][r] = a.m[r][c];
+    }
+  }
+  return result;
+}
+
+// Solve A * x = b in every lane.  The inverse is formed from
+// cofactors, the same as Eigen does for fixed 3x3 matrices.  Near a
+// singularity, this returns the minimum norm solution, which is what
+// a rigid body simulation of the leg converges to as the link masses
+// go to zero.  Those lanes are solved one at a time.
+template <typename Matrix3, typename Vector3>
+Vector3 Solve3(const Matrix3& a, const Vector3& b) {
+  using Lane = decltype(b.x);
+  using Scalar = typename Lane::Scalar;
+  using Mask = Eigen::Array<bool, Lane::RowsAtCompileTime, 1>;
+
+  const auto& m = a.m;
+  auto cofactor = [&](int i, int j) -> Lane {
+    const int i1 = (i + 1) % 3;
+    const int i2 = (i + 2) % 3;
+    const int j1 = (j + 1) % 3;
+    const int j2 = (j + 2) % 3;
+    return m[i1][j1] * m[i2][j2] - m[i1][j2] * m[i2][j1];
+  };
+
+  Matrix3 inverse;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      inverse.m[j][i] = cofactor(i, j);
+    }
+  }
+  const Lane det =
+      inverse.m[0][0] * m[0][0] +
+      inverse.m[0][1] * m[1][0] +
+      inverse.m[0][2] * m[2][0];
+  const Lane inv_det = 1 / det;
+  for (auto& row : inverse.m) {
+    for (auto& value : row) { value *= inv_det; }
+  }
+
+  Vector3 result = Multiply(inverse, b);
+
+  const Mask singular = det.abs() <= kSingularDeterminant<Scalar>;
+  if (singular.any()) {
+    for (int i = 0; i < Lane::RowsAtCompileTime; i++) {
+      if (!singular(i)) { continue; }
+      result.Set(i, a.Get(i).completeOrthogonalDecomposition().solve(
+                     b.Get(i)));
+    }
+  }
+
+  return result;
+}
+}
+
+template <typename Scalar, int Lanes>
+MammalIkBatchT<Scalar, Lanes>::MammalIkBatchT(
+    const std::vector<MammalIk::Config>& configs)
+    : size_(configs.size()) {
+  MJ_ASSERT(configs.size() <= kLanes);
+
+  for (int i = 0; i < kLanes; i++) {
+    // Unused lanes duplicate the first so that they remain finite.
+    SetConfig(i, configs.empty() ? MammalIk::Config() :
+              configs[i < size_ ? i : 0]);
+  }
+}
+
+template <typename Scalar, int Lanes>
+MammalIkBatchT<Scalar, Lanes>::MammalIkBatchT(const MammalIk::Config& config)
+    : size_(kLanes) {
+  for (int i = 0; i < kLanes; i++) { SetConfig(i, config); }
+}
+
+template <typename Scalar, int Lanes>
+void MammalIkBatchT<Scalar, Lanes>::SetConfig(
+    int lane, const MammalIk::Config& config) {
+  shoulder_.Set(lane, config.shoulder.pose);
+  femur_.Set(lane, config.femur.pose);
+  tibia_.Set(lane, config.tibia.pose);
+  tibia_sign_(lane) = config.invert ? 1 : -1;
+  femur_sign_(lane) = config.invert ? -1 : 1;
+}
+
+template <typename Scalar, int Lanes>
+typename MammalIkBatchT<Scalar, Lanes>::Vector3
+MammalIkBatchT<Scalar, Lanes>::ForwardKinematics(
+    const Lane& shoulder_rad,
+    const Lane& femur_rad,
+    const Lane& tibia_rad,
+    Matrix3* jacobian_G) const {
+  // The shoulder rotates about +x, the femur and tibia about +y, each
+  // following the right hand rule.  Each joint's child link is offset
+  // by the configured pose in the joint's rotated frame:
+  //
+  //   p = Rx(shoulder) * (s + Ry(femur) * (f + Ry(tibia) * t))
+  //
+  // Since the femur and tibia share an axis, their rotations combine
+  // into a single rotation by the sum of their angles.
+  const auto& s = shoulder_;
+  const auto& f = femur_;
+  const auto& t = tibia_;
+
+  const Lane cs = shoulder_rad.cos();
+  const Lane ss = shoulder_rad.sin();
+  const Lane cf = femur_rad.cos();
+  const Lane sf = femur_rad.sin();
+  const Lane femur_tibia_rad = femur_rad + tibia_rad;
+  const Lane cft = femur_tibia_rad.cos();
+  const Lane sft = femur_tibia_rad.sin();
+
+  // The tibia link, rotated into the shoulder frame.
+  Vector3 tibia_S;
+  tibia_S.x = cft * t.x + sft * t.z;
+  tibia_S.y = t.y;
+  tibia_S.z = -sft * t.x + cft * t.z;
+
+  // The femur and tibia links, rotated into the shoulder frame.
+  Vector3 lower_S;
+  lower_S.x = cf * f.x + sf * f.z + tibia_S.x;
+  lower_S.y = f.y + tibia_S.y;
+  lower_S.z = -sf * f.x + cf * f.z + tibia_S.z;
+
+  auto rotate_x = [&](const Lane& x, const Lane& y, const Lane& z) {
+    Vector3 result;
+    result.x = x;
+    result.y = cs * y - ss * z;
+    result.z = ss * y + cs * z;
+    return result;
+  };
+
+  const Vector3 result_G = rotate_x(
+      s.x + lower_S.x, s.y + lower_S.y, s.z + lower_S.z);
+
+  if (jacobian_G) {
+    // Each column is the joint axis crossed with the vector from that
+    // joint to the foot.  All axes pass through the origin of the
+    // shoulder frame in their respective parent frames.
+    //
+    // ex x v = (0, -v.z, v.y) and ey x v = (v.z, 0, -v.x)
+    auto& j = jacobian_G->m;
+    j[0][0] = Lane::Zero();
+    j[1][0] = -result_G.z;
+    j[2][0] = result_G.y;
+
+    const Vector3 femur_col = rotate_x(lower_S.z, Lane::Zero(), -lower_S.x);
+    j[0][1] = femur_col.x;
+    j[1][1] = femur_col.y;
+    j[2][1] = femur_col.z;
+
+    const Vector3 tibia_col = rotate_x(tibia_S.z, Lane::Zero(), -tibia_S.x);
+    j[0][2] = tibia_col.x;
+    j[1][2] = tibia_col.y;
+    j[2][2] = tibia_col.z;
+  }
+
+  return result_G;
+}
+
+template <typename Scalar, int Lanes>
+void MammalIkBatchT<Scalar, Lanes>::Forward_G(
+    const Joints& joints, Effectors* effectors_G) const {
+  Matrix3 jacobian_G;
+  effectors_G->pose = ForwardKinematics(
+      Radians(joints.shoulder.angle_deg),
+      Radians(joints.femur.angle_deg),
+      Radians(joints.tibia.angle_deg),
+      &jacobian_G);
+
+  Vector3 joint_rps;
+  joint_rps.x = Radians(joints.shoulder.velocity_dps);
+  joint_rps.y = Radians(joints.femur.velocity_dps);
+  joint_rps.z = Radians(joints.tibia.velocity_dps);
+  effectors_G->velocity = Multiply(jacobian_G, joint_rps);
+
+  // The joint torques and foot force are related by tau = J^T * F.
+  Vector3 joint_torque;
+  joint_torque.x = joints.shoulder.torque_Nm;
+  joint_torque.y = joints.femur.torque_Nm;
+  joint_torque.z = joints.tibia.torque_Nm;
+  effectors_G->force_N = Solve3(Transpose(jacobian_G), joint_torque);
+}
+
+template <typename Scalar, int Lanes>
+uint32_t MammalIkBatchT<Scalar, Lanes>::Inverse(
+    const Effectors& effectors_G,
+    const Joints* current,
+    Joints* result) const {
+  using Mask = Eigen::Array<bool, kLanes, 1>;
+  const Scalar kPi = base::kPi;
+
+  const auto& point = effectors_G.pose;
+  const Lane& r = shoulder_.y;
+
+  // Every lane evaluates every path, and selects between the
+  // results, rather than branching.
+
+  // Find the angle of the shoulder joint.  This will be the tangent
+  // angle between the point and the circle with radius
+  // femur_attachment.y.  Define a 2D coordinate system looking
+  // behind the shoulder joint with +x to the right and +y up.
+  const Lane x0 = point.y;
+  const Lane y0 = -point.z;
+
+  // Close enough to centered that we can do the math directly.
+  const Mask centered = r.abs() < static_cast<Scalar>(1e-3);
+
+  // From: http://mathworld.wolfram.com/CircleTangentLine.html
+  const Lane denom = x0.square() + y0.square();
+  const Lane squared = denom - r.square();
+  // Otherwise, the point is inside our shoulder's rotating radius,
+  // and we cannot position ourselves.
+  const Mask outside = squared > 0;
+  const Lane root = squared.max(0).sqrt();
+
+  // The tangent angles are t1 = acos(cos_t1) and t2 = acos(cos_t2).
+  // Each (cos, sin) pair below is a unit vector, so the sines are
+  // found directly, rather than through acos, which loses precision
+  // near 0 and pi, where the foot is below the shoulder.
+  const Lane cos_t1 = Limit1(Lane((-r * x0 + y0 * root) / denom));
+  const Lane cos_t2 = Limit1(Lane((-r * x0 - y0 * root) / denom));
+  const Lane sin_t1 = ((-r * y0 - x0 * root) / denom).abs();
+  const Lane sin_t2 = ((-r * y0 + x0 * root) / denom).abs();
+
+  // Possible solutions are +-t1 or +-t2, only 2 of which will
+  // actually result in a tangent line.  We only need the tangent
+  // line on the same side as our shoulder point.
+  Mask have_best = Mask::Constant(false);
+  Lane best_distance_sq = Lane::Zero();
+  Lane best_x_int = Lane::Zero();
+  Lane best_y_int = Lane::Zero();
+
+  auto consider = [&](const Lane& dx, const Lane& dy) {
+    // From: http://mathworld.wolfram.com/Circle-LineIntersection.html
+    const Lane D = x0 * (y0 + dy) - (x0 + dx) * y0;
+    // We don't need to square these, since dr == 1
+    const Lane discriminant = r.abs() - D.abs();
+    const Lane x_int = D * dy;
+    const Lane y_int = -D * dx;
+    const Lane distance = (x_int - r).square() + y_int.square();
+
+    const Mask take =
+        (discriminant.abs() <= static_cast<Scalar>(1e-4)) &&
+        (!have_best || distance < best_distance_sq);
+    best_distance_sq = take.select(distance, best_distance_sq);
+    best_x_int = take.select(x_int, best_x_int);
+    best_y_int = take.select(y_int, best_y_int);
+    have_best = have_best || take;
+  };
+
+  consider(sin_t1, cos_t1);
+  consider(-sin_t1, cos_t1);
+  consider(sin_t2, cos_t2);
+  consider(-sin_t2, cos_t2);
+
+  // Only the winning line needs its angle found.
+  Lane shoulder_rad = Wrap(
+      Lane(Atan2(Lane(Lane::Zero()), r) - Atan2(best_y_int, best_x_int)));
+  if (centered.any()) {
+    shoulder_rad = centered.select(
+        -(Atan2(y0, x0) + static_cast<Scalar>(0.5) * kPi), shoulder_rad);
+  }
+  Mask valid = centered || (outside && have_best);
+
+  // Given this shoulder angle, find the center of the leg plane in
+  // the joint reference system.
+  const Lane leg_frame_y = r * shoulder_rad.cos();
+  const Lane leg_frame_z = -r * shoulder_rad.sin();
+
+  // Now we project the the point into the leg plane.
+  const Lane dz = -point.z - leg_frame_z;
+  const Lane point_y =
+      ((point.y - leg_frame_y).square() + dz.square()).sqrt() * Sign(dz);
+
+  // This 2D frame is looking through the femur along its +y axis,
+  // with x pointed to the right, and y pointed up.
+  const Lane prx = -(point.x - shoulder_.x);
+  const Lane pry = point_y + shoulder_.z;
+
+  // Now we have a simple triangle, with the femur attachment point
+  // at the origin, and the two sides being the femur and tibia.  We
+  // know the length of all three sides, which means we can find all
+  // three angles.
+  const Lane& femur_length = femur_.z;
+  const Lane& tibia_length = tibia_.z;
+
+  // Use the law of cosines to find the tibia angle first.
+  const Lane op_sq = prx.square() + pry.square();
+  const Lane op = op_sq.sqrt();
+  valid = valid && !(op > (femur_length + tibia_length));
+
+  const Lane cos_tibiainv =
+      (femur_length.square() + tibia_length.square() - op_sq) /
+      (2 * femur_length * tibia_length);
+  const Lane tibiainv_rad = Limit1(cos_tibiainv).acos();
+  const Lane tibia_rad = tibia_sign_ * (kPi - tibiainv_rad);
+
+  // Now we can solve for the femur.
+  const Lane cos_femur_1 =
+      (op_sq + femur_length.square() - tibia_length.square()) /
+      (2 * op * femur_length);
+  const Lane femur_1_rad = Limit1(cos_femur_1).acos();
+  const Lane femur_rad = Wrap(Lane(
+      -(Atan2(pry, prx) + static_cast<Scalar>(0.5) * kPi) +
+      femur_sign_ * femur_1_rad));
+
+  result->shoulder.angle_deg = Degrees(shoulder_rad);
+  result->femur.angle_deg = Degrees(femur_rad);
+  result->tibia.angle_deg = Degrees(tibia_rad);
+
+  // Now we do velocity and force.  If we have it, use the joint
+  // angles provided, otherwise, use those we just calculated.
+  Matrix3 jacobian_G;
+  if (current) {
+    ForwardKinematics(Radians(current->shoulder.angle_deg),
+                      Radians(current->femur.angle_deg),
+                      Radians(current->tibia.angle_deg),
+                      &jacobian_G);
+  } else {
+    ForwardKinematics(shoulder_rad, femur_rad, tibia_rad, &jacobian_G);
+  }
+
+  const Vector3 joint_rps = Solve3(jacobian_G, effectors_G.velocity);
+  const Vector3 joint_torque =
+      Multiply(Transpose(jacobian_G), effectors_G.force_N);
+
+  result->shoulder.velocity_dps = Degrees(joint_rps.x);
+  result->femur.velocity_dps = Degrees(joint_rps.y);
+  result->tibia.velocity_dps = Degrees(joint_rps.z);
+  result->shoulder.torque_Nm = joint_torque.x;
+  result->femur.torque_Nm = joint_torque.y;
+  result->tibia.torque_Nm = joint_torque.z;
+
+  uint32_t mask = 0;
+  for (int i = 0; i < size_; i++) {
+    if (valid(i)) { mask |= (1u << i); }
+  }
+  return mask;
+}
+
+template class MammalIkBatchT<double, 1>;
+template class MammalIkBatchT<float, 4>;
+
+}
+}
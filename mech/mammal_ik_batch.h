@@ -0,0 +1,173 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "base/point3d.h"
+
+#include "mech/mammal_ik.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Evaluates the MammalIk kinematics for @p Lanes legs at once.
+///
+/// Every quantity is stored as a struct of arrays, with one lane per
+/// leg, so that the arithmetic of all the legs proceeds together in
+/// Eigen array operations.  MammalIk itself is the single lane,
+/// double precision instantiation.
+template <typename Scalar, int Lanes>
+class MammalIkBatchT {
+ public:
+  static constexpr int kLanes = Lanes;
+  using Lane = Eigen::Array<Scalar, kLanes, 1>;
+
+  struct Vector3 {
+    Lane x = Lane::Zero();
+    Lane y = Lane::Zero();
+    Lane z = Lane::Zero();
+
+    base::Point3D Get(int lane) const {
+      return base::Point3D(x(lane), y(lane), z(lane));
+    }
+
+    void Set(int lane, const base::Point3D& value) {
+      x(lane) = value.x();
+      y(lane) = value.y();
+      z(lane) = value.z();
+    }
+  };
+
+  struct Matrix3 {
+    Lane m[3][3];
+
+    Eigen::Matrix3d Get(int lane) const {
+      Eigen::Matrix3d result;
+      for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+          result(r, c) = m[r][c](lane);
+        }
+      }
+      return result;
+    }
+  };
+
+  /// The same as IkSolver::Effector, in the G frame of each leg.
+  struct Effectors {
+    Vector3 pose;
+    Vector3 velocity;
+    Vector3 force_N;
+
+    IkSolver::Effector Get(int lane) const {
+      IkSolver::Effector result;
+      result.pose = pose.Get(lane);
+      result.velocity = velocity.Get(lane);
+      result.force_N = force_N.Get(lane);
+      return result;
+    }
+
+    void Set(int lane, const IkSolver::Effector& effector) {
+      pose.Set(lane, effector.pose);
+      velocity.Set(lane, effector.velocity);
+      force_N.Set(lane, effector.force_N);
+    }
+  };
+
+  struct Joint {
+    Lane angle_deg = Lane::Zero();
+    Lane velocity_dps = Lane::Zero();
+    Lane torque_Nm = Lane::Zero();
+
+    IkSolver::Joint Get(int lane, int id) const {
+      return IkSolver::Joint()
+          .set_id(id)
+          .set_angle_deg(angle_deg(lane))
+          .set_velocity_dps(velocity_dps(lane))
+          .set_torque_Nm(torque_Nm(lane));
+    }
+
+    template <typename JointType>
+    void Set(int lane, const JointType& joint) {
+      angle_deg(lane) = joint.angle_deg;
+      velocity_dps(lane) = joint.velocity_dps;
+      torque_Nm(lane) = joint.torque_Nm;
+    }
+  };
+
+  struct Joints {
+    Joint shoulder;
+    Joint femur;
+    Joint tibia;
+  };
+
+  MammalIkBatchT() {}
+
+  /// Lane i solves for configs[i].  At most kLanes may be given.
+  explicit MammalIkBatchT(const std::vector<MammalIk::Config>& configs);
+
+  /// Every lane solves for @p config.
+  explicit MammalIkBatchT(const MammalIk::Config& config);
+
+  int size() const { return size_; }
+
+  /// Return the foot position in the G frame for the given joint
+  /// angles, and fill @p jacobian_G as MammalIk::ForwardKinematics_G
+  /// does.
+  Vector3 ForwardKinematics(const Lane& shoulder_rad,
+                            const Lane& femur_rad,
+                            const Lane& tibia_rad,
+                            Matrix3* jacobian_G) const;
+
+  void Forward_G(const Joints& joints, Effectors* effectors_G) const;
+
+  /// Solve every lane.  If @p current is non-null, its angles are
+  /// used to find the joint velocities and torques, as with
+  /// MammalIk::Inverse.
+  ///
+  /// @return a bitmask with bit i set if lane i had a solution.  The
+  /// results of lanes without one are unspecified.
+  uint32_t Inverse(const Effectors& effectors_G,
+                   const Joints* current,
+                   Joints* result) const;
+
+ private:
+  void SetConfig(int lane, const MammalIk::Config& config);
+
+  int size_ = 0;
+
+  Vector3 shoulder_;
+  Vector3 femur_;
+  Vector3 tibia_;
+  Lane tibia_sign_ = Lane::Zero();
+  Lane femur_sign_ = Lane::Zero();
+};
+
+extern template class MammalIkBatchT<double, 1>;
+extern template class MammalIkBatchT<float, 4>;
+
+/// Four legs in single precision, as used by the control loop.
+/// Single precision is used because the 32 bit ARM NEON unit has no
+/// double precision lanes, so it is the only way all four legs share
+/// one vector register there.  Results match MammalIk to within
+/// single precision rounding, except that near a kinematic
+/// singularity the velocities and forces may differ more.
+using MammalIkBatch = MammalIkBatchT<float, 4>;
+
+}
+}
@@ -14,6 +14,10 @@
 
 #pragma once
 
+#include <array>
+#include <vector>
+
+#include "mjlib/base/fail.h"
 #include "mjlib/multiplex/asio_client.h"
 
 #include "mech/imu_client.h"
@@ -34,6 +38,26 @@ class Pi3hatInterface : public ImuClient,
       AttitudeData*,
       const Request*, Reply*,
       mjlib::io::ErrorCallback callback) = 0;
+
+  /// A servo's reply, exactly as it was received.
+  struct RawReply {
+    uint8_t id = 0;
+    uint8_t size = 0;
+    std::array<uint8_t, 64> data = {};
+  };
+  using RawReplies = std::vector<RawReply>;
+
+  /// True if CycleRaw is implemented.
+  virtual bool supports_raw_replies() const { return false; }
+
+  /// Like Cycle, but the servo replies are left undecoded, so that
+  /// the caller can decode them directly into its own structures.
+  virtual void CycleRaw(
+      AttitudeData*,
+      const Request*, RawReplies*,
+      mjlib::io::ErrorCallback callback) {
+    mjlib::base::Fail("CycleRaw is not supported");
+  }
 };
 
 }
@@ -14,6 +14,9 @@
 
 #include "mech/pi3hat_wrapper.h"
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <functional>
 #include <thread>
 
@@ -33,6 +36,7 @@
 #endif
 
 #include "base/logging.h"
+#include "base/realtime.h"
 #include "base/saturate.h"
 
 namespace mjmech {
@@ -43,6 +47,19 @@ template <typename T>
 uint32_t u32(T value) {
   return static_cast<uint32_t>(value);
 }
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CpuRelax() {
+#if defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#elif defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
 }
 
 #ifdef COM_GITHUB_MJBOTS_RASPBERRYPI
@@ -56,6 +73,7 @@ class Pi3hatWrapper::Impl {
   }
 
   ~Impl() {
+    child_done_.store(true);
     child_context_.stop();
     thread_.join();
   }
@@ -103,22 +121,13 @@ class Pi3hatWrapper::Impl {
       const Request* request,
       Reply* reply,
       mjlib::io::ErrorCallback callback) {
-    if (rf_to_send_) {
-      // Copy all the RF data to the child.
-      pi3data_.rf_tx_slots = rf_tx_slots_;
-      pi3data_.rf_to_send = rf_to_send_;
-      rf_to_send_ = 0;
-    }
-    boost::asio::post(
-        child_context_,
-        [this, callback=std::move(callback), request, reply,
-         request_attitude=(attitude_ != nullptr),
-         request_rf=rf_remote_ != nullptr]() mutable {
-          this->CHILD_Transmit(
-              request, reply,
-              request_attitude, request_rf,
-              std::move(callback));
-        });
+    Work work;
+    work.op = Work::kTransmit;
+    work.request = request;
+    work.reply = reply;
+    work.request_attitude = (attitude_ != nullptr);
+    work.request_rf = (rf_remote_ != nullptr);
+    Dispatch(work, std::move(callback));
   }
 
   void Cycle(
@@ -126,21 +135,35 @@ class Pi3hatWrapper::Impl {
       const Request* request,
       Reply* reply,
       mjlib::io::ErrorCallback callback) {
-    if (rf_to_send_) {
-      // Copy all the RF data to the child.
-      pi3data_.rf_tx_slots = rf_tx_slots_;
-      pi3data_.rf_to_send = rf_to_send_;
-      rf_to_send_ = 0;
-    }
+    Work work;
+    work.op = Work::kCycle;
+    work.attitude = attitude;
+    work.request = request;
+    work.reply = reply;
+    work.request_rf = (rf_remote_ != nullptr);
+    Dispatch(work, std::move(callback));
+  }
 
-    boost::asio::post(
-        child_context_,
-        [this, callback=std::move(callback), attitude, request, reply,
-         request_rf=(rf_remote_ != nullptr)]() mutable {
-          this->CHILD_Cycle(
-              attitude, request, reply, request_rf,
-              std::move(callback));
-        });
+  void CycleRaw(
+      AttitudeData* attitude,
+      const Request* request,
+      RawReplies* reply,
+      mjlib::io::ErrorCallback callback) {
+    Work work;
+    work.op = Work::kCycle;
+    work.attitude = attitude;
+    work.request = request;
+    work.raw_reply = reply;
+    work.request_rf = (rf_remote_ != nullptr);
+    Dispatch(work, std::move(callback));
+  }
+
+  Stats stats() const {
+    return stats_;
+  }
+
+  boost::signals2::signal<void (const Stats*)>* stats_signal() {
+    return &stats_signal_;
   }
 
   mjlib::io::SharedStream MakeTunnel(
@@ -151,6 +174,120 @@ class Pi3hatWrapper::Impl {
   }
 
  private:
+  /// A single transaction for the pi3hat thread.  Everything the
+  /// pi3hat thread needs is in here, while the callback stays with
+  /// the calling thread.
+  struct Work {
+    enum Op {
+      kCycle,
+      kTransmit,
+    };
+
+    Op op = kCycle;
+    AttitudeData* attitude = nullptr;
+    const Request* request = nullptr;
+    Reply* reply = nullptr;
+    RawReplies* raw_reply = nullptr;
+    bool request_attitude = false;
+    bool request_rf = false;
+
+    int64_t posted_ns = 0;
+    int64_t started_ns = 0;
+    int64_t finished_ns = 0;
+
+    // Filled in by the pi3hat thread.
+    int64_t cycle_ns = 0;
+    using BusCounts = std::array<uint8_t, CanBusScheduler::kNumBuses>;
+    BusCounts bus_frames = {};
+    BusCounts bus_expected = {};
+    BusCounts bus_replies = {};
+  };
+
+  void Dispatch(Work work, mjlib::io::ErrorCallback callback) {
+    work.posted_ns = NowNs();
+
+    if (options_.spin_handoff) {
+      mailbox_queue_.push_back({work, std::move(callback)});
+      if (mailbox_queue_.size() == 1) { StartMailbox(); }
+      return;
+    }
+
+    CopyRf();
+
+    boost::asio::post(
+        child_context_,
+        [this, work, callback=std::move(callback)]() mutable {
+          this->CHILD_Execute(&work);
+
+          // Now come back to the main thread.
+          boost::asio::post(
+              executor_,
+              [this, work, callback=std::move(callback)]() mutable {
+                this->Finish(work, std::move(callback));
+              });
+        });
+  }
+
+  void CopyRf() {
+    if (rf_to_send_) {
+      // Copy all the RF data to the child.
+      pi3data_.rf_tx_slots = rf_tx_slots_;
+      pi3data_.rf_to_send = rf_to_send_;
+      rf_to_send_ = 0;
+    }
+  }
+
+  /// Hand the oldest queued transaction to the pi3hat thread.
+  void StartMailbox() {
+    CopyRf();
+    mailbox_ = mailbox_queue_.front().first;
+    mailbox_request_.store(++mailbox_sequence_, std::memory_order_release);
+    boost::asio::post(executor_, std::bind(&Impl::PollMailbox, this));
+  }
+
+  /// Check for completion of the mailbox transaction, re-posting
+  /// ourselves until it is done, so that the calling executor keeps
+  /// servicing other handlers in the meantime.
+  void PollMailbox() {
+    if (mailbox_done_.load(std::memory_order_acquire) != mailbox_sequence_) {
+      CpuRelax();
+      boost::asio::post(executor_, std::bind(&Impl::PollMailbox, this));
+      return;
+    }
+
+    auto callback = std::move(mailbox_queue_.front().second);
+    mailbox_queue_.pop_front();
+    // The results live in pi3data_, so they must be consumed before
+    // the next transaction starts.
+    Finish(mailbox_, std::move(callback));
+
+    if (!mailbox_queue_.empty()) { StartMailbox(); }
+  }
+
+  void Finish(const Work& work, mjlib::io::ErrorCallback callback) {
+    stats_.request_hop_ns.Add(work.started_ns - work.posted_ns);
+    stats_.completion_hop_ns.Add(NowNs() - work.finished_ns);
+
+    bool expected_replies = false;
+    for (int i = 0; i < CanBusScheduler::kNumBuses; i++) {
+      auto& bus = stats_.buses[i];
+      bus.frames += work.bus_frames[i];
+      bus.expected_replies += work.bus_expected[i];
+      bus.replies += work.bus_replies[i];
+      if (work.bus_expected[i] == 0) { continue; }
+      expected_replies = true;
+      if (work.bus_replies[i] < work.bus_expected[i]) { bus.timeouts++; }
+    }
+    if (expected_replies) { stats_.cycle_ns.Add(work.cycle_ns); }
+
+    if (work.op == Work::kCycle) {
+      FinishCycle(work.attitude, work.reply, work.raw_reply,
+                  std::move(callback));
+    } else {
+      FinishTransmit(work.reply, std::move(callback));
+    }
+  }
+
   void HandlePowerPoll(const mjlib::base::error_code& ec) {
     if (ec == boost::asio::error::operation_aborted) {
       return;
@@ -158,6 +295,10 @@ class Pi3hatWrapper::Impl {
     mjlib::base::FailIf(ec);
 
     power_poll_.store(true);
+
+    stats_.timestamp = mjlib::io::Now(executor_.context());
+    stats_signal_(&stats_);
+    stats_ = {};
   }
 
   class Tunnel : public mjlib::io::AsyncStream,
@@ -248,6 +389,8 @@ class Pi3hatWrapper::Impl {
       std::cout << fmt::format(
           "pi3hat cpu affinity set to {}\n", options_.cpu_affinity);
     }
+    base::ConfigureRealtimeThread(
+        base::RealtimeThread::kPi3hat, options_.cpu_affinity);
 
     pi3hat_.emplace([&]() {
         mjbots::pi3hat::Pi3Hat::Configuration c;
@@ -260,8 +403,12 @@ class Pi3hatWrapper::Impl {
         return c;
       }());
 
-    boost::asio::io_context::work work{child_context_};
-    child_context_.run();
+    if (options_.spin_handoff) {
+      CHILD_Spin();
+    } else {
+      boost::asio::io_context::work work{child_context_};
+      child_context_.run();
+    }
 
     // Destroy before we finish.
     pi3hat_.reset();
@@ -294,13 +441,14 @@ class Pi3hatWrapper::Impl {
   }
 
   void CHILD_SetupCAN(mjbots::pi3hat::Pi3Hat::Input* input,
-                      const Request* requests) {
+                      const Request* requests,
+                      Work* work) {
     auto& d = pi3data_;
-    d.tx_can.clear();
+    d.unscheduled_can.clear();
 
     for (const auto& request : *requests) {
-      d.tx_can.push_back({});
-      auto& dst = d.tx_can.back();
+      d.unscheduled_can.push_back({});
+      auto& dst = d.unscheduled_can.back();
       dst.id = request.id | (request.request.request_reply() ? 0x8000 : 0x00);
       dst.size = request.request.buffer().size();
       std::memcpy(&dst.data[0], request.request.buffer().data(), dst.size);
@@ -310,8 +458,8 @@ class Pi3hatWrapper::Impl {
 
     const bool power_poll = power_poll_.exchange(false);
     if (power_poll) {
-      d.tx_can.push_back({});
-      auto& dst = d.tx_can.back();
+      d.unscheduled_can.push_back({});
+      auto& dst = d.unscheduled_can.back();
       dst.bus = 5;  // The slow auxiliary CAN bus
       dst.id = 0x00010005;
       dst.size = 2;
@@ -321,6 +469,23 @@ class Pi3hatWrapper::Impl {
       input->force_can_check |= (1 << 5);
     }
 
+    // The pi3hat returns as soon as every frame marked expect_reply
+    // has been answered, so the frames only need to be ordered such
+    // that each bus starts transmitting as early as possible.
+    scheduler_.Clear();
+    for (size_t i = 0; i < d.unscheduled_can.size(); i++) {
+      const auto& frame = d.unscheduled_can[i];
+      scheduler_.Add(i, frame.bus, frame.expect_reply);
+    }
+    d.tx_can.clear();
+    for (const int index : scheduler_.Schedule()) {
+      d.tx_can.push_back(d.unscheduled_can[index]);
+    }
+    for (int i = 0; i < CanBusScheduler::kNumBuses; i++) {
+      work->bus_frames[i] = scheduler_.frames(i);
+      work->bus_expected[i] = scheduler_.expected_replies(i);
+    }
+
     if (d.tx_can.size()) {
       input->tx_can = {&d.tx_can[0], d.tx_can.size()};
     }
@@ -329,59 +494,59 @@ class Pi3hatWrapper::Impl {
     input->rx_can = {&d.rx_can[0], d.rx_can.size()};
   }
 
-  void CHILD_Cycle(AttitudeData* attitude_dest,
-                   const Request* request,
-                   Reply* reply,
-                   bool request_rf,
-                   mjlib::io::ErrorCallback callback) {
-    mjbots::pi3hat::Pi3Hat::Input input;
-
-    CHILD_SetupRf(&input);
-    CHILD_SetupCAN(&input, request);
-
-    input.attitude = &pi3data_.attitude;
-    input.request_attitude = true;
-    input.wait_for_attitude = true;
-    input.request_attitude_detail = options_.attitude_detail;
-    input.request_rf = request_rf;
-    input.timeout_ns = options_.query_timeout_s * 1e9;
-    input.rx_extra_wait_ns = 0;
-
-    pi3data_.result = pi3hat_->Cycle(input);
+  void CHILD_Spin() {
+    uint32_t handled = 0;
+    while (!child_done_.load(std::memory_order_relaxed)) {
+      const auto sequence = mailbox_request_.load(std::memory_order_acquire);
+      if (sequence != handled) {
+        handled = sequence;
+        CHILD_Execute(&mailbox_);
+        mailbox_done_.store(sequence, std::memory_order_release);
+        continue;
+      }
 
-    // Now come back to the main thread.
-    boost::asio::post(
-        executor_,
-        [this, callback=std::move(callback), attitude_dest, reply]() mutable {
-          this->FinishCycle(attitude_dest, reply, std::move(callback));
-        });
+      // Tunnels still arrive through asio.  Polling an idle context
+      // does not involve the kernel.
+      child_context_.poll();
+      child_context_.restart();
+      CpuRelax();
+    }
   }
 
-  void CHILD_Transmit(const Request* request,
-                      Reply* reply,
-                      bool request_attitude,
-                      bool request_rf,
-                      mjlib::io::ErrorCallback callback) {
+  void CHILD_Execute(Work* work) {
+    work->started_ns = NowNs();
+
     mjbots::pi3hat::Pi3Hat::Input input;
 
     CHILD_SetupRf(&input);
-    CHILD_SetupCAN(&input, request);
+    CHILD_SetupCAN(&input, work->request, work);
 
     input.attitude = &pi3data_.attitude;
-    input.request_attitude = request_attitude;
-    input.wait_for_attitude = false;
     input.request_attitude_detail = options_.attitude_detail;
-    input.request_rf = request_rf;
+    input.request_rf = work->request_rf;
     input.timeout_ns = options_.query_timeout_s * 1e9;
 
+    if (work->op == Work::kCycle) {
+      input.request_attitude = true;
+      input.wait_for_attitude = true;
+      input.rx_extra_wait_ns = 0;
+    } else {
+      input.request_attitude = work->request_attitude;
+      input.wait_for_attitude = false;
+    }
+
+    const auto cycle_start_ns = NowNs();
     pi3data_.result = pi3hat_->Cycle(input);
+    work->finished_ns = NowNs();
+    work->cycle_ns = work->finished_ns - cycle_start_ns;
 
-    // Now come back to the main thread.
-    boost::asio::post(
-        executor_,
-        [this, callback=std::move(callback), reply]() mutable {
-          this->FinishTransmit(reply, std::move(callback));
-        });
+    work->bus_replies = {};
+    for (size_t i = 0; i < pi3data_.result.rx_can_size; i++) {
+      const int bus = pi3data_.rx_can[i].bus;
+      if (bus >= 0 && bus < CanBusScheduler::kNumBuses) {
+        work->bus_replies[bus]++;
+      }
+    }
   }
 
   size_t CHILD_TunnelPoll(uint8_t id, uint32_t channel,
@@ -524,7 +689,9 @@ class Pi3hatWrapper::Impl {
         std::bind(std::move(callback), mjlib::base::error_code(), size));
   }
 
-  void FinishCAN(Reply* reply) {
+  void FinishCAN(Reply* reply, RawReplies* raw_reply) {
+    if (raw_reply) { raw_reply->clear(); }
+
     // First CAN.
     for (size_t i = 0; i < pi3data_.result.rx_can_size; i++) {
       const auto& src = pi3data_.rx_can[i];
@@ -545,6 +712,15 @@ class Pi3hatWrapper::Impl {
         continue;
       }
 
+      if (raw_reply) {
+        raw_reply->push_back({});
+        auto& dst = raw_reply->back();
+        dst.id = (src.id >> 8) & 0xff;
+        dst.size = src.size;
+        std::memcpy(&dst.data[0], &src.data[0], src.size);
+        continue;
+      }
+
       parsed_data_.clear();
       mjlib::base::BufferReadStream payload_stream{
         {reinterpret_cast<const char*>(&src.data[0]),
@@ -606,10 +782,11 @@ class Pi3hatWrapper::Impl {
 
   void FinishCycle(AttitudeData* attitude,
                    Reply* reply,
+                   RawReplies* raw_reply,
                    mjlib::io::ErrorCallback callback) {
     const auto now = mjlib::io::Now(executor_.context());
 
-    FinishCAN(reply);
+    FinishCAN(reply, raw_reply);
     FinishAttitude(now, attitude);
     FinishRF(now);
 
@@ -621,7 +798,7 @@ class Pi3hatWrapper::Impl {
   void FinishTransmit(Reply* reply, mjlib::io::ErrorCallback callback) {
     const auto now = mjlib::io::Now(executor_.context());
 
-    FinishCAN(reply);
+    FinishCAN(reply, nullptr);
 
     if (attitude_) {
       FinishAttitude(now, attitude_);
@@ -678,12 +855,14 @@ class Pi3hatWrapper::Impl {
 
   // Only accessed from the thread.
   std::optional<mjbots::pi3hat::Pi3Hat> pi3hat_;
+  CanBusScheduler scheduler_;
   boost::asio::io_context child_context_;
 
   // The following are accessed by both threads, but never at the same
   // time.  They can either be accessed inside CHILD_Register, or in
   // the parent until the callback is invoked.
   struct Pi3Data {
+    std::vector<mjbots::pi3hat::CanFrame> unscheduled_can;
     std::vector<mjbots::pi3hat::CanFrame> tx_can;
     std::vector<mjbots::pi3hat::CanFrame> rx_can;
     std::vector<mjbots::pi3hat::RfSlot> tx_rf;
@@ -697,6 +876,22 @@ class Pi3hatWrapper::Impl {
   Pi3Data pi3data_;
 
   std::atomic<bool> power_poll_{false};
+
+  // The spin handoff mailbox.  mailbox_ is written by the calling
+  // thread before mailbox_request_ is advanced, and by the pi3hat
+  // thread before mailbox_done_ is advanced.  Transactions requested
+  // while one is outstanding wait in mailbox_queue_, whose front is
+  // the one in the mailbox.
+  std::deque<std::pair<Work, mjlib::io::ErrorCallback>> mailbox_queue_;
+  Work mailbox_;
+  uint32_t mailbox_sequence_ = 0;
+  std::atomic<uint32_t> mailbox_request_{0};
+  std::atomic<uint32_t> mailbox_done_{0};
+  std::atomic<bool> child_done_{false};
+
+  // Only accessed from the calling thread.
+  Stats stats_;
+  boost::signals2::signal<void (const Stats*)> stats_signal_;
 };
 #else
 
@@ -712,9 +907,18 @@ class Pi3hatWrapper::Impl {
   void AsyncTransmit(const Request*, Reply*, mjlib::io::ErrorCallback) {}
   void Cycle(AttitudeData*, const Request*, Reply*,
              mjlib::io::ErrorCallback) {}
+  void CycleRaw(AttitudeData*, const Request*, RawReplies*,
+                mjlib::io::ErrorCallback) {}
   mjlib::io::SharedStream MakeTunnel(uint8_t, uint32_t, const TunnelOptions&) {
     return {};
   }
+  Stats stats() const { return {}; }
+  boost::signals2::signal<void (const Stats*)>* stats_signal() {
+    return &stats_signal_;
+  }
+
+ private:
+  boost::signals2::signal<void (const Stats*)> stats_signal_;
 };
 #endif
 
@@ -766,7 +970,12 @@ mjlib::io::SharedStream Pi3hatWrapper::MakeTunnel(
 }
 
 Pi3hatWrapper::Stats Pi3hatWrapper::stats() const {
-  return Stats();
+  return impl_->stats();
+}
+
+boost::signals2::signal<void (const Pi3hatWrapper::Stats*)>*
+Pi3hatWrapper::stats_signal() {
+  return impl_->stats_signal();
 }
 
 void Pi3hatWrapper::Cycle(AttitudeData* attitude,
@@ -776,5 +985,12 @@ void Pi3hatWrapper::Cycle(AttitudeData* attitude,
   impl_->Cycle(attitude, request, reply, std::move(callback));
 }
 
+void Pi3hatWrapper::CycleRaw(AttitudeData* attitude,
+                             const Request* request,
+                             RawReplies* reply,
+                             mjlib::io::ErrorCallback callback) {
+  impl_->CycleRaw(attitude, request, reply, std::move(callback));
+}
+
 }
 }
@@ -14,17 +14,22 @@
 
 #pragma once
 
+#include <array>
 #include <memory>
 #include <string>
 
 #include <boost/asio/any_io_executor.hpp>
+#include <boost/signals2/signal.hpp>
 
 #include "mjlib/base/visitor.h"
 #include "mjlib/io/async_types.h"
 #include "mjlib/multiplex/asio_client.h"
 #include "mjlib/multiplex/register.h"
 
+#include "base/histogram.h"
+
 #include "mech/attitude_data.h"
+#include "mech/can_bus_scheduler.h"
 #include "mech/pi3hat_interface.h"
 
 namespace mjmech {
@@ -73,6 +78,15 @@ class Pi3hatWrapper : public Pi3hatInterface {
     bool attitude_detail = false;
     int force_bus = -1;
 
+    // If true, requests are handed to the pi3hat thread, and results
+    // back, through a single slot mailbox which both threads busy
+    // poll, rather than through asio.  This avoids mutexes and
+    // futex wakes on each hop, but the pi3hat thread then spins
+    // continuously and the calling executor re-posts a completion
+    // check until each transaction is done, so it should only be
+    // used when both are pinned to their own isolated CPUs.
+    bool spin_handoff = false;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(cpu_affinity));
@@ -85,6 +99,7 @@ class Pi3hatWrapper : public Pi3hatInterface {
       a->Visit(MJ_NVP(imu_rate_hz));
       a->Visit(MJ_NVP(attitude_detail));
       a->Visit(MJ_NVP(force_bus));
+      a->Visit(MJ_NVP(spin_handoff));
     }
   };
 
@@ -107,13 +122,60 @@ class Pi3hatWrapper : public Pi3hatInterface {
       uint32_t channel,
       const TunnelOptions& options) override;
 
+  /// Statistics accumulated since the last emission of
+  /// stats_signal().
+  struct BusStats {
+    uint64_t frames = 0;
+    uint64_t expected_replies = 0;
+    uint64_t replies = 0;
+
+    // The number of transactions where this bus did not receive all
+    // of its expected replies before query_timeout_s.
+    uint64_t timeouts = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(frames));
+      a->Visit(MJ_NVP(expected_replies));
+      a->Visit(MJ_NVP(replies));
+      a->Visit(MJ_NVP(timeouts));
+    }
+  };
+
   struct Stats {
+    boost::posix_time::ptime timestamp;
+
+    // Time from a request being made on the calling thread until the
+    // pi3hat thread starts it.
+    base::Histogram request_hop_ns;
+
+    // Time from the pi3hat thread finishing a request until the
+    // calling thread sees the result.
+    base::Histogram completion_hop_ns;
+
+    // The duration of each pi3hat transaction which expected any
+    // replies.  The pi3hat reports no per-bus timing, so this covers
+    // all buses together.
+    base::Histogram cycle_ns;
+
+    // Indexed by the pi3hat bus number, 1 through 5.
+    std::array<BusStats, CanBusScheduler::kNumBuses> buses;
+
     template <typename Archive>
     void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(timestamp));
+      a->Visit(MJ_NVP(request_hop_ns));
+      a->Visit(MJ_NVP(completion_hop_ns));
+      a->Visit(MJ_NVP(cycle_ns));
+      a->Visit(MJ_NVP(buses));
     }
   };
   Stats stats() const;
 
+  /// Emitted every power_poll_period_s, after which the statistics
+  /// are reset.
+  boost::signals2::signal<void (const Stats*)>* stats_signal();
+
   // ************************
   // ImuClient
 
@@ -140,6 +202,13 @@ class Pi3hatWrapper : public Pi3hatInterface {
              Reply* reply,
              mjlib::io::ErrorCallback callback) override;
 
+  bool supports_raw_replies() const override { return true; }
+
+  void CycleRaw(AttitudeData*,
+                const Request* request,
+                RawReplies* reply,
+                mjlib::io::ErrorCallback callback) override;
+
  private:
   class Impl;
   std::unique_ptr<Impl> impl_;
@@ -327,7 +327,7 @@ class Application {
         file_writer_(),
         log_registrar_(context, &file_writer_) {
     if (!options.log.empty()) {
-      file_writer_.Open(options.log);
+      log_registrar_.Open(options.log);
     }
 
     load_cell_.signal()->connect(
@@ -444,8 +444,10 @@ class Application {
       throw mjlib::base::system_error::einval(
           "Unknown response: " + schema_prefix_);
     }
-    debug_ids_[schema_name_] = file_writer_.AllocateIdentifier(schema_name_);
-    file_writer_.WriteSchema(debug_ids_[schema_name_], schema_data_);
+    log_registrar_.WithLog([&](auto* log) {
+        debug_ids_[schema_name_] = log->AllocateIdentifier(schema_name_);
+        log->WriteSchema(debug_ids_[schema_name_], schema_data_);
+      });
     StartSchemaRead();
   }
 
@@ -471,7 +473,9 @@ class Application {
       throw mjlib::base::system_error::einval("Unknown emit: " + schema_prefix_);
     }
 
-    file_writer_.WriteData({}, debug_ids_[schema_name_], schema_data_);
+    log_registrar_.WithLog([&](auto* log) {
+        log->WriteData({}, debug_ids_[schema_name_], schema_data_);
+      });
 
     StartReadDebugData();
   }
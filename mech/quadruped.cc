@@ -17,6 +17,7 @@
 #include <boost/asio/post.hpp>
 
 #include "base/logging.h"
+#include "base/telemetry_registry.h"
 #include "mech/pi3hat_wrapper.h"
 
 namespace pl = std::placeholders;
@@ -28,7 +29,8 @@ class Quadruped::Impl {
  public:
   Impl(base::Context& context)
       : executor_(context.executor),
-        factory_(context.factory.get()) {
+        factory_(context.factory.get()),
+        telemetry_registry_(context.telemetry_registry.get()) {
     m_.pi3hat = std::make_unique<
       mjlib::io::Selector<Pi3hatInterface>>(executor_, "type");
     m_.pi3hat->Register<Pi3hatWrapper>("pi3hat");
@@ -57,11 +59,26 @@ class Quadruped::Impl {
   }
 
   void AsyncStart(mjlib::io::ErrorCallback callback) {
-    base::StartArchive::Start(&m_, std::move(callback));
+    base::StartArchive::Start(
+        &m_, [this, callback=std::move(callback)](
+            const mjlib::base::error_code& ec) mutable {
+          // Which pi3hat implementation is in use is only known once
+          // it has started.
+          if (!ec) {
+            auto* const pi3hat =
+                dynamic_cast<Pi3hatWrapper*>(m_.pi3hat->selected());
+            if (pi3hat) {
+              telemetry_registry_->Register(
+                  "pi3hat", pi3hat->stats_signal());
+            }
+          }
+          callback(ec);
+        });
   }
 
   boost::asio::any_io_executor executor_;
   mjlib::io::StreamFactory* const factory_;
+  base::TelemetryRegistry* const telemetry_registry_;
 
   base::LogRef log_ = base::GetLogInstance("Quadruped");
 
@@ -17,10 +17,13 @@
 #include <array>
 #include <map>
 #include <optional>
+#include <utility>
 #include <vector>
 
 #include "base/point3d.h"
+#include "base/rigid_transform.h"
 #include "base/sophus.h"
+#include "base/static_vector.h"
 
 namespace mjmech {
 namespace mech {
@@ -162,11 +165,21 @@ struct QuadrupedCommand {
     }
 
     friend Leg operator*(const Sophus::SE3d& pose, const Leg&);
+    friend Leg operator*(const base::RigidTransformd& pose, const Leg&);
   };
 
   // Only valid for kLeg mode.
   std::vector<Leg> legs_B;
 
+  static constexpr int kNumLegs = 4;
+  static constexpr int kNumJoints = 12;
+
+  // Fixed capacity lists used as working storage in the control loop
+  // so that it need not allocate.
+  using Joints = base::StaticVector<Joint, kNumJoints>;
+  using Legs = base::StaticVector<Leg, kNumLegs>;
+  using LegPoses = base::StaticVector<std::pair<int, base::Point3D>, kNumLegs>;
+
   struct Rest {
     Sophus::SE3d offset_RB;
 
@@ -257,6 +270,20 @@ inline QuadrupedCommand::Leg operator*(const Sophus::SE3d& pose_AB,
   return result_A;
 }
 
+inline QuadrupedCommand::Leg operator*(const base::RigidTransformd& pose_AB,
+                                       const QuadrupedCommand::Leg& leg_B) {
+  QuadrupedCommand::Leg result_A = leg_B;
+
+  result_A.position = pose_AB * leg_B.position;
+  result_A.velocity = pose_AB.Rotate(leg_B.velocity);
+  result_A.acceleration = pose_AB.Rotate(leg_B.acceleration);
+  result_A.force_N = pose_AB.Rotate(leg_B.force_N);
+  result_A.kp_N_m = pose_AB.Rotate(leg_B.kp_N_m);
+  result_A.kd_N_m_s = pose_AB.Rotate(leg_B.kd_N_m_s);
+
+  return result_A;
+}
+
 }
 }
 
@@ -14,12 +14,16 @@
 
 #pragma once
 
+#include <algorithm>
 #include <deque>
 
 #include <boost/noncopyable.hpp>
 
 #include "mjlib/base/assert.h"
 
+#include "base/dense_id_map.h"
+
+#include "mech/mammal_ik_batch.h"
 #include "mech/propagate_leg.h"
 #include "mech/quadruped_command.h"
 #include "mech/quadruped_config.h"
@@ -28,6 +32,7 @@
 #include "mech/swing_trajectory.h"
 #include "mech/trajectory.h"
 #include "mech/valid_leg_region.h"
+#include "mech/valid_leg_region_cache.h"
 #include "mech/vertical_line_frame.h"
 
 namespace mjmech {
@@ -107,40 +112,71 @@ struct QuadrupedContext : boost::noncopyable {
 
   QuadrupedContext(const QuadrupedConfig& config_in,
                    const QuadrupedCommand* command_in,
-                   QuadrupedState* state_in)
+                   QuadrupedState* state_in,
+                   const ValidLegRegionCache::Options& region_cache = {})
       : config(config_in),
         command(command_in),
         state(state_in) {
-    for (const auto& leg : config.legs) {
+    // Legs and joints are kept permanently in id order, and each id
+    // is mapped to its slot once here, so that the control loop can
+    // find any of them with a single array lookup.
+    std::vector<Config::Leg> sorted_legs = config.legs;
+    std::sort(sorted_legs.begin(), sorted_legs.end(),
+              [](const auto& lhs, const auto& rhs) {
+                return lhs.leg < rhs.leg;
+              });
+    for (const auto& leg : sorted_legs) {
+      leg_slots.Insert(leg.leg, legs.size());
       legs.emplace_back(leg, config.stand_up, config.stand_height,
                         config.idle_x, config.idle_y);
     }
 
+    {
+      std::vector<MammalIk::Config> ik_configs;
+      for (const auto& leg : legs) { ik_configs.push_back(leg.config.ik); }
+      ik_batch = MammalIkBatch(ik_configs);
+    }
+
+    joints = config.joints;
+    std::sort(joints.begin(), joints.end(),
+              [](const auto& lhs, const auto& rhs) {
+                return lhs.id < rhs.id;
+              });
+    for (size_t i = 0; i < joints.size(); i++) {
+      joint_slots.Insert(joints[i].id, i);
+    }
+
+    state->joints.resize(joints.size());
+    for (size_t i = 0; i < joints.size(); i++) {
+      state->joints[i].id = joints[i].id;
+    }
+    state->legs_B.resize(legs.size());
+    for (size_t i = 0; i < legs.size(); i++) {
+      state->legs_B[i].leg = legs[i].leg;
+    }
+
     // Determine a rough estimate of the valid region for each leg.
 
     // assume B == R .... this doesn't matter too much, we just need
     // to give a point "somewhere" in the valid G region.
     Sophus::SE3d tf_BR;
-    for (size_t i = 0; i < legs.size(); i++) {
-      valid_regions.emplace_back(
-          legs[i].ik,
-          legs[i].pose_BG.inverse() * tf_BR * legs[i].idle_R,
-          config.walk.lift_height);
+    std::vector<ValidLegRegionCache::Leg> region_legs;
+    for (const auto& leg : legs) {
+      ValidLegRegionCache::Leg region_leg;
+      region_leg.ik = leg.config.ik;
+      region_leg.idle_G = leg.pose_BG.inverse() * tf_BR * leg.idle_R;
+      region_leg.lift_height = config.walk.lift_height;
+      region_legs.push_back(region_leg);
     }
+    valid_regions = ValidLegRegionCache(region_cache).Get(region_legs);
   }
 
   const Leg& GetLeg(int id) const {
-    for (auto& leg : legs) {
-      if (leg.leg == id) { return leg; }
-    }
-    mjlib::base::AssertNotReached();
+    return legs[leg_slots[id]];
   }
 
   const QuadrupedState::Leg& GetLegState_B(int id) const {
-    for (const auto& leg_B : state->legs_B) {
-      if (leg_B.leg == id) { return leg_B; }
-    }
-    mjlib::base::AssertNotReached();
+    return state->legs_B[leg_slots[id]];
   }
 
   QuadrupedState::Leg GetLegState_R(int id) const {
@@ -148,10 +184,7 @@ struct QuadrupedContext : boost::noncopyable {
   }
 
   const QuadrupedState::Joint& GetJointState(int id) const {
-    for (const auto& joint : state->joints) {
-      if (joint.id == id) { return joint; }
-    }
-    mjlib::base::AssertNotReached();
+    return state->joints[joint_slots[id]];
   }
 
   base::KinematicRelation LevelDesiredRB() const {
@@ -192,7 +225,7 @@ struct QuadrupedContext : boost::noncopyable {
     state->robot.desired_R.w = result_R.w;
   }
 
-  void MoveLegsForR(std::vector<QC::Leg>* legs_R) {
+  void MoveLegsForR(QC::Legs* legs_R) {
     PropagateLeg propagator(state->robot.desired_R.v,
                             state->robot.desired_R.w,
                             config.period_s);
@@ -217,11 +250,11 @@ struct QuadrupedContext : boost::noncopyable {
 
   bool MoveLegsFixedSpeedZ(
       const std::vector<int>& leg_ids,
-      std::vector<QC::Leg>* legs_R,
+      QC::Legs* legs_R,
       double desired_velocity,
       double desired_height,
       const MoveOptions& move_options = MoveOptions()) const {
-    std::vector<std::pair<int, base::Point3D>> desired_poses_R;
+    QC::LegPoses desired_poses_R;
 
     for (int id : leg_ids) {
       const auto& leg_R = GetLeg_R(legs_R, id);
@@ -240,9 +273,9 @@ struct QuadrupedContext : boost::noncopyable {
   }
 
   bool MoveLegsFixedSpeed(
-      std::vector<QC::Leg>* legs_R,
+      QC::Legs* legs_R,
       double desired_velocity,
-      const std::vector<std::pair<int, base::Point3D>>& command_pose_R,
+      const QC::LegPoses& command_pose_R,
       const MoveOptions& move_options = MoveOptions(),
       base::Point3D velocity_mask = base::Point3D(1., 1., 1),
       base::Point3D velocity_inverse_mask = base::Point3D(0., 0., 0.)) const {
@@ -280,9 +313,9 @@ struct QuadrupedContext : boost::noncopyable {
   }
 
   void MoveLegsTargetTime(
-      std::vector<QC::Leg>* legs_R,
+      QC::Legs* legs_R,
       double remaining_s,
-      const std::vector<std::pair<int, base::Point3D>>& command_pose_R) const {
+      const QC::LegPoses& command_pose_R) const {
     for (const auto& pair : command_pose_R) {
       auto& leg_R = GetLeg_R(legs_R, pair.first);
 
@@ -311,7 +344,19 @@ struct QuadrupedContext : boost::noncopyable {
   const QuadrupedConfig& config;
   const QuadrupedCommand* const command;
   QuadrupedState* const state;
+  static constexpr int kMaxId = 32;
+
+  /// Legs, ordered by leg id.  state->legs_B uses the same slots.
   std::deque<Leg> legs;
+  base::DenseIdMap<kMaxId> leg_slots;
+
+  /// Solves the kinematics of every leg at once, with lanes in slot
+  /// order.
+  MammalIkBatch ik_batch;
+
+  /// Joints, ordered by servo id.  state->joints uses the same slots.
+  std::vector<Config::Joint> joints;
+  base::DenseIdMap<kMaxId> joint_slots;
 
   std::array<SwingTrajectory, 4> swing_trajectory = {};
   std::vector<ValidLegRegion> valid_regions;
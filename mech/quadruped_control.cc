@@ -27,21 +27,28 @@
 #include "mjlib/io/now.h"
 #include "mjlib/io/repeating_timer.h"
 
+#include "base/allocation_counter.h"
 #include "base/common.h"
 #include "base/fit_plane.h"
 #include "base/interpolate.h"
 #include "base/logging.h"
+#include "base/realtime.h"
+#include "base/rigid_transform.h"
 #include "base/sophus.h"
+#include "base/static_vector.h"
 #include "base/telemetry_registry.h"
 #include "base/timestamped_log.h"
 
 #include "mech/attitude_data.h"
 #include "mech/mammal_ik.h"
+#include "mech/mammal_ik_batch.h"
 #include "mech/moteus.h"
 #include "mech/quadruped_config.h"
 #include "mech/quadruped_context.h"
 #include "mech/quadruped_trot.h"
 #include "mech/quadruped_util.h"
+#include "mech/servo_command_frame.h"
+#include "mech/servo_reply_plan.h"
 #include "mech/swing_trajectory.h"
 #include "mech/trajectory.h"
 
@@ -152,12 +159,13 @@ class QuadrupedControl::Impl {
   Impl(base::Context& context,
        Pi3hatGetter pi3hat_getter)
       : executor_(context.executor),
-        telemetry_log_(context.telemetry_log.get()),
+        telemetry_log_(context.telemetry_registry->log()),
         timer_(executor_),
         pi3hat_getter_(pi3hat_getter) {
     context.telemetry_registry->Register("qc_status", &status_signal_);
     context.telemetry_registry->Register("qc_command", &command_signal_);
     context.telemetry_registry->Register("qc_control", &control_signal_);
+    context.telemetry_registry->Register("qc_timing", &timing_signal_);
     context.telemetry_registry->Register("imu", &imu_signal_);
     context.telemetry_registry->Register("servo_config", &servo_config_signal_);
   }
@@ -167,6 +175,12 @@ class QuadrupedControl::Impl {
 
     BOOST_ASSERT(!!pi3hat_);
 
+    if (parameters_.check_allocations &&
+        !base::IsAllocationCountingEnabled()) {
+      mjlib::base::Fail(
+          "check_allocations requires //base:allocation_counter_hooks");
+    }
+
     // Load our configuration.
     std::vector<std::string> configs;
     boost::split(configs, parameters_.config, boost::is_any_of(" "));
@@ -187,7 +201,21 @@ class QuadrupedControl::Impl {
               config_.legs.size(), config_.joints.size()));
     }
 
-    context_.emplace(config_, &current_command_, &status_.state);
+    ValidLegRegionCache::Options region_cache;
+    region_cache.directory = parameters_.valid_leg_region_cache;
+    context_.emplace(config_, &current_command_, &status_.state,
+                     region_cache);
+
+    // Reserve all our per-cycle storage up front, so that the control
+    // loop itself never needs to allocate.  The context has already
+    // sized status_.state.joints and legs_B, one slot per id.
+    for (auto& control_log : control_logs_) {
+      control_log.joints.reserve(kNumServos);
+      control_log.leg_pds.reserve(QC::kNumLegs);
+      control_log.legs_B.reserve(QC::kNumLegs);
+      control_log.legs_R.reserve(QC::kNumLegs);
+    }
+    client_command_.reserve(kNumServos);
 
     PopulateStatusRequest();
 
@@ -235,20 +263,41 @@ class QuadrupedControl::Impl {
     command_signal_(&command_log);
   }
 
+  /// Append the register reads we need each cycle to @p request,
+  /// and if given, record their reply layout in @p plan.
+  void AppendStatusQuery(mjlib::multiplex::RegisterRequest* request,
+                         bool configuring,
+                         ServoReplyPlan* plan = nullptr) const {
+    auto read = [&](uint32_t reg, uint32_t count, int type) {
+      request->ReadMultiple(reg, count, type);
+      if (plan) { plan->ReadMultiple(reg, count, type); }
+    };
+
+    if (configuring) {
+      // While configuring, we request a few more things.
+      read(moteus::Register::kMode, 4, 1);
+      read(moteus::Register::kRezeroState, 4, 0);
+      read(moteus::Register::kRegisterMapVersion, 1, 2);
+      read(moteus::Register::kSerialNumber, 3, 2);
+      return;
+    }
+
+    // Read mode, position, velocity, and torque.
+    read(moteus::Register::kMode, 4, 1);
+    read(moteus::Register::kVoltage, 3, 0);
+
+    if (parameters_.servo_debug) {
+      read(moteus::Register::kPositionKp, 5, 1);
+    }
+  }
+
   void PopulateStatusRequest() {
     status_request_ = {};
     for (const auto& joint : config_.joints) {
       status_request_.push_back({});
       auto& current = status_request_.back();
       current.id = joint.id;
-
-      // Read mode, position, velocity, and torque.
-      current.request.ReadMultiple(moteus::Register::kMode, 4, 1);
-      current.request.ReadMultiple(moteus::Register::kVoltage, 3, 0);
-
-      if (parameters_.servo_debug) {
-        current.request.ReadMultiple(moteus::Register::kPositionKp, 5, 1);
-      }
+      AppendStatusQuery(&current.request, false);
     }
 
     config_status_request_ = {};
@@ -256,13 +305,47 @@ class QuadrupedControl::Impl {
       config_status_request_.push_back({});
       auto& current = config_status_request_.back();
       current.id = joint.id;
+      AppendStatusQuery(&current.request, true);
+    }
 
-      // While configuring, we request a few more things.
-      current.request.ReadMultiple(moteus::Register::kMode, 4, 1);
-      current.request.ReadMultiple(moteus::Register::kRezeroState, 4, 0);
-      current.request.ReadMultiple(moteus::Register::kRegisterMapVersion, 1, 2);
-      current.request.ReadMultiple(moteus::Register::kSerialNumber, 3, 2);
+    pipelined_request_.resize(context_->joints.size());
+
+    // Every servo is asked for the same registers, so one plan
+    // decodes all of their replies.
+    status_plan_.Clear();
+    mjlib::multiplex::RegisterRequest plan_request;
+    AppendStatusQuery(&plan_request, false, &status_plan_);
+    raw_reply_.reserve(kNumServos);
+    parsed_cache_.reserve(16);
+  }
+
+  /// Build a request which carries the command computed in the
+  /// previous cycle, if any, followed by the status query for this
+  /// cycle, one frame per servo.
+  const Request* PopulatePipelinedRequest(bool configuring) {
+    std::array<const Client::IdRequest*, QuadrupedContext::kMaxId>
+        command_by_slot = {};
+    if (command_pending_) {
+      for (const auto& command : client_command_) {
+        const int slot = context_->joint_slots.Find(command.id);
+        if (slot >= 0) { command_by_slot[slot] = &command; }
+      }
+      command_pending_ = false;
+    }
+
+    for (size_t i = 0; i < pipelined_request_.size(); i++) {
+      auto& dst = pipelined_request_[i];
+      dst.id = context_->joints[i].id;
+      if (command_by_slot[i]) {
+        // Assigning keeps the destination buffer's storage.
+        dst.request = command_by_slot[i]->request;
+      } else {
+        dst.request.clear();
+      }
+      AppendStatusQuery(&dst.request, configuring);
     }
+
+    return &pipelined_request_;
   }
 
   void HandleTimer(const mjlib::base::error_code& ec) {
@@ -272,7 +355,7 @@ class QuadrupedControl::Impl {
     if (!pi3hat_) { return; }
     if (outstanding_) { return; }
 
-    timing_ = ControlTiming(executor_, timing_.cycle_start());
+    timing_.StartCycle();
 
     if (timing_.status().delta_s > 1.5 * period_s_) {
       // We likely skipped a cycle.  Warn.
@@ -282,19 +365,33 @@ class QuadrupedControl::Impl {
 
     outstanding_ = true;
 
-    status_reply_ = {};
+    status_reply_.clear();
+    raw_reply_.clear();
 
     // Ask for the IMU and the servo data simultaneously.
     outstanding_status_requests_ = 0;
 
-    auto* request = [&]() {
-      if (status_.mode == QM::kConfiguring) {
+    const bool configuring = status_.mode == QM::kConfiguring;
+    const auto* request = [&]() {
+      if (parameters_.pipeline_commands) {
+        return PopulatePipelinedRequest(configuring);
+      }
+      if (configuring) {
         return &config_status_request_;
       }
       return &status_request_;
     }();
-    pi3hat_->Cycle(&imu_data_, request, &status_reply_,
-                   std::bind(&Impl::HandleStatus, this, pl::_1));
+
+    // Outside of configuration, the replies are always laid out as
+    // status_plan_ expects, so skip the generic parse when possible.
+    raw_cycle_ = !configuring && pi3hat_->supports_raw_replies();
+    if (raw_cycle_) {
+      pi3hat_->CycleRaw(&imu_data_, request, &raw_reply_,
+                        std::bind(&Impl::HandleStatus, this, pl::_1));
+    } else {
+      pi3hat_->Cycle(&imu_data_, request, &status_reply_,
+                     std::bind(&Impl::HandleStatus, this, pl::_1));
+    }
   }
 
   void HandleStatus(const mjlib::base::error_code& ec) {
@@ -310,6 +407,9 @@ class QuadrupedControl::Impl {
       for (const auto& item : status_reply_) {
         result |= (1 << item.id);
       }
+      for (const auto& item : raw_reply_) {
+        result |= (1 << item.id);
+      }
       return result;
     }();
     const int found_servos = [&]() {
@@ -324,7 +424,7 @@ class QuadrupedControl::Impl {
     status_.missing_replies = kNumServos - found_servos;
 
     if (found_servos != kNumServos) {
-      if (status_.state.joints.size() != kNumServos) {
+      if (!HaveAllJoints()) {
         // We have to get at least one full set before we can start
         // updating.
         outstanding_ = false;
@@ -332,6 +432,9 @@ class QuadrupedControl::Impl {
       }
     }
 
+    const auto start_allocations = base::GetAllocationCount();
+    const auto start_mode = status_.mode;
+
     // Fill in the status structure.
     if (!UpdateStatus()) {
       // Guess we didn't have enough to actually do anything.
@@ -343,12 +446,28 @@ class QuadrupedControl::Impl {
 
     // Now run our control loop and generate our command.
     std::swap(control_log_, old_control_log_);
-    *control_log_ = {};
+    ClearControlLog(control_log_);
     RunControl();
 
     timing_.finish_control();
 
-    if (!client_command_.empty()) {
+    if (parameters_.check_allocations) {
+      CheckAllocations(start_mode,
+                       base::GetAllocationCount() - start_allocations);
+    }
+
+    // Emit the control log outside of the control calculations, so
+    // that allocations made by telemetry consumers are not attributed
+    // to the control cycle.
+    if (!control_log_->timestamp.is_not_a_date_time()) {
+      control_signal_(control_log_);
+    }
+
+    if (parameters_.pipeline_commands) {
+      // The command will go out with the next status query.
+      command_pending_ = !client_command_.empty();
+      HandleCommand({});
+    } else if (!client_command_.empty()) {
       client_command_reply_.clear();
       pi3hat_->AsyncTransmit(
           &client_command_, &client_command_reply_,
@@ -367,13 +486,68 @@ class QuadrupedControl::Impl {
     status_.timing = timing_.status();
 
     status_signal_(&status_);
+    realtime_report_.Cycle();
+
+    if (last_timing_report_.is_not_a_date_time() ||
+        base::ConvertDurationToSeconds(
+            status_.timestamp - last_timing_report_) >=
+        parameters_.timing_report_period_s) {
+      last_timing_report_ = status_.timestamp;
+      timing_report_.timestamp = status_.timestamp;
+      timing_.FillReport(&timing_report_);
+      timing_signal_(&timing_report_);
+    }
+  }
+
+  void ClearControlLog(ControlLog* control_log) {
+    // Clear each member individually, rather than assigning a new
+    // object, so that every list keeps its capacity.
+    control_log->timestamp = {};
+    control_log->joints.clear();
+    control_log->leg_pds.clear();
+    control_log->legs_B.clear();
+    control_log->legs_R.clear();
+    control_log->desired_RB = {};
+  }
+
+  void CheckAllocations(QM start_mode, int64_t allocations) {
+    // Mode changes and the configuration phase are allowed to
+    // allocate, as they log and format diagnostic messages.
+    if (status_.mode != start_mode ||
+        status_.mode == QM::kConfiguring) {
+      return;
+    }
+    if (allocations != 0) {
+      mjlib::base::Fail(
+          fmt::format("{} allocations in control cycle in mode {}",
+                      allocations, status_.mode));
+    }
   }
 
   std::optional<double> MaybeGetSign(int id) const {
-    for (const auto& joint : config_.joints) {
-      if (joint.id == id) { return joint.sign; }
+    const int slot = context_->joint_slots.Find(id);
+    if (slot < 0) { return {}; }
+    return context_->joints[slot].sign;
+  }
+
+  bool HaveAllJoints() const {
+    // The shift is 64 bit so that all kMaxId joints may be used.
+    return received_joints_ ==
+        (uint64_t{1} << context_->joints.size()) - 1;
+  }
+
+  /// Return the joint which a reply from servo @p id should update,
+  /// or nullptr if it is not one of ours.
+  QuadrupedState::Joint* ReplyJoint(int id, double* sign) {
+    const int slot = context_->joint_slots.Find(id);
+    if (slot < 0) {
+      log_.warn(fmt::format("Reply from unknown servo {}", id));
+      return nullptr;
     }
-    return {};
+
+    received_joints_ |= (1u << slot);
+    *sign = context_->joints[slot].sign;
+    return &status_.state.joints[slot];
   }
 
   bool UpdateStatus() {
@@ -382,92 +556,39 @@ class QuadrupedControl::Impl {
       UpdateConfiguringStatus();
     }
 
-    auto find_or_make_joint = [&](int id) -> QuadrupedState::Joint& {
-      for (auto& joint : status_.state.joints) {
-        if (joint.id == id) { return joint; }
-      }
-      status_.state.joints.push_back({});
-      auto& result = status_.state.joints.back();
-      result.id = id;
-      return result;
-    };
-
-    for (const auto& reply : status_reply_) {
-      const auto maybe_sign = MaybeGetSign(reply.id);
-      if (!maybe_sign) {
-        log_.warn(fmt::format("Reply from unknown servo {}", reply.id));
-        return false;
+    if (raw_cycle_) {
+      for (const auto& raw : raw_reply_) {
+        double sign = 1.0;
+        auto* const out_joint = ReplyJoint(raw.id, &sign);
+        if (!out_joint) { return false; }
+
+        if (!status_plan_.Decode(raw.data.data(), raw.size,
+                                 sign, out_joint)) {
+          // Something unexpected, like a read error.  Take the slow
+          // path.
+          mjlib::base::BufferReadStream stream{
+            {reinterpret_cast<const char*>(raw.data.data()), raw.size}};
+          parsed_cache_.clear();
+          mjlib::multiplex::ParseRegisterReply(stream, &parsed_cache_);
+          for (const auto& pair : parsed_cache_) {
+            const auto* value = std::get_if<moteus::Value>(&pair.second);
+            if (!value) { continue; }
+            ServoReplyPlan::Apply(pair.first, *value, sign, out_joint);
+          }
+        }
       }
+    } else {
+      for (const auto& reply : status_reply_) {
+        double sign = 1.0;
+        auto* const out_joint = ReplyJoint(reply.id, &sign);
+        if (!out_joint) { return false; }
 
-      QuadrupedState::Joint& out_joint = find_or_make_joint(reply.id);
-
-      out_joint.id = reply.id;
-
-      const double sign = *maybe_sign;
-
-      const auto* maybe_value = std::get_if<moteus::Value>(&reply.value);
-      if (!maybe_value) { continue; }
-      const auto& value = *maybe_value;
-      switch (static_cast<moteus::Register>(reply.reg)) {
-        case moteus::kMode: {
-          out_joint.mode = moteus::ReadInt(value);
-          break;
-        }
-        case moteus::kPosition: {
-          out_joint.angle_deg = sign * moteus::ReadPosition(value);
-          break;
-        }
-        case moteus::kVelocity: {
-          out_joint.velocity_dps = sign * moteus::ReadVelocity(value);
-          break;
-        }
-        case moteus::kTorque: {
-          out_joint.torque_Nm = sign * moteus::ReadTorque(value);
-          break;
-        }
-        case moteus::kVoltage: {
-          out_joint.voltage = moteus::ReadVoltage(value);
-          break;
-        }
-        case moteus::kTemperature: {
-          out_joint.temperature_C = moteus::ReadTemperature(value);
-          break;
-        }
-        case moteus::kFault: {
-          out_joint.fault = moteus::ReadInt(value);
-          break;
-        }
-        case moteus::kPositionKp: {
-          out_joint.kp_Nm = sign * moteus::ReadTorque(value);
-          break;
-        }
-        case moteus::kPositionKi: {
-          out_joint.ki_Nm = sign * moteus::ReadTorque(value);
-          break;
-        }
-        case moteus::kPositionKd: {
-          out_joint.kd_Nm = sign * moteus::ReadTorque(value);
-          break;
-        }
-        case moteus::kPositionFeedforward: {
-          out_joint.feedforward_Nm = sign * moteus::ReadTorque(value);
-          break;
-        }
-        case moteus::kPositionCommand: {
-          out_joint.command_Nm = sign * moteus::ReadTorque(value);
-          break;
-        }
-        default: {
-          break;
-        }
+        const auto* maybe_value = std::get_if<moteus::Value>(&reply.value);
+        if (!maybe_value) { continue; }
+        ServoReplyPlan::Apply(reply.reg, *maybe_value, sign, out_joint);
       }
     }
 
-    std::sort(status_.state.joints.begin(), status_.state.joints.end(),
-              [](const auto& lhs, const auto& rhs) {
-                return lhs.id < rhs.id;
-              });
-
     if (status_.mode != QM::kFault) {
       std::string fault;
 
@@ -485,88 +606,72 @@ class QuadrupedControl::Impl {
     }
 
     // We should only be here if we have something for all our joints.
-    if (status_.state.joints.size() != kNumServos) {
+    if (!HaveAllJoints()) {
       return false;
     }
 
-    IkSolver::JointAngles joint_angles;
-    for (const auto& joint : status_.state.joints) {
-      IkSolver::Joint ik_joint;
-
-      ik_joint.id = joint.id;
-      ik_joint.angle_deg = joint.angle_deg;
-      ik_joint.velocity_dps = joint.velocity_dps;
-      ik_joint.torque_Nm = joint.torque_Nm;
-
-      joint_angles.push_back(ik_joint);
+    // Evaluate the forward kinematics of all legs at once.
+    {
+      auto& joints = ik_joints_;
+      for (size_t slot = 0; slot < context_->legs.size(); slot++) {
+        const auto& ik = context_->legs[slot].config.ik;
+        joints.shoulder.Set(slot, context_->GetJointState(ik.shoulder.id));
+        joints.femur.Set(slot, context_->GetJointState(ik.femur.id));
+        joints.tibia.Set(slot, context_->GetJointState(ik.tibia.id));
+      }
+      context_->ik_batch.Forward_G(joints, &ik_effectors_G_);
     }
 
-    status_.state.legs_B.clear();
+    // The control log lists legs in slot order, but may omit some, so
+    // walk it in step with our own legs.
+    const auto& old_legs_B = old_control_log_->legs_B;
+    size_t old_leg_index = 0;
 
-    auto find_or_make_leg = [&](int id) -> QuadrupedState::Leg& {
-      for (auto& leg : status_.state.legs_B) {
-        if (leg.leg == id) { return leg; }
-      }
-
-      status_.state.legs_B.push_back({});
-      auto& result = status_.state.legs_B.back();
-      result.leg = id;
-      return result;
-    };
-
-    for (const auto& leg : context_->legs) {
-      QuadrupedState::Leg& out_leg_B = find_or_make_leg(leg.leg);
-      const auto effector_G = leg.ik.Forward_G(joint_angles);
+    for (size_t slot = 0; slot < context_->legs.size(); slot++) {
+      const auto& leg = context_->legs[slot];
+      QuadrupedState::Leg& out_leg_B = status_.state.legs_B[slot];
+      const auto effector_G = ik_effectors_G_.Get(slot);
       const auto effector_B = leg.pose_BG * effector_G;
 
-      out_leg_B.leg = leg.leg;
       out_leg_B.position = effector_B.pose;
       out_leg_B.velocity = effector_B.velocity;
       out_leg_B.force_N = effector_B.force_N;
 
-      const auto* control_B = [&]() -> const QC::Leg* {
-        for (const auto& item_B : old_control_log_->legs_B) {
-          if (item_B.leg_id == leg.leg) { return &item_B; }
-        }
-        return nullptr;
-      }();
-
-      if (control_B) {
-        out_leg_B.stance = control_B->stance;
+      if (old_leg_index < old_legs_B.size() &&
+          old_legs_B[old_leg_index].leg_id == leg.leg) {
+        out_leg_B.stance = old_legs_B[old_leg_index].stance;
+        old_leg_index++;
+      } else {
+        out_leg_B.stance = 0.0;
       }
     }
 
-    std::sort(status_.state.legs_B.begin(), status_.state.legs_B.end(),
-              [](const auto& lhs, const auto& rhs) {
-                return lhs.leg < rhs.leg;
-              });
-
     // Now update the robot values.
 
     // frame_RB isn't sensed, but is just a commanded value.
 
     // Do the A frame (Attitude)
+    //
+    // Both this and the M frame are a pure rotation applied after the
+    // pure translation CB, so are composed directly rather than
+    // through Sophus.  The IMU quaternion is the only input here not
+    // unit length by construction.
     auto& frame_AB = status_.state.robot.frame_AB;
-    Sophus::SE3d CB{
-      Sophus::SO3d(),
-          -config_.center_of_mass_B};
-    Sophus::SE3d AC{
-      Sophus::SO3d(imu_data_.attitude.eigen()),
-          Eigen::Vector3d(),
-    };
+    const Eigen::Vector3d p_CB = -config_.center_of_mass_B;
+    const Eigen::Quaterniond q_AC = imu_data_.attitude.eigen().normalized();
 
-    frame_AB.pose = AC * CB;
+    base::SetUnitQuaternion(&frame_AB.pose.so3(), q_AC);
+    frame_AB.pose.translation() = q_AC * p_CB;
     frame_AB.w = (M_PI / 180.0) * imu_data_.rate_dps;
 
     // Now the M frame (CoM)
     auto& frame_MB = status_.state.robot.frame_MB;
     auto axis_MC = imu_data_.attitude.euler_rad();
     axis_MC.yaw = 0.0;
-    Sophus::SE3d MC{
-      Sophus::SO3d(base::Quaternion::FromEuler(axis_MC).eigen()),
-          Eigen::Vector3d(),
-    };
-    frame_MB.pose = MC * CB;
+    const Eigen::Quaterniond q_MC =
+        base::Quaternion::FromEuler(axis_MC).eigen();
+    base::SetUnitQuaternion(&frame_MB.pose.so3(), q_MC);
+    frame_MB.pose.translation() = q_MC * p_CB;
 
     // Do terrain.
     UpdateTerrain();
@@ -595,10 +700,11 @@ class QuadrupedControl::Impl {
   }
 
   void UpdateTerrain() {
-    const auto& tf_AB = status_.state.robot.frame_AB.pose;
-    auto& tf_TA = status_.state.robot.tf_TA;
+    const base::RigidTransformd tf_AB{status_.state.robot.frame_AB.pose};
+    const base::RigidTransformd tf_TA{status_.state.robot.tf_TA};
+    const auto tf_AT = tf_TA.inverse();
 
-    std::vector<base::Point3D> stance_A;
+    base::StaticVector<base::Point3D, QC::kNumLegs> stance_A;
     for (const auto& leg_B : status_.state.legs_B) {
       Eigen::Vector3d p_A = tf_AB * leg_B.position;
       // If we are not in full stance, or if we are not pressing
@@ -609,7 +715,7 @@ class QuadrupedControl::Impl {
         // Use the Z value from the current terrain.
         Eigen::Vector3d p_T = tf_TA * p_A;
         p_T.z() = 0;
-        stance_A.push_back(tf_TA.inverse() * p_T);
+        stance_A.push_back(tf_AT * p_T);
       } else {
         stance_A.push_back(p_A);
       }
@@ -621,15 +727,9 @@ class QuadrupedControl::Impl {
 
     auto& robot = status_.state.robot;
 
-    // Now update the attitude recursively.
-    std::vector<base::Point3D> stance_T;
-    for (const auto& leg_A : stance_A) {
-      stance_T.push_back(tf_TA * leg_A);
-    }
-
     // Fit a plane to these four points to see how to update our
     // terrain transform.
-    const auto plane = base::FitPlane(stance_A);
+    const auto plane = base::FitPlane(stance_A.data(), stance_A.size());
 
     // We just always exactly set our translation.
     robot.tf_TA.translation().z() = -plane.c;
@@ -642,7 +742,8 @@ class QuadrupedControl::Impl {
     robot.terrain_rad[1] = (
         alpha * robot.terrain_rad[1] + (1.0 - alpha) * std::atan(plane.b));
 
-    robot.tf_TA.so3() = Sophus::SO3d(
+    base::SetUnitQuaternion(
+        &robot.tf_TA.so3(),
         (base::Quaternion::FromAxisAngle(
             robot.terrain_rad[0], 0, 1, 0) *
          base::Quaternion::FromAxisAngle(
@@ -976,7 +1077,7 @@ class QuadrupedControl::Impl {
   }
 
   void EmitStop() {
-    std::vector<QC::Joint> out_joints;
+    QC::Joints out_joints;
     for (const auto& joint : config_.joints) {
       QC::Joint out_joint;
       out_joint.id = joint.id;
@@ -984,7 +1085,7 @@ class QuadrupedControl::Impl {
       out_joints.push_back(out_joint);
     }
 
-    ControlJoints(std::move(out_joints));
+    ControlJoints(out_joints);
   }
 
   void Fault(std::string_view message) {
@@ -1002,7 +1103,7 @@ class QuadrupedControl::Impl {
   }
 
   void DoControl_ZeroVelocity() {
-    std::vector<QC::Joint> out_joints;
+    QC::Joints out_joints;
     for (const auto& joint : config_.joints) {
       QC::Joint out_joint;
       out_joint.id = joint.id;
@@ -1011,7 +1112,7 @@ class QuadrupedControl::Impl {
       out_joints.push_back(out_joint);
     }
 
-    ControlJoints(std::move(out_joints));
+    ControlJoints(out_joints);
   }
 
   void DoControl_Joint() {
@@ -1072,19 +1173,10 @@ class QuadrupedControl::Impl {
 
   bool CheckPrepositioning() const {
     // We're done when all our joints are close enough.
-    const std::map<int, double> current_deg = [&]() {
-      std::map<int, double> result;
-      for (const auto& joint : status_.state.joints) {
-        result[joint.id] = joint.angle_deg;
-      }
-      return result;
-    }();
-
     for (const auto& leg : context_->legs) {
       auto check = [&](int id, int expected_deg) {
-        const auto it = current_deg.find(id);
-        BOOST_ASSERT(it != current_deg.end());
-        if (std::abs(it->second - expected_deg) > config_.stand_up.tolerance_deg) {
+        const double current_deg = context_->GetJointState(id).angle_deg;
+        if (std::abs(current_deg - expected_deg) > config_.stand_up.tolerance_deg) {
           return false;
         }
         return true;
@@ -1107,7 +1199,7 @@ class QuadrupedControl::Impl {
   }
 
   void DoControl_StandUp_Prepositioning() {
-    std::vector<QC::Joint> joints;
+    QC::Joints joints;
     for (const auto& leg : context_->legs) {
       QC::Joint joint;
       joint.power = true;
@@ -1181,7 +1273,8 @@ class QuadrupedControl::Impl {
   }
 
   void DoControl_StandUp_Standing() {
-    std::vector<QC::Leg> legs_R = old_control_log_->legs_R;
+    QC::Legs legs_R(old_control_log_->legs_R.begin(),
+                    old_control_log_->legs_R.end());
 
     if (legs_R.empty()) {
       for (const auto& leg : context_->legs) {
@@ -1203,7 +1296,7 @@ class QuadrupedControl::Impl {
 
     const bool done = context_->MoveLegsFixedSpeed(
         &legs_R, config_.stand_up.velocity, [&]() {
-          std::vector<std::pair<int, base::Point3D>> result;
+          QC::LegPoses result;
           for (const auto& leg : context_->legs) {
             base::Point3D pose = leg.stand_up_R;
             pose.z() = config_.stand_height;
@@ -1217,7 +1310,7 @@ class QuadrupedControl::Impl {
       status_.state.stand_up.mode = QuadrupedState::StandUp::Mode::kDone;
     }
 
-    ControlLegs_R(std::move(legs_R), context_->LevelDesiredRB());
+    ControlLegs_R(legs_R, context_->LevelDesiredRB());
   }
 
   bool IsRestAndSteadyState() const {
@@ -1234,11 +1327,10 @@ class QuadrupedControl::Impl {
   void DoControl_Rest() {
     ClearDesiredMotion();
 
-    std::vector<QC::Leg> legs_R;
-
     MJ_ASSERT(!old_control_log_->legs_R.empty());
 
-    legs_R = old_control_log_->legs_R;
+    QC::Legs legs_R(old_control_log_->legs_R.begin(),
+                    old_control_log_->legs_R.end());
 
     // Ensure all gains are back to their default and that
     // everything is marked as in stance.
@@ -1269,11 +1361,11 @@ class QuadrupedControl::Impl {
     desired_RB.pose.translation() +=
         current_command_.rest.offset_RB.translation();
 
-    ControlLegs_R(std::move(legs_R), desired_RB);
+    ControlLegs_R(legs_R, desired_RB);
   }
 
-  std::vector<std::pair<int, base::Point3D>> MakeIdleLegs() const {
-    std::vector<std::pair<int, base::Point3D>> result;
+  QC::LegPoses MakeIdleLegs() const {
+    QC::LegPoses result;
     for (const auto& leg : context_->legs) {
       result.push_back(std::make_pair(leg.leg, leg.idle_R));
     }
@@ -1313,7 +1405,8 @@ class QuadrupedControl::Impl {
     while (true) {
       // We should only loop here if our jumping state is different
       // from what it was the previous time.
-      auto legs_R = old_control_log_->legs_R;
+      QC::Legs legs_R(old_control_log_->legs_R.begin(),
+                      old_control_log_->legs_R.end());
 
       if (!!previous_jump_mode) {
         MJ_ASSERT(status_.state.jump.mode != *previous_jump_mode);
@@ -1385,7 +1478,7 @@ class QuadrupedControl::Impl {
                   status_.state.robot.frame_RB.pose * cur_leg_B.velocity;
             }
             // Loop around and do the retracting behavior.
-            old_control_log_->legs_R = legs_R;
+            old_control_log_->legs_R.assign(legs_R.begin(), legs_R.end());
             continue;
           }
           break;
@@ -1411,7 +1504,7 @@ class QuadrupedControl::Impl {
               leg_R.landing = true;
             }
             // Loop around and do the falling behavior.
-            old_control_log_->legs_R = legs_R;
+            old_control_log_->legs_R.assign(legs_R.begin(), legs_R.end());
             continue;
           }
           break;
@@ -1508,12 +1601,12 @@ class QuadrupedControl::Impl {
 
       // If we make it here, then we haven't skipped back to redo our
       // loop.  Thus we can actually emit our control.
-      ControlLegs_R(std::move(legs_R), context_->LevelDesiredRB());
+      ControlLegs_R(legs_R, context_->LevelDesiredRB());
       return;
     }
   }
 
-  bool SetLandingParameters(std::vector<QC::Leg>* legs_R) {
+  bool SetLandingParameters(QC::Legs* legs_R) {
     auto get_vel = [](const auto& leg_B) { return leg_B.velocity.z(); };
     auto& js = status_.state.jump;
 
@@ -1594,8 +1687,8 @@ class QuadrupedControl::Impl {
   }
 
   void DoControl_Walk() {
-    auto result = QuadrupedTrot(&*context_, old_control_log_->legs_R);
-    ControlLegs_R(std::move(result.legs_R), result.desired_RB);
+    const auto result = QuadrupedTrot(&*context_, old_control_log_->legs_R);
+    ControlLegs_R(result.legs_R, result.desired_RB);
   }
 
   void DoControl_Backflip() {
@@ -1606,7 +1699,8 @@ class QuadrupedControl::Impl {
     const double dt_s = period_s_;
 
     while (true) {
-      auto legs_R = old_control_log_->legs_R;
+      QC::Legs legs_R(old_control_log_->legs_R.begin(),
+                      old_control_log_->legs_R.end());
 
       // We loop around until we stop changing state.
       if (!!previous_mode) {
@@ -1740,12 +1834,12 @@ class QuadrupedControl::Impl {
       }
 
       // If we make it here, then we don't need to repeat.
-      ControlLegs_R(std::move(legs_R), context_->LevelDesiredRB());
+      ControlLegs_R(legs_R, context_->LevelDesiredRB());
       return;
     }
   }
 
-  void BackflipUpdateLegs(std::vector<QC::Leg>* legs_R,
+  void BackflipUpdateLegs(QC::Legs* legs_R,
                           double acceleration) {
     auto& bs = status_.state.backflip;
 
@@ -1835,15 +1929,11 @@ class QuadrupedControl::Impl {
     context_->UpdateCommandedR();
   }
 
-  void ControlLegs_R(std::vector<QC::Leg> legs_R,
+  void ControlLegs_R(const QC::Legs& legs_R,
                      const base::KinematicRelation& desired_RB) {
     control_log_->desired_RB = desired_RB;
-    control_log_->legs_R = std::move(legs_R);
-    std::sort(control_log_->legs_R.begin(),
-              control_log_->legs_R.end(),
-              [](const auto& lhs, const auto& rhs) {
-                return lhs.leg_id < rhs.leg_id;
-              });
+    AssignBySlot(legs_R, &control_log_->legs_R, context_->leg_slots,
+                 [](const auto& leg) { return leg.leg_id; });
 
     // Apply our desired RB frame with an exponential smoothing
     // filter.
@@ -1854,32 +1944,30 @@ class QuadrupedControl::Impl {
           desired_RB.pose.translation() - frame_RB.pose.translation();
       frame_RB.pose.translation() +=
           config_.rb_filter_constant_Hz * config_.period_s * delta;
-      frame_RB.pose.so3() =
-          Sophus::SO3d(
-              frame_RB.pose.so3().unit_quaternion().slerp(
-                  config_.rb_filter_constant_Hz * config_.period_s,
-                  desired_RB.pose.so3().unit_quaternion()));
+      base::SetUnitQuaternion(
+          &frame_RB.pose.so3(),
+          base::Slerp(frame_RB.pose.so3().unit_quaternion(),
+                      desired_RB.pose.so3().unit_quaternion(),
+                      config_.rb_filter_constant_Hz * config_.period_s));
       frame_RB.v = desired_RB.v;
       frame_RB.w = desired_RB.w;
     }
 
-    const Sophus::SE3d pose_BR = status_.state.robot.frame_RB.pose.inverse();
+    const base::RigidTransformd pose_BR =
+        base::RigidTransformd(status_.state.robot.frame_RB.pose).inverse();
 
-    std::vector<QC::Leg> legs_B;
+    QC::Legs legs_B;
     for (const auto& leg_R : control_log_->legs_R) {
       legs_B.push_back(pose_BR * leg_R);
     }
 
-    ControlLegs_B(std::move(legs_B));
+    ControlLegs_B(legs_B);
   }
 
-  void ControlLegs_B(std::vector<QC::Leg> legs_B) {
-    control_log_->legs_B = std::move(legs_B);
-    std::sort(control_log_->legs_B.begin(),
-              control_log_->legs_B.end(),
-              [](const auto& lhs, const auto& rhs) {
-                return lhs.leg_id < rhs.leg_id;
-              });
+  template <typename LegList>
+  void ControlLegs_B(const LegList& legs_B) {
+    AssignBySlot(legs_B, &control_log_->legs_B, context_->leg_slots,
+                 [](const auto& leg) { return leg.leg_id; });
 
     // Apply Z bounds.
     for (auto& leg_B : control_log_->legs_B) {
@@ -1888,21 +1976,6 @@ class QuadrupedControl::Impl {
           std::min(config_.bounds.max_z_B, leg_B.position.z()));
     }
 
-    std::vector<QC::Joint> out_joints;
-
-    const std::vector<IkSolver::Joint> current_joints = [&]() {
-      std::vector<IkSolver::Joint> result;
-      for (const auto& joint : status_.state.joints) {
-        IkSolver::Joint ik_joint;
-        ik_joint.id = joint.id;
-        ik_joint.angle_deg = joint.angle_deg;
-        ik_joint.velocity_dps = joint.velocity_dps;
-        ik_joint.torque_Nm = joint.torque_Nm;
-        result.push_back(ik_joint);
-      }
-      return result;
-    }();
-
     if (control_log_->leg_pds.size() < control_log_->legs_B.size()) {
       control_log_->leg_pds.resize(control_log_->legs_B.size());
     }
@@ -1918,11 +1991,71 @@ class QuadrupedControl::Impl {
     const base::Point3D g_M = base::Point3D(0., 0., 1.);
     const base::Point3D g_B = status_.state.robot.frame_MB.pose.inverse() * g_M;
 
+    // First find the effector for every leg under cartesian control,
+    // so that they can all be solved in a single batch.  Lanes are
+    // leg slots.
+    uint32_t solve_mask = 0;
     for (const auto& leg_B : control_log_->legs_B) {
-      const auto& qleg = GetLeg(leg_B.leg_id);
+      if (!leg_B.power || leg_B.zero_velocity) { continue; }
+
+      const int slot = context_->leg_slots[leg_B.leg_id];
+      const auto& qleg = context_->legs[slot];
       const auto& leg_state_B = GetLegState_B(leg_B.leg_id);
       auto& leg_pd = control_log_->leg_pds[leg_B.leg_id];
 
+      const Sophus::SE3d pose_GB = qleg.pose_BG.inverse();
+
+      IkSolver::Effector effector_B;
+
+      effector_B.pose = leg_B.position;
+      effector_B.velocity = leg_B.velocity;
+
+      const double stance_fraction = leg_B.stance / total_stance;
+
+      // Do the cartesian PD control.
+      leg_pd.cmd_N = leg_B.force_N;
+      leg_pd.gravity_N =
+          stance_fraction * base::kGravity * config_.mass_kg * g_B;
+
+      leg_pd.accel_N =
+          (leg_B.acceleration) *
+          base::Interpolate(
+              config_.leg_mass_kg,
+              stance_fraction * config_.mass_kg,
+              leg_B.stance);
+      leg_pd.err_m = leg_state_B.position - leg_B.position;
+      leg_pd.p_N = -1 * (leg_pd.err_m.array() *
+                         leg_B.kp_N_m.array()).matrix();
+      leg_pd.err_m_s = leg_state_B.velocity - leg_B.velocity;
+      leg_pd.d_N = -1 * (leg_pd.err_m_s.array() *
+                         leg_B.kd_N_m_s.array()).matrix();
+      leg_pd.total_N =
+          leg_pd.cmd_N + leg_pd.gravity_N +
+          leg_pd.accel_N + leg_pd.p_N + leg_pd.d_N;
+
+      effector_B.force_N = leg_pd.total_N;
+
+      ik_effectors_G_.Set(slot, pose_GB * effector_B);
+
+      const auto& ik = qleg.config.ik;
+      ik_joints_.shoulder.Set(slot, context_->GetJointState(ik.shoulder.id));
+      ik_joints_.femur.Set(slot, context_->GetJointState(ik.femur.id));
+      ik_joints_.tibia.Set(slot, context_->GetJointState(ik.tibia.id));
+
+      solve_mask |= (1u << slot);
+    }
+
+    const uint32_t solved_mask =
+        solve_mask == 0 ? 0 :
+        context_->ik_batch.Inverse(
+            ik_effectors_G_, &ik_joints_, &ik_result_) & solve_mask;
+
+    QC::Joints out_joints;
+
+    for (const auto& leg_B : control_log_->legs_B) {
+      const int slot = context_->leg_slots[leg_B.leg_id];
+      const auto& qleg = context_->legs[slot];
+
       auto add_joints = [&](auto base) {
         base.id = qleg.config.ik.shoulder.id;
         out_joints.push_back(base);
@@ -1940,101 +2073,79 @@ class QuadrupedControl::Impl {
         out_joint.power = true;
         out_joint.zero_velocity = true;
         add_joints(out_joint);
+      } else if ((solved_mask & (1u << slot)) == 0) {
+        // Hmmm, for now, we'll just command all zero velocity, but
+        // in the future we should probably just stick to the
+        // command we had the last cycle?
+        QC::Joint out_joint;
+        out_joint.power = true;
+        out_joint.zero_velocity = true;
+        add_joints(out_joint);
       } else {
-        const Sophus::SE3d pose_GB = qleg.pose_BG.inverse();
-
-        IkSolver::Effector effector_B;
-
-        effector_B.pose = leg_B.position;
-        effector_B.velocity = leg_B.velocity;
-
-        const double stance_fraction = leg_B.stance / total_stance;
-
-        // Do the cartesian PD control.
-        leg_pd.cmd_N = leg_B.force_N;
-        leg_pd.gravity_N =
-            stance_fraction * base::kGravity * config_.mass_kg * g_B;
-
-        leg_pd.accel_N =
-            (leg_B.acceleration) *
-            base::Interpolate(
-                config_.leg_mass_kg,
-                stance_fraction * config_.mass_kg,
-                leg_B.stance);
-        leg_pd.err_m = leg_state_B.position - leg_B.position;
-        leg_pd.p_N = -1 * (leg_pd.err_m.array() *
-                           leg_B.kp_N_m.array()).matrix();
-        leg_pd.err_m_s = leg_state_B.velocity - leg_B.velocity;
-        leg_pd.d_N = -1 * (leg_pd.err_m_s.array() *
-                           leg_B.kd_N_m_s.array()).matrix();
-        leg_pd.total_N =
-            leg_pd.cmd_N + leg_pd.gravity_N +
-            leg_pd.accel_N + leg_pd.p_N + leg_pd.d_N;
-
-        effector_B.force_N = leg_pd.total_N;
-
-        const auto effector_G = pose_GB * effector_B;
-
-        const auto result = qleg.ik.Inverse(effector_G, current_joints);
-
-        if (!result) {
-          // Hmmm, for now, we'll just command all zero velocity, but
-          // in the future we should probably just stick to the
-          // command we had the last cycle?
+        auto add_joint = [&](const MammalIkBatch::Joint& joint, int id,
+                             auto get_pd_scale) {
           QC::Joint out_joint;
+          out_joint.id = id;
           out_joint.power = true;
-          out_joint.zero_velocity = true;
-          add_joints(out_joint);
-        } else {
-          for (const auto& joint_angle : *result) {
-            QC::Joint out_joint;
-            out_joint.id = joint_angle.id;
-            out_joint.power = true;
-            out_joint.angle_deg = joint_angle.angle_deg;
-            out_joint.torque_Nm = joint_angle.torque_Nm;
-            out_joint.velocity_dps = joint_angle.velocity_dps;
-
-            auto get_pd_scale = [&](const auto& value) {
-              if (joint_angle.id == qleg.config.ik.shoulder.id) {
-                return value.x();
-              }
-              if (joint_angle.id == qleg.config.ik.femur.id) {
-                return value.y();
-              }
-              if (joint_angle.id == qleg.config.ik.tibia.id) {
-                return value.z();
-              }
-              return value.x();
-            };
-            out_joint.kp_scale =
-                leg_B.kp_scale ? get_pd_scale(*leg_B.kp_scale) :
-                std::optional<double>();
-            out_joint.kd_scale =
-                leg_B.kd_scale ? get_pd_scale(*leg_B.kd_scale) :
-                std::optional<double>();
-            out_joints.push_back(out_joint);
-          }
-        }
+          out_joint.angle_deg = joint.angle_deg(slot);
+          out_joint.torque_Nm = joint.torque_Nm(slot);
+          out_joint.velocity_dps = joint.velocity_dps(slot);
+          out_joint.kp_scale =
+              leg_B.kp_scale ? get_pd_scale(*leg_B.kp_scale) :
+              std::optional<double>();
+          out_joint.kd_scale =
+              leg_B.kd_scale ? get_pd_scale(*leg_B.kd_scale) :
+              std::optional<double>();
+          out_joints.push_back(out_joint);
+        };
+        const auto& ik = qleg.config.ik;
+        add_joint(ik_result_.shoulder, ik.shoulder.id,
+                  [](const auto& value) { return value.x(); });
+        add_joint(ik_result_.femur, ik.femur.id,
+                  [](const auto& value) { return value.y(); });
+        add_joint(ik_result_.tibia, ik.tibia.id,
+                  [](const auto& value) { return value.z(); });
       }
     }
 
-    ControlJoints(std::move(out_joints));
+    ControlJoints(out_joints);
   }
 
-  void ControlJoints(std::vector<QC::Joint> joints) {
-    control_log_->joints = std::move(joints);
-    std::sort(control_log_->joints.begin(),
-              control_log_->joints.end(),
-              [](const auto& lhs, const auto& rhs) {
-                return lhs.id < rhs.id;
-              });
+  template <typename JointList>
+  void ControlJoints(const JointList& joints) {
+    AssignBySlot(joints, &control_log_->joints, context_->joint_slots,
+                 [](const auto& joint) { return joint.id; });
 
     EmitControl();
   }
 
+  /// Copy @p input into @p output in slot order.  This replaces a
+  /// sort with a single scatter through the context's id maps.  Any
+  /// items with an unknown or duplicate id are appended at the end in
+  /// their original order.
+  template <typename Input, typename Output, typename SlotMap,
+            typename GetId>
+  static void AssignBySlot(const Input& input, Output* output,
+                           const SlotMap& slots, GetId get_id) {
+    std::array<const typename Output::value_type*,
+               SlotMap::kMaxId> by_slot = {};
+    for (const auto& item : input) {
+      const int slot = slots.Find(get_id(item));
+      if (slot >= 0 && by_slot[slot] == nullptr) { by_slot[slot] = &item; }
+    }
+
+    output->clear();
+    for (const auto* item : by_slot) {
+      if (item) { output->push_back(*item); }
+    }
+    for (const auto& item : input) {
+      const int slot = slots.Find(get_id(item));
+      if (slot < 0 || by_slot[slot] != &item) { output->push_back(item); }
+    }
+  }
+
   void EmitControl() {
     control_log_->timestamp = Now();
-    control_signal_(control_log_);
 
     size_t pos = 0;
     for (const auto& joint : control_log_->joints) {
@@ -2042,8 +2153,12 @@ class QuadrupedControl::Impl {
         client_command_.resize(client_command_.size() + 1);
       }
 
+      if (command_frames_.size() < client_command_.size()) {
+        command_frames_.resize(client_command_.size());
+      }
+
+      auto& frame = command_frames_[pos];
       auto& request = client_command_[pos++];
-      request.request.clear();
       request.id = joint.id;
 
       constexpr double kInf = std::numeric_limits<double>::infinity();
@@ -2064,73 +2179,74 @@ class QuadrupedControl::Impl {
         }
       }();
 
-      request.request.WriteSingle(moteus::kMode, static_cast<int8_t>(mode));
-
-      auto& values = values_cache_;
-      values.resize(0);
+      ServoCommandFrame::Layout layout;
+      layout.mode = mode;
+      auto& values = command_values_;
 
       if (mode == moteus::Mode::kPosition) {
         const auto maybe_sign = MaybeGetSign(joint.id);
         if (!maybe_sign) {
           log_.warn(fmt::format("Unknown servo {}", joint.id));
+          frame.Emit(layout, values, &request.request);
           continue;
         }
         const double sign = *maybe_sign;
 
-        if (joint.angle_deg != 0.0) { values.resize(1); }
-        if (joint.velocity_dps != 0.0) { values.resize(2); }
-        if (joint.torque_Nm != 0.0) { values.resize(3); }
-        if (max_torque_Nm) { values.resize(6); }
-        if (joint.stop_angle_deg) { values.resize(7); }
+        auto& n = layout.num_position;
+        if (joint.angle_deg != 0.0) { n = 1; }
+        if (joint.velocity_dps != 0.0) { n = 2; }
+        if (joint.torque_Nm != 0.0) { n = 3; }
+        if (max_torque_Nm) { n = 6; }
+        if (joint.stop_angle_deg) { n = 7; }
+
+        auto int16 = [](moteus::Value value) {
+          return std::get<int16_t>(value);
+        };
 
-        for (size_t i = 0; i < values.size(); i++) {
+        for (int i = 0; i < n; i++) {
           switch (i) {
             case 0: {
-              values[i] = moteus::WritePosition(
-                  sign * joint.angle_deg, moteus::kInt16);
+              values.position[i] = int16(moteus::WritePosition(
+                  sign * joint.angle_deg, moteus::kInt16));
               break;
             }
             case 1: {
-              values[i] = moteus::WriteVelocity(
-                  sign * joint.velocity_dps, moteus::kInt16);
+              values.position[i] = int16(moteus::WriteVelocity(
+                  sign * joint.velocity_dps, moteus::kInt16));
               break;
             }
             case 2: {
-              values[i] = moteus::WriteTorque(
-                  sign * joint.torque_Nm, moteus::kInt16);
+              values.position[i] = int16(moteus::WriteTorque(
+                  sign * joint.torque_Nm, moteus::kInt16));
               break;
             }
             case 3:
             case 4: {
-              values[i] = moteus::WritePwm(1.0, moteus::kInt16);
+              values.position[i] = int16(
+                  moteus::WritePwm(1.0, moteus::kInt16));
               break;
             }
             case 5: {
-              values[i] = moteus::WriteTorque(
+              values.position[i] = int16(moteus::WriteTorque(
                   max_torque_Nm.value_or(kInf),
-                  moteus::kInt16);
+                  moteus::kInt16));
               break;
             }
             case 6: {
-              values[i] = moteus::WritePosition(
+              values.position[i] = int16(moteus::WritePosition(
                   sign * joint.stop_angle_deg.value_or(
                       std::numeric_limits<double>::quiet_NaN()),
-                  moteus::kInt16);
+                  moteus::kInt16));
               break;
             }
 
           }
         }
 
-        if (!values.empty()) {
-          request.request.WriteMultiple(moteus::kCommandPosition, values);
-        }
-
         // We do kp and kd separately so we can use the float type.
-        values.clear();
-        if (joint.kp_scale) { values.resize(1); }
-        if (joint.kd_scale) { values.resize(2); }
-        for (size_t i = 0; i < values.size(); i++) {
+        if (joint.kp_scale) { layout.num_scale = 1; }
+        if (joint.kd_scale) { layout.num_scale = 2; }
+        for (int i = 0; i < layout.num_scale; i++) {
           switch (i) {
             case 0: {
               double kp = joint.kp_scale.value_or(1.0);
@@ -2138,7 +2254,7 @@ class QuadrupedControl::Impl {
                 kp = 0.0;
                 log_.warn("negative joint kp!");
               }
-              values[i] = moteus::WritePwm(kp, moteus::kFloat);
+              values.scale[i] = static_cast<float>(kp);
               break;
             }
             case 1: {
@@ -2147,16 +2263,14 @@ class QuadrupedControl::Impl {
                 kd = 0.0;
                 log_.warn("negative joint kd!");
               }
-              values[i] = moteus::WritePwm(kd, moteus::kFloat);
+              values.scale[i] = static_cast<float>(kd);
               break;
             }
           }
         }
-
-        if (!values.empty()) {
-          request.request.WriteMultiple(moteus::kCommandKpScale, values);
-        }
       }
+
+      frame.Emit(layout, values, &request.request);
     }
     if (client_command_.size() > pos) {
       client_command_.resize(pos);
@@ -2169,6 +2283,7 @@ class QuadrupedControl::Impl {
     status_.performed_rezero = true;
 
     client_command_.resize(config_.joints.size());
+    for (auto& frame : command_frames_) { frame.Invalidate(); }
     size_t pos = 0;
     for (const auto& joint : config_.joints) {
       auto& request = client_command_[pos++];
@@ -2212,7 +2327,7 @@ class QuadrupedControl::Impl {
   }
 
   boost::asio::any_io_executor executor_;
-  mjlib::telemetry::FileWriter* const telemetry_log_;
+  base::TelemetryLogRegistrar* const telemetry_log_;
   Parameters parameters_;
 
   base::LogRef log_ = base::GetLogInstance("QuadrupedControl");
@@ -2245,8 +2360,21 @@ class QuadrupedControl::Impl {
   Request client_command_;
   Client::Reply client_command_reply_;
 
+  // Used instead of status_reply_ when raw_cycle_ is set.
+  bool raw_cycle_ = false;
+  Pi3hatInterface::RawReplies raw_reply_;
+  ServoReplyPlan status_plan_;
+  std::vector<mjlib::multiplex::RegisterValue> parsed_cache_;
+
+  // Only used when pipeline_commands is set.
+  Request pipelined_request_;
+  bool command_pending_ = false;
+
   bool outstanding_ = false;
-  ControlTiming timing_{executor_, {}};
+  ControlTiming timing_{executor_};
+  ControlTiming::Report timing_report_;
+  boost::posix_time::ptime last_timing_report_;
+  base::RealtimeStartupReport realtime_report_{"quadruped_control"};
 
   int outstanding_status_requests_ = 0;
   AttitudeData imu_data_;
@@ -2254,11 +2382,22 @@ class QuadrupedControl::Impl {
   boost::signals2::signal<void (const Status*)> status_signal_;
   boost::signals2::signal<void (const CommandLog*)> command_signal_;
   boost::signals2::signal<void (const ControlLog*)> control_signal_;
+  boost::signals2::signal<void (const ControlTiming::Report*)> timing_signal_;
   boost::signals2::signal<void (const AttitudeData*)> imu_signal_;
   boost::signals2::signal<
     void (const ReportedServoConfig*)> servo_config_signal_;
 
-  std::vector<moteus::Value> values_cache_;
+  // Parallel to client_command_ while it holds control commands.
+  std::vector<ServoCommandFrame> command_frames_;
+  ServoCommandFrame::Values command_values_;
+
+  // Scratch space for the batched kinematics, one lane per leg slot.
+  MammalIkBatch::Joints ik_joints_;
+  MammalIkBatch::Joints ik_result_;
+  MammalIkBatch::Effectors ik_effectors_G_;
+
+  // A bitmask of the joint slots we have ever received a reply from.
+  uint32_t received_joints_ = 0;
 
   std::vector<int> all_leg_ids_{0, 1, 2, 3};
 
@@ -2287,5 +2426,9 @@ clipp::group QuadrupedControl::program_options() {
   return mjlib::base::ClippArchive().Accept(&impl_->parameters_).release();
 }
 
+QuadrupedControl::Parameters* QuadrupedControl::parameters() {
+  return &impl_->parameters_;
+}
+
 }
 }
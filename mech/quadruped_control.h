@@ -53,6 +53,27 @@ class QuadrupedControl : boost::noncopyable {
 
     double command_timeout_s = 1.0;
 
+    // If true, fail if any heap allocations are made while computing
+    // the status and control in a steady state cycle.  This requires
+    // the binary to link //base:allocation_counter_hooks.
+    bool check_allocations = false;
+
+    // Computed leg workspace regions are cached here, so that they
+    // need not be searched again on every start.  Empty disables the
+    // cache.
+    std::string valid_leg_region_cache = "/tmp/mjmech_valid_leg_region";
+
+    // If true, the servo commands computed in one cycle are not sent
+    // immediately, but are instead combined with the status query at
+    // the start of the next cycle, so that each period makes only a
+    // single pass over the CAN buses.  This adds one period of
+    // command latency in exchange for roughly half the bus time.
+    bool pipeline_commands = false;
+
+    // Summaries of the control cycle timing histograms are emitted
+    // as the "qc_timing" record at this interval.
+    double timing_report_period_s = 1.0;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(max_torque_Nm));
@@ -61,6 +82,10 @@ class QuadrupedControl : boost::noncopyable {
       a->Visit(MJ_NVP(enable_imu));
       a->Visit(MJ_NVP(servo_debug));
       a->Visit(MJ_NVP(command_timeout_s));
+      a->Visit(MJ_NVP(check_allocations));
+      a->Visit(MJ_NVP(valid_leg_region_cache));
+      a->Visit(MJ_NVP(pipeline_commands));
+      a->Visit(MJ_NVP(timing_report_period_s));
     }
   };
 
@@ -139,6 +164,7 @@ class QuadrupedControl : boost::noncopyable {
   const Status& status() const;
 
   clipp::group program_options();
+  Parameters* parameters();
 
  private:
   class Impl;
@@ -23,6 +23,7 @@
 #include "base/kinematic_relation.h"
 #include "base/point3d.h"
 #include "base/quaternion.h"
+#include "base/rigid_transform.h"
 
 #include "mech/quadruped_command.h"
 
@@ -89,6 +90,7 @@ struct QuadrupedState {
     }
 
     friend Leg operator*(const Sophus::SE3d&, const Leg& rhs);
+    friend Leg operator*(const base::RigidTransformd&, const Leg& rhs);
   };
 
   std::vector<Leg> legs_B;
@@ -338,6 +340,15 @@ inline QuadrupedState::Leg operator*(const Sophus::SE3d& pose_AB,
   return result_A;
 }
 
+inline QuadrupedState::Leg operator*(const base::RigidTransformd& pose_AB,
+                                     const QuadrupedState::Leg& rhs_B) {
+  auto result_A = rhs_B;
+  result_A.position = pose_AB * rhs_B.position;
+  result_A.velocity = pose_AB.Rotate(rhs_B.velocity);
+  result_A.force_N = pose_AB.Rotate(rhs_B.force_N);
+  return result_A;
+}
+
 }
 }
 
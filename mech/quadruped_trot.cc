@@ -109,7 +109,7 @@ class WalkContext {
         wc_(config_.walk) {}
 
   TrotResult Run(const std::vector<QC::Leg>& old_legs_R) {
-    auto legs_R = old_legs_R;
+    QC::Legs legs_R(old_legs_R.begin(), old_legs_R.end());
 
     UpdateGlobal();
     UpdateSwingTime(legs_R);
@@ -126,7 +126,7 @@ class WalkContext {
     }
 
     TrotResult result;
-    result.legs_R = std::move(legs_R);
+    result.legs_R = legs_R;
     result.desired_RB = context_->LevelDesiredRB();
     return result;
   }
@@ -150,7 +150,7 @@ class WalkContext {
     }
   }
 
-  void UpdateSwingTime(const std::vector<QC::Leg>& legs_R) {
+  void UpdateSwingTime(const QC::Legs& legs_R) {
     for (int vleg_idx = 0; vleg_idx < 2; vleg_idx++) {
       const int leg1 = kVlegMapping[vleg_idx][0];
       const int leg2 = kVlegMapping[vleg_idx][1];
@@ -168,8 +168,10 @@ class WalkContext {
     }
   }
 
-  void UpdateInvalidTime(const std::vector<QC::Leg>& legs_R) {
-    for (const auto& leg_R : legs_R) {
+  void UpdateInvalidTime(const QC::Legs& legs_R) {
+    std::array<ValidLegRegion::Query, QC::kNumLegs> queries;
+    for (size_t i = 0; i < legs_R.size(); i++) {
+      const auto& leg_R = legs_R[i];
       const auto id = leg_R.leg_id;
       const auto& leg_config = context_->GetLeg(id);
       const base::Point3D p_B =
@@ -189,9 +191,18 @@ class WalkContext {
       const base::Point3D v_G = leg_config.pose_BG.inverse().so3() * v_B;
       const double omega_G = 0.0;
 
-      ws_.legs[id].invalid_time_s =
-          context_->valid_regions[id].TimeToLeave_G(
-              p_G.head<2>(), v_G.head<2>(), omega_G);
+      auto& query = queries[i];
+      query.region = &context_->valid_regions[id];
+      query.point_G = p_G.head<2>();
+      query.velocity = v_G.head<2>();
+      query.omega = omega_G;
+    }
+
+    std::array<double, QC::kNumLegs> invalid_time_s = {};
+    ValidLegRegion::TimeToLeave_G(
+        queries.data(), invalid_time_s.data(), legs_R.size());
+    for (size_t i = 0; i < legs_R.size(); i++) {
+      ws_.legs[legs_R[i].leg_id].invalid_time_s = invalid_time_s[i];
     }
 
     for (int vleg_idx = 0; vleg_idx < 2; vleg_idx++) {
@@ -250,7 +261,7 @@ class WalkContext {
         state_->robot.desired_R.v.norm());
   }
 
-  void MaybeLift(std::vector<QC::Leg>* legs_R) {
+  void MaybeLift(QC::Legs* legs_R) {
     const auto num_stance = count_stance();
     if (num_stance == 0) { return; }
 
@@ -363,7 +374,7 @@ class WalkContext {
     ws_.next_step_vleg = (ws_.next_step_vleg + 1) % 2;
   }
 
-  void LiftVleg(std::vector<QC::Leg>* legs_R, int vleg_idx) {
+  void LiftVleg(QC::Legs* legs_R, int vleg_idx) {
     ws_.last_swing_v_R = state_->robot.desired_R.v;
 
     // Yes, we are ready to begin a lift.
@@ -535,7 +546,7 @@ class WalkContext {
     }
   }
 
-  void PropagateLegs(std::vector<QC::Leg>* legs_R) {
+  void PropagateLegs(QC::Legs* legs_R) {
     // Update our current leg positions.
     PropagateLeg propagator(
         state_->robot.desired_R.v,
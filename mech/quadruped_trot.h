@@ -21,7 +21,7 @@ namespace mjmech {
 namespace mech {
 
 struct TrotResult {
-  std::vector<QuadrupedCommand::Leg> legs_R;
+  QuadrupedCommand::Legs legs_R;
   base::KinematicRelation desired_RB;
 };
 
@@ -0,0 +1,92 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/servo_command_frame.h"
+
+#include <cstring>
+
+#include "mjlib/base/assert.h"
+
+namespace mjmech {
+namespace mech {
+
+void ServoCommandFrame::Emit(const Layout& layout, const Values& values,
+                             mjlib::multiplex::RegisterRequest* request) {
+  const auto buffer = request->buffer();
+  if (!valid_ ||
+      !(layout == layout_) ||
+      buffer.data() != buffer_ ||
+      buffer.size() != size_) {
+    Build(layout, values, request);
+    return;
+  }
+
+  Patch(values, request);
+}
+
+void ServoCommandFrame::Build(const Layout& layout, const Values& values,
+                              mjlib::multiplex::RegisterRequest* request) {
+  MJ_ASSERT(layout.num_position >= 0 && layout.num_position <= kMaxPosition);
+  MJ_ASSERT(layout.num_scale >= 0 && layout.num_scale <= kMaxScale);
+
+  rebuilds_++;
+
+  request->clear();
+  request->WriteSingle(moteus::kMode, static_cast<int8_t>(layout.mode));
+
+  // Each value block is written contiguously at the end of its
+  // subframe, so its offset is just the size after writing less the
+  // size of the values themselves.
+  if (layout.num_position) {
+    values_cache_.resize(layout.num_position);
+    for (int i = 0; i < layout.num_position; i++) {
+      values_cache_[i] = values.position[i];
+    }
+    request->WriteMultiple(moteus::kCommandPosition, values_cache_);
+    position_offset_ =
+        request->buffer().size() - layout.num_position * sizeof(int16_t);
+  }
+
+  if (layout.num_scale) {
+    values_cache_.resize(layout.num_scale);
+    for (int i = 0; i < layout.num_scale; i++) {
+      values_cache_[i] = values.scale[i];
+    }
+    request->WriteMultiple(moteus::kCommandKpScale, values_cache_);
+    scale_offset_ =
+        request->buffer().size() - layout.num_scale * sizeof(float);
+  }
+
+  layout_ = layout;
+  buffer_ = request->buffer().data();
+  size_ = request->buffer().size();
+  valid_ = true;
+}
+
+void ServoCommandFrame::Patch(
+    const Values& values,
+    mjlib::multiplex::RegisterRequest* request) const {
+  // RegisterRequest only exposes its frame read-only.  We own the
+  // request, and only ever overwrite bytes of values it encoded
+  // itself with the same width, so the frame remains well formed.
+  char* const data = const_cast<char*>(request->buffer().data());
+
+  std::memcpy(data + position_offset_, values.position.data(),
+              layout_.num_position * sizeof(int16_t));
+  std::memcpy(data + scale_offset_, values.scale.data(),
+              layout_.num_scale * sizeof(float));
+}
+
+}
+}
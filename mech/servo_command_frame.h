@@ -0,0 +1,89 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "mjlib/multiplex/register.h"
+
+#include "mech/moteus.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Maintains the command frame for a single servo.
+///
+/// A command is a mode, followed by up to 7 int16 registers starting
+/// at kCommandPosition, then up to 2 float registers starting at
+/// kCommandKpScale.  For a given mode and number of each, the bytes
+/// of the frame are always laid out the same way, so once a frame
+/// has been built, subsequent commands with the same layout only
+/// overwrite the values in place.
+class ServoCommandFrame {
+ public:
+  static constexpr int kMaxPosition = 7;
+  static constexpr int kMaxScale = 2;
+
+  struct Layout {
+    moteus::Mode mode = moteus::Mode::kStopped;
+    int num_position = 0;
+    int num_scale = 0;
+
+    bool operator==(const Layout& rhs) const {
+      return mode == rhs.mode &&
+          num_position == rhs.num_position &&
+          num_scale == rhs.num_scale;
+    }
+  };
+
+  struct Values {
+    // Encoded as moteus kInt16, in kCommandPosition register order.
+    std::array<int16_t, kMaxPosition> position = {};
+    // kCommandKpScale and kCommandKdScale.
+    std::array<float, kMaxScale> scale = {};
+  };
+
+  /// Make @p request hold the given command.  It is only rebuilt
+  /// from scratch if @p layout differs from the last call, or if the
+  /// request has been modified by someone else since.
+  void Emit(const Layout& layout, const Values& values,
+            mjlib::multiplex::RegisterRequest* request);
+
+  /// Forget the current layout, forcing a rebuild on the next Emit.
+  void Invalidate() { valid_ = false; }
+
+  /// The number of times the frame has been rebuilt, for tests.
+  int rebuilds() const { return rebuilds_; }
+
+ private:
+  void Build(const Layout&, const Values&,
+             mjlib::multiplex::RegisterRequest*);
+  void Patch(const Values&, mjlib::multiplex::RegisterRequest*) const;
+
+  bool valid_ = false;
+  Layout layout_;
+  const char* buffer_ = nullptr;
+  size_t size_ = 0;
+  size_t position_offset_ = 0;
+  size_t scale_offset_ = 0;
+  int rebuilds_ = 0;
+
+  std::vector<moteus::Value> values_cache_;
+};
+
+}
+}
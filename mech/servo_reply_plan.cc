@@ -0,0 +1,219 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/servo_reply_plan.h"
+
+#include <cstring>
+#include <limits>
+
+#include "mjlib/base/assert.h"
+
+namespace mjmech {
+namespace mech {
+
+using Joint = QuadrupedState::Joint;
+
+struct ServoReplyPlan::Field {
+  uint32_t reg;
+
+  // Exactly one of these is set.
+  double Joint::* value;
+  int32_t Joint::* int_value;
+
+  // The scale of the int8, int16, and int32 encodings.  Floats are
+  // not scaled.
+  double scale[3];
+
+  // Applied after scaling, regardless of the encoding.
+  double multiplier;
+
+  // If true, the value is multiplied by the joint's sign.
+  bool apply_sign;
+};
+
+namespace {
+constexpr double kPositionScale[] = {0.01, 0.0001, 0.00001};
+constexpr double kVelocityScale[] = {0.01, 0.00025, 0.00001};
+constexpr double kTorqueScale[] = {0.5, 0.01, 0.001};
+constexpr double kVoltageScale[] = {0.5, 0.1, 0.001};
+constexpr double kTemperatureScale[] = {1.0, 0.1, 0.001};
+
+constexpr uint8_t kReplyBase = 0x20;
+
+constexpr int kTypeSize[] = {1, 2, 4, 4};
+
+void AppendVaruint(uint32_t value, std::vector<uint8_t>* out) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    if (value) { byte |= 0x80; }
+    out->push_back(byte);
+  } while (value);
+}
+
+template <typename T>
+T Load(const uint8_t* data) {
+  T result;
+  std::memcpy(&result, data, sizeof(result));
+  return result;
+}
+
+template <typename T>
+double ScaleInt(T raw, double scale) {
+  if (raw == std::numeric_limits<T>::min()) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return raw * scale;
+}
+}
+
+const ServoReplyPlan::Field* ServoReplyPlan::FindField(uint32_t reg) {
+  auto make = [](uint32_t reg, double Joint::* value,
+                 const double* scale, double multiplier, bool apply_sign) {
+    return Field{reg, value, nullptr, {scale[0], scale[1], scale[2]},
+                 multiplier, apply_sign};
+  };
+  auto make_int = [](uint32_t reg, int32_t Joint::* int_value) {
+    return Field{reg, nullptr, int_value, {1.0, 1.0, 1.0}, 1.0, false};
+  };
+
+  static const Field kFields[] = {
+    make_int(moteus::kMode, &Joint::mode),
+    make(moteus::kPosition, &Joint::angle_deg, kPositionScale, 360.0, true),
+    make(moteus::kVelocity, &Joint::velocity_dps,
+         kVelocityScale, 360.0, true),
+    make(moteus::kTorque, &Joint::torque_Nm, kTorqueScale, 1.0, true),
+    make(moteus::kVoltage, &Joint::voltage, kVoltageScale, 1.0, false),
+    make(moteus::kTemperature, &Joint::temperature_C,
+         kTemperatureScale, 1.0, false),
+    make_int(moteus::kFault, &Joint::fault),
+    make(moteus::kPositionKp, &Joint::kp_Nm, kTorqueScale, 1.0, true),
+    make(moteus::kPositionKi, &Joint::ki_Nm, kTorqueScale, 1.0, true),
+    make(moteus::kPositionKd, &Joint::kd_Nm, kTorqueScale, 1.0, true),
+    make(moteus::kPositionFeedforward, &Joint::feedforward_Nm,
+         kTorqueScale, 1.0, true),
+    make(moteus::kPositionCommand, &Joint::command_Nm,
+         kTorqueScale, 1.0, true),
+  };
+
+  for (const auto& field : kFields) {
+    if (field.reg == reg) { return &field; }
+  }
+  return nullptr;
+}
+
+void ServoReplyPlan::ReadMultiple(
+    uint32_t start_register, uint32_t count, int type) {
+  MJ_ASSERT(type >= 0 && type <= moteus::kFloat);
+  MJ_ASSERT(count > 0);
+
+  // A reply subframe is a single byte holding the type and, if it
+  // fits, the count, then the count if it did not fit, then the
+  // starting register, then the values.
+  std::vector<uint8_t> header;
+  header.push_back(kReplyBase | (type << 2) | (count <= 3 ? count : 0));
+  if (count > 3) { AppendVaruint(count, &header); }
+  AppendVaruint(start_register, &header);
+
+  for (const auto byte : header) {
+    checks_.push_back({static_cast<uint8_t>(size_), byte});
+    size_++;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    const auto* field = FindField(start_register + i);
+    if (field) {
+      ops_.push_back({static_cast<uint8_t>(size_),
+                      static_cast<uint8_t>(type), field});
+    }
+    size_ += kTypeSize[type];
+  }
+
+  // Every offset must fit in a single CAN-FD frame.
+  MJ_ASSERT(size_ <= 64);
+}
+
+void ServoReplyPlan::Clear() {
+  checks_.clear();
+  ops_.clear();
+  size_ = 0;
+}
+
+bool ServoReplyPlan::Decode(const uint8_t* data, size_t size, double sign,
+                            Joint* joint) const {
+  if (size < size_) { return false; }
+  for (const auto& check : checks_) {
+    if (data[check.offset] != check.value) { return false; }
+  }
+
+  for (const auto& op : ops_) {
+    const auto* field = op.field;
+    const uint8_t* const src = data + op.offset;
+
+    if (field->int_value) {
+      const int32_t value = [&]() -> int32_t {
+        switch (op.type) {
+          case moteus::kInt8: { return Load<int8_t>(src); }
+          case moteus::kInt16: { return Load<int16_t>(src); }
+          case moteus::kInt32: { return Load<int32_t>(src); }
+          case moteus::kFloat: { return static_cast<int32_t>(Load<float>(src)); }
+        }
+        return 0;
+      }();
+      joint->*(field->int_value) = value;
+      continue;
+    }
+
+    const double scaled = [&]() {
+      switch (op.type) {
+        case moteus::kInt8: {
+          return ScaleInt(Load<int8_t>(src), field->scale[0]);
+        }
+        case moteus::kInt16: {
+          return ScaleInt(Load<int16_t>(src), field->scale[1]);
+        }
+        case moteus::kInt32: {
+          return ScaleInt(Load<int32_t>(src), field->scale[2]);
+        }
+        case moteus::kFloat: {
+          return static_cast<double>(Load<float>(src));
+        }
+      }
+      return 0.0;
+    }();
+    joint->*(field->value) =
+        (field->apply_sign ? sign : 1.0) * field->multiplier * scaled;
+  }
+
+  return true;
+}
+
+void ServoReplyPlan::Apply(uint32_t reg, const moteus::Value& value,
+                           double sign, Joint* joint) {
+  const auto* field = FindField(reg);
+  if (!field) { return; }
+
+  if (field->int_value) {
+    joint->*(field->int_value) = moteus::ReadInt(value);
+    return;
+  }
+
+  const double scaled = moteus::ReadScale(
+      value, field->scale[0], field->scale[1], field->scale[2]);
+  joint->*(field->value) =
+      (field->apply_sign ? sign : 1.0) * field->multiplier * scaled;
+}
+
+}
+}
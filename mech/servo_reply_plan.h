@@ -0,0 +1,79 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mech/moteus.h"
+#include "mech/quadruped_state.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Decodes servo replies straight into a QuadrupedState::Joint.
+///
+/// When the same registers are read every cycle, the reply frame
+/// always has the same layout.  The plan records the expected
+/// subframe headers and the offset of every value once, so decoding
+/// is a handful of header byte comparisons followed by a fixed list
+/// of loads, with no intermediate register/value list.
+///
+/// Decode returns false for any frame which is not laid out as
+/// planned, for instance if the servo reported a read error, in
+/// which case the caller should fall back to a generic parse and
+/// Apply.
+class ServoReplyPlan {
+ public:
+  /// Record that @p count registers of @p type, starting at
+  /// @p start_register, were read.  Calls must be made in the same
+  /// order as on the RegisterRequest.
+  void ReadMultiple(uint32_t start_register, uint32_t count, int type);
+
+  void Clear();
+
+  /// The number of bytes a planned reply occupies.
+  size_t size() const { return size_; }
+
+  bool Decode(const uint8_t* data, size_t size, double sign,
+              QuadrupedState::Joint* joint) const;
+
+  /// Store a single register value which was parsed elsewhere.
+  /// Registers without a corresponding joint field are ignored.
+  static void Apply(uint32_t reg, const moteus::Value& value, double sign,
+                    QuadrupedState::Joint* joint);
+
+ private:
+  struct Field;
+  static const Field* FindField(uint32_t reg);
+
+  struct Check {
+    uint8_t offset = 0;
+    uint8_t value = 0;
+  };
+
+  struct Op {
+    uint8_t offset = 0;
+    uint8_t type = 0;
+    const Field* field = nullptr;
+  };
+
+  std::vector<Check> checks_;
+  std::vector<Op> ops_;
+  size_t size_ = 0;
+};
+
+}
+}
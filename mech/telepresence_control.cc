@@ -111,7 +111,7 @@ class TelepresenceControl::Impl {
 
     outstanding_ = true;
 
-    timing_ = ControlTiming(executor_, timing_.cycle_start());
+    timing_.StartCycle();
 
     RunControl();
   }
@@ -365,7 +365,7 @@ class TelepresenceControl::Impl {
   boost::signals2::signal<void (const CommandLog*)> command_signal_;
   boost::signals2::signal<void (const ControlLog*)> control_signal_;
 
-  ControlTiming timing_{executor_, {}};
+  ControlTiming timing_{executor_};
 
   mjlib::base::PID pid_{&parameters_.pid, &status_.pid};
 };
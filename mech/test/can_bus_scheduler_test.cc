@@ -0,0 +1,51 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/can_bus_scheduler.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::mech;
+
+BOOST_AUTO_TEST_CASE(CanBusSchedulerInterleave) {
+  CanBusScheduler dut;
+
+  // Three servos on each of buses 1 and 2, in id order, and one
+  // extra frame on bus 2.
+  dut.Add(0, 1, true);
+  dut.Add(1, 1, true);
+  dut.Add(2, 1, true);
+  dut.Add(3, 2, true);
+  dut.Add(4, 2, true);
+  dut.Add(5, 2, true);
+  dut.Add(6, 2, false);
+  dut.Add(7, 5, false);
+
+  const std::vector<int> expected = {3, 0, 7, 4, 1, 5, 2, 6};
+  BOOST_TEST(dut.Schedule() == expected);
+
+  BOOST_TEST(dut.frames(1) == 3);
+  BOOST_TEST(dut.frames(2) == 4);
+  BOOST_TEST(dut.frames(3) == 0);
+  BOOST_TEST(dut.expected_replies(1) == 3);
+  BOOST_TEST(dut.expected_replies(2) == 3);
+  BOOST_TEST(dut.expected_replies(5) == 0);
+
+  dut.Clear();
+  BOOST_TEST(dut.Schedule().empty());
+  BOOST_TEST(dut.expected_replies(1) == 0);
+
+  dut.Add(0, 3, true);
+  BOOST_TEST(dut.Schedule() == std::vector<int>{0});
+}
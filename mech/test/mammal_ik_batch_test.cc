@@ -0,0 +1,202 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/mammal_ik_batch.h"
+
+#include <random>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::mech;
+
+namespace {
+/// Four legs, mirrored left to right like a real robot, with one
+/// using the inverted solution and one with no shoulder offset.
+std::vector<MammalIk::Config> MakeConfigs() {
+  std::vector<MammalIk::Config> result;
+  for (int i = 0; i < 4; i++) {
+    MammalIk::Config config;
+    const double side = (i % 2) ? -1.0 : 1.0;
+    config.shoulder.pose = {0.020, i == 3 ? 0.0 : side * 0.030, 0.005};
+    config.shoulder.id = i * 3 + 1;
+    config.femur.pose = {0.0, 0.0, 0.100};
+    config.femur.id = i * 3 + 2;
+    config.tibia.pose = {0.0, 0.0, 0.110};
+    config.tibia.id = i * 3 + 3;
+    config.invert = (i == 2);
+    result.push_back(config);
+  }
+  return result;
+}
+
+IkSolver::Joint GetJoint(const IkSolver::JointAngles& joints, int id) {
+  for (const auto& joint : joints) {
+    if (joint.id == id) { return joint; }
+  }
+  BOOST_FAIL("joint not found");
+  return {};
+}
+
+/// The batch is single precision, while MammalIk is double.
+void CheckLane(const MammalIkBatch::Joint& actual, int lane,
+               const IkSolver::Joint& expected) {
+  auto relative = [](double value) { return std::max(1.0, std::abs(value)); };
+  BOOST_TEST(std::abs(actual.angle_deg(lane) - expected.angle_deg) < 1e-3);
+  BOOST_TEST(std::abs(actual.velocity_dps(lane) - expected.velocity_dps)
+             < 1e-3 * relative(expected.velocity_dps));
+  BOOST_TEST(std::abs(actual.torque_Nm(lane) - expected.torque_Nm)
+             < 1e-5 * relative(expected.torque_Nm));
+}
+}
+
+BOOST_AUTO_TEST_CASE(MammalIkBatchForward) {
+  const auto configs = MakeConfigs();
+  const MammalIkBatch dut(configs);
+  BOOST_TEST(dut.size() == 4);
+
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> angle(-60.0, 60.0);
+  std::uniform_real_distribution<double> other(-10.0, 10.0);
+
+  for (int trial = 0; trial < 100; trial++) {
+    MammalIkBatch::Joints joints;
+    std::vector<IkSolver::JointAngles> scalar_joints;
+
+    for (int i = 0; i < 4; i++) {
+      const auto& config = configs[i];
+      IkSolver::JointAngles leg;
+      for (const auto* joint : {&config.shoulder, &config.femur,
+                                &config.tibia}) {
+        leg.push_back(IkSolver::Joint()
+                      .set_id(joint->id)
+                      .set_angle_deg(angle(rng))
+                      .set_velocity_dps(other(rng))
+                      .set_torque_Nm(other(rng)));
+      }
+      joints.shoulder.Set(i, leg[0]);
+      joints.femur.Set(i, leg[1]);
+      joints.tibia.Set(i, leg[2]);
+      scalar_joints.push_back(leg);
+    }
+
+    MammalIkBatch::Effectors effectors_G;
+    dut.Forward_G(joints, &effectors_G);
+
+    for (int i = 0; i < 4; i++) {
+      const auto expected = MammalIk(configs[i]).Forward_G(scalar_joints[i]);
+      BOOST_TEST((effectors_G.pose.Get(i) - expected.pose).norm()
+                 < 1e-6);
+      BOOST_TEST((effectors_G.velocity.Get(i) -
+                  expected.velocity).norm() <
+                 1e-5 * std::max(1.0, expected.velocity.norm()));
+      // Forces are relative, as they grow large near singularities.
+      BOOST_TEST((effectors_G.force_N.Get(i) -
+                  expected.force_N).norm() <
+                 1e-3 * std::max(1.0, expected.force_N.norm()));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(MammalIkBatchInverse) {
+  const auto configs = MakeConfigs();
+  const MammalIkBatch dut(configs);
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> xy(-0.08, 0.08);
+  std::uniform_real_distribution<double> z(0.05, 0.25);
+  std::uniform_real_distribution<double> other(-1.0, 1.0);
+
+  int solved = 0;
+  int unsolved = 0;
+
+  for (int trial = 0; trial < 200; trial++) {
+    const bool use_current = (trial % 2) == 0;
+
+    MammalIkBatch::Effectors effectors_G;
+    MammalIkBatch::Joints current;
+    std::vector<IkSolver::Effector> scalar_effectors;
+    std::vector<IkSolver::JointAngles> scalar_current;
+
+    for (int i = 0; i < 4; i++) {
+      IkSolver::Effector effector;
+      // Every so often, ask for something out of reach.
+      const double scale = (trial % 7 == 0 && i == 1) ? 3.0 : 1.0;
+      effector.pose = scale * Eigen::Vector3d(xy(rng), xy(rng), z(rng));
+      effector.velocity = Eigen::Vector3d(other(rng), other(rng), other(rng));
+      effector.force_N =
+          10.0 * Eigen::Vector3d(other(rng), other(rng), other(rng));
+      effectors_G.Set(i, effector);
+      scalar_effectors.push_back(effector);
+
+      const auto& config = configs[i];
+      IkSolver::JointAngles leg;
+      leg.push_back(IkSolver::Joint().set_id(config.shoulder.id)
+                    .set_angle_deg(5.0));
+      leg.push_back(IkSolver::Joint().set_id(config.femur.id)
+                    .set_angle_deg(30.0));
+      leg.push_back(IkSolver::Joint().set_id(config.tibia.id)
+                    .set_angle_deg(-60.0));
+      current.shoulder.Set(i, leg[0]);
+      current.femur.Set(i, leg[1]);
+      current.tibia.Set(i, leg[2]);
+      scalar_current.push_back(leg);
+    }
+
+    MammalIkBatch::Joints result;
+    const auto mask = dut.Inverse(
+        effectors_G, use_current ? &current : nullptr, &result);
+
+    for (int i = 0; i < 4; i++) {
+      const MammalIk scalar(configs[i]);
+      const auto expected = scalar.Inverse(
+          scalar_effectors[i],
+          use_current ?
+          std::optional<IkSolver::JointAngles>(scalar_current[i]) :
+          std::optional<IkSolver::JointAngles>());
+
+      const bool have = (mask & (1u << i)) != 0;
+      BOOST_TEST(have == !!expected);
+      if (!expected || !have) {
+        unsolved++;
+        continue;
+      }
+      solved++;
+
+      CheckLane(result.shoulder, i,
+                GetJoint(*expected, configs[i].shoulder.id));
+      CheckLane(result.femur, i, GetJoint(*expected, configs[i].femur.id));
+      CheckLane(result.tibia, i, GetJoint(*expected, configs[i].tibia.id));
+    }
+  }
+
+  // Make sure both outcomes were exercised.
+  BOOST_TEST(solved > 500);
+  BOOST_TEST(unsolved > 10);
+}
+
+BOOST_AUTO_TEST_CASE(MammalIkBatchPartial) {
+  auto configs = MakeConfigs();
+  configs.resize(2);
+  const MammalIkBatch dut(configs);
+  BOOST_TEST(dut.size() == 2);
+
+  MammalIkBatch::Effectors effectors_G;
+  for (int i = 0; i < 2; i++) {
+    effectors_G.pose.Set(i, Eigen::Vector3d(0.0, 0.03, 0.15));
+  }
+
+  MammalIkBatch::Joints result;
+  // Unused lanes never report a solution.
+  BOOST_TEST(dut.Inverse(effectors_G, nullptr, &result) == 0x3u);
+}
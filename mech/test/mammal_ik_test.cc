@@ -14,8 +14,15 @@
 
 #include "mech/mammal_ik.h"
 
+#include <random>
+
 #include <boost/test/auto_unit_test.hpp>
 
+#include <dart/dynamics/BodyNode.hpp>
+#include <dart/dynamics/RevoluteJoint.hpp>
+#include <dart/dynamics/Skeleton.hpp>
+#include <dart/dynamics/WeldJoint.hpp>
+
 #include <fmt/format.h>
 
 #include "mjlib/base/fail.h"
@@ -83,6 +90,95 @@ class OffsetFixture {
   using J = IkSolver::Joint;
 };
 
+/// A rigid body model of the same leg, used as an oracle for the
+/// closed form kinematics in MammalIk.
+class DartLeg {
+ public:
+  DartLeg(const MammalIk::Config& config) {
+    namespace dyn = dart::dynamics;
+    skel_ = dyn::Skeleton::create("leg");
+    skel_->setGravity(Eigen::Vector3d(0, 0, 0));
+
+    auto make_joint = [&](auto* parent, const auto& config_joint,
+                          const Eigen::Vector3d& axis,
+                          const std::string& name) {
+      dyn::RevoluteJoint::Properties properties;
+      properties.mName = name + "_joint";
+      properties.mAxis = axis;
+      properties.mT_ChildBodyToJoint.translation() = -config_joint.pose;
+
+      auto pair = skel_->createJointAndBodyNodePair<dyn::RevoluteJoint>(
+          parent, properties, dyn::BodyNode::AspectProperties(name));
+      pair.second->setMass(0.01);
+      return pair;
+    };
+
+    dyn::BodyNode* shoulder_body = nullptr;
+    dyn::BodyNode* femur_body = nullptr;
+    dyn::BodyNode* tibia_body = nullptr;
+    std::tie(joints_[0], shoulder_body) = make_joint(
+        static_cast<dyn::BodyNode*>(nullptr), config.shoulder,
+        Eigen::Vector3d::UnitX(), "shoulder");
+    std::tie(joints_[1], femur_body) = make_joint(
+        shoulder_body, config.femur, Eigen::Vector3d::UnitY(), "femur");
+    std::tie(joints_[2], tibia_body) = make_joint(
+        femur_body, config.tibia, Eigen::Vector3d::UnitY(), "tibia");
+
+    dyn::WeldJoint::Properties properties;
+    properties.mName = "foot_joint";
+    foot_body_ =
+        skel_->createJointAndBodyNodePair<dyn::WeldJoint>(
+            tibia_body, properties,
+            dyn::BodyNode::AspectProperties("foot")).second;
+    // This swamps all other masses, so that the foot acceleration
+    // can be used to back out the force the end-effector produces.
+    foot_body_->setMass(1e6);
+  }
+
+  struct Result {
+    Eigen::Vector3d pose;
+    Eigen::Vector3d velocity;
+    Eigen::Vector3d force_N;
+    Eigen::MatrixXd jacobian;
+  };
+
+  Result Forward(const Eigen::Vector3d& angle_rad,
+                 const Eigen::Vector3d& velocity_rps,
+                 const Eigen::Vector3d& torque_Nm) {
+    for (int i = 0; i < 3; i++) {
+      joints_[i]->setPosition(0, angle_rad(i));
+      joints_[i]->setVelocity(0, velocity_rps(i));
+      joints_[i]->setForce(0, 0.0);
+    }
+    skel_->computeForwardKinematics();
+    skel_->computeForwardDynamics();
+
+    Result result;
+    result.pose = foot_body_->getCOM();
+    result.velocity = foot_body_->getCOMLinearVelocity();
+    result.jacobian = foot_body_->getLinearJacobian();
+
+    const Eigen::Vector3d no_torque_accel =
+        foot_body_->getCOMLinearAcceleration();
+
+    for (int i = 0; i < 3; i++) {
+      joints_[i]->setForce(0, torque_Nm(i));
+    }
+    skel_->computeForwardKinematics();
+    skel_->computeForwardDynamics();
+
+    result.force_N =
+        (foot_body_->getCOMLinearAcceleration() - no_torque_accel) * 1e6;
+
+    return result;
+  }
+
+ private:
+  dart::dynamics::SkeletonPtr skel_;
+  dart::dynamics::Joint* joints_[3] = {};
+  dart::dynamics::BodyNode* foot_body_ = nullptr;
+};
+
 struct TorqueTest {
   double x;
   double y;
@@ -564,3 +660,97 @@ BOOST_AUTO_TEST_CASE(MammalInverseForceTest,
     }
   }
 }
+
+BOOST_AUTO_TEST_CASE(MammalDartOracleTest) {
+  // Compare the closed form kinematics against a full rigid body
+  // model across a range of configurations and joint states.
+  const MammalIk::Config config = []() {
+    MammalIk::Config config;
+
+    config.shoulder.pose = {0.020, 0.030, 0.010};
+    config.shoulder.id = 1;
+    config.femur.pose = {0.0, 0.0, 0.100};
+    config.femur.id = 2;
+    config.tibia.pose = {0.0, 0.0, 0.110};
+    config.tibia.id = 3;
+
+    return config;
+  }();
+
+  MammalIk dut{config};
+  DartLeg oracle{config};
+
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<double> angle_dist(-1.5, 1.5);
+  std::uniform_real_distribution<double> value_dist(-5.0, 5.0);
+
+  using J = IkSolver::Joint;
+
+  for (int i = 0; i < 200; i++) {
+    const Eigen::Vector3d angle_rad{
+      angle_dist(rng), angle_dist(rng), angle_dist(rng)};
+    const Eigen::Vector3d velocity_rps{
+      value_dist(rng), value_dist(rng), value_dist(rng)};
+    const Eigen::Vector3d torque_Nm{
+      value_dist(rng), value_dist(rng), value_dist(rng)};
+
+    BOOST_TEST_CONTEXT(fmt::format("i={} angles={} {} {}", i,
+                                   angle_rad.x(), angle_rad.y(),
+                                   angle_rad.z())) {
+      const auto expected = oracle.Forward(angle_rad, velocity_rps, torque_Nm);
+
+      Eigen::Matrix3d jacobian;
+      dut.ForwardKinematics_G(
+          angle_rad.x(), angle_rad.y(), angle_rad.z(), &jacobian);
+      BOOST_TEST(jacobian.isApprox(expected.jacobian, 1e-6));
+
+      // Near a singularity, the force is ill-conditioned, so only
+      // compare forces where the Jacobian is well behaved.
+      const bool well_conditioned = std::abs(jacobian.determinant()) > 1e-4;
+
+      const IkSolver::JointAngles joints = {
+        J().set_id(1)
+        .set_angle_deg(base::Degrees(angle_rad.x()))
+        .set_velocity_dps(base::Degrees(velocity_rps.x()))
+        .set_torque_Nm(torque_Nm.x()),
+        J().set_id(2)
+        .set_angle_deg(base::Degrees(angle_rad.y()))
+        .set_velocity_dps(base::Degrees(velocity_rps.y()))
+        .set_torque_Nm(torque_Nm.y()),
+        J().set_id(3)
+        .set_angle_deg(base::Degrees(angle_rad.z()))
+        .set_velocity_dps(base::Degrees(velocity_rps.z()))
+        .set_torque_Nm(torque_Nm.z()),
+      };
+
+      const auto result_G = dut.Forward_G(joints);
+      BOOST_TEST(result_G.pose.isApprox(expected.pose, 1e-9));
+      BOOST_TEST(result_G.velocity.isApprox(expected.velocity, 1e-6));
+      if (well_conditioned) {
+        BOOST_TEST(result_G.force_N.isApprox(expected.force_N, 1e-3));
+
+        // Inverse, when evaluated at the same joints, should recover
+        // the joint velocities and torques.
+        IkSolver::Effector effector_G;
+        effector_G.pose = expected.pose;
+        effector_G.velocity = expected.velocity;
+        effector_G.force_N = expected.force_N;
+        const auto inverse = dut.Inverse(effector_G, joints);
+        if (inverse) {
+          BOOST_TEST(std::abs(Shoulder(*inverse).velocity_dps -
+                              joints[0].velocity_dps) < 1e-3);
+          BOOST_TEST(std::abs(Femur(*inverse).velocity_dps -
+                              joints[1].velocity_dps) < 1e-3);
+          BOOST_TEST(std::abs(Tibia(*inverse).velocity_dps -
+                              joints[2].velocity_dps) < 1e-3);
+          BOOST_TEST(std::abs(Shoulder(*inverse).torque_Nm -
+                              joints[0].torque_Nm) < 1e-2);
+          BOOST_TEST(std::abs(Femur(*inverse).torque_Nm -
+                              joints[1].torque_Nm) < 1e-2);
+          BOOST_TEST(std::abs(Tibia(*inverse).torque_Nm -
+                              joints[2].torque_Nm) < 1e-2);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,113 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/servo_command_frame.h"
+
+#include <string>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::mech;
+using mjlib::multiplex::RegisterRequest;
+
+namespace {
+// Build the same command the generic way.
+std::string Generic(const ServoCommandFrame::Layout& layout,
+                    const ServoCommandFrame::Values& values) {
+  RegisterRequest request;
+  request.WriteSingle(moteus::kMode, static_cast<int8_t>(layout.mode));
+  std::vector<moteus::Value> cache;
+  for (int i = 0; i < layout.num_position; i++) {
+    cache.push_back(values.position[i]);
+  }
+  if (!cache.empty()) {
+    request.WriteMultiple(moteus::kCommandPosition, cache);
+  }
+  cache.clear();
+  for (int i = 0; i < layout.num_scale; i++) {
+    cache.push_back(values.scale[i]);
+  }
+  if (!cache.empty()) {
+    request.WriteMultiple(moteus::kCommandKpScale, cache);
+  }
+  return std::string(request.buffer());
+}
+
+ServoCommandFrame::Values MakeValues(int base) {
+  ServoCommandFrame::Values result;
+  for (size_t i = 0; i < result.position.size(); i++) {
+    result.position[i] = static_cast<int16_t>(base * 100 + i);
+  }
+  result.scale = {{0.25f * base, 0.5f * base}};
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(ServoCommandFramePatch) {
+  ServoCommandFrame dut;
+  RegisterRequest request;
+
+  ServoCommandFrame::Layout layout;
+  layout.mode = moteus::Mode::kPosition;
+  layout.num_position = 7;
+  layout.num_scale = 2;
+
+  for (int i = 1; i < 5; i++) {
+    const auto values = MakeValues(i);
+    dut.Emit(layout, values, &request);
+    BOOST_TEST(std::string(request.buffer()) == Generic(layout, values));
+  }
+  BOOST_TEST(dut.rebuilds() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(ServoCommandFrameLayoutChange) {
+  ServoCommandFrame dut;
+  RegisterRequest request;
+
+  const ServoCommandFrame::Layout layouts[] = {
+    {moteus::Mode::kStopped, 0, 0},
+    {moteus::Mode::kPosition, 1, 0},
+    {moteus::Mode::kPosition, 3, 1},
+    {moteus::Mode::kPosition, 6, 2},
+    {moteus::Mode::kZeroVelocity, 0, 0},
+  };
+
+  int count = 0;
+  for (const auto& layout : layouts) {
+    const auto values = MakeValues(++count);
+    dut.Emit(layout, values, &request);
+    BOOST_TEST(std::string(request.buffer()) == Generic(layout, values));
+  }
+  BOOST_TEST(dut.rebuilds() == count);
+}
+
+BOOST_AUTO_TEST_CASE(ServoCommandFrameExternalChange) {
+  ServoCommandFrame dut;
+  RegisterRequest request;
+
+  ServoCommandFrame::Layout layout;
+  layout.mode = moteus::Mode::kPosition;
+  layout.num_position = 3;
+
+  dut.Emit(layout, MakeValues(1), &request);
+
+  // Someone else reuses the request for a different command.
+  request.clear();
+  request.WriteSingle(moteus::kRezero, 0.5f);
+
+  const auto values = MakeValues(2);
+  dut.Emit(layout, values, &request);
+  BOOST_TEST(std::string(request.buffer()) == Generic(layout, values));
+  BOOST_TEST(dut.rebuilds() == 2);
+}
@@ -0,0 +1,111 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/servo_reply_plan.h"
+
+#include <cmath>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/multiplex/register.h"
+
+using namespace mjmech::mech;
+using Joint = QuadrupedState::Joint;
+
+namespace {
+// The reply a servo makes to the standard status query, a block of
+// 4 int16 registers starting at kMode, then 3 int8 starting at
+// kVoltage.
+const std::vector<uint8_t> kStatusReply = {
+  0x24, 0x04, 0x00,
+  0x0a, 0x00,  // mode 10
+  0x10, 0x27,  // position 10000 -> 1 revolution
+  0x38, 0xff,  // velocity -200
+  0x00, 0x80,  // torque int16 min -> NaN
+  0x23, 0x0d,
+  0x28,  // voltage 40 -> 20V
+  0x1e,  // temperature 30C
+  0x00,  // no fault
+  0x50, 0x50,  // padding
+};
+
+ServoReplyPlan MakeStatusPlan() {
+  ServoReplyPlan result;
+  result.ReadMultiple(moteus::kMode, 4, moteus::kInt16);
+  result.ReadMultiple(moteus::kVoltage, 3, moteus::kInt8);
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(ServoReplyPlanDecode) {
+  const auto dut = MakeStatusPlan();
+  BOOST_TEST(dut.size() == 16);
+
+  Joint joint;
+  BOOST_TEST_REQUIRE(dut.Decode(kStatusReply.data(), kStatusReply.size(),
+                                -1.0, &joint));
+
+  BOOST_TEST(joint.mode == 10);
+  BOOST_TEST(joint.angle_deg == -360.0, boost::test_tools::tolerance(1e-9));
+  BOOST_TEST(joint.velocity_dps == 18.0, boost::test_tools::tolerance(1e-9));
+  BOOST_TEST(std::isnan(joint.torque_Nm));
+  BOOST_TEST(joint.voltage == 20.0);
+  BOOST_TEST(joint.temperature_C == 30.0);
+  BOOST_TEST(joint.fault == 0);
+}
+
+BOOST_AUTO_TEST_CASE(ServoReplyPlanMismatch) {
+  const auto dut = MakeStatusPlan();
+  Joint joint;
+
+  // Too short.
+  BOOST_TEST(!dut.Decode(kStatusReply.data(), 10, 1.0, &joint));
+
+  // A read error in place of the second block.
+  auto error_reply = kStatusReply;
+  error_reply[11] = 0x31;
+  BOOST_TEST(!dut.Decode(error_reply.data(), error_reply.size(),
+                         1.0, &joint));
+}
+
+BOOST_AUTO_TEST_CASE(ServoReplyPlanMatchesGenericParse) {
+  const auto dut = MakeStatusPlan();
+
+  Joint planned;
+  BOOST_TEST_REQUIRE(dut.Decode(kStatusReply.data(), kStatusReply.size(),
+                                1.0, &planned));
+
+  mjlib::base::BufferReadStream stream{
+    {reinterpret_cast<const char*>(kStatusReply.data()),
+          kStatusReply.size()}};
+  std::vector<mjlib::multiplex::RegisterValue> parsed;
+  mjlib::multiplex::ParseRegisterReply(stream, &parsed);
+  BOOST_TEST(parsed.size() == 7);
+
+  Joint generic;
+  for (const auto& pair : parsed) {
+    const auto* value = std::get_if<moteus::Value>(&pair.second);
+    BOOST_TEST_REQUIRE(!!value);
+    ServoReplyPlan::Apply(pair.first, *value, 1.0, &generic);
+  }
+
+  BOOST_TEST(planned.mode == generic.mode);
+  BOOST_TEST(planned.angle_deg == generic.angle_deg);
+  BOOST_TEST(planned.velocity_dps == generic.velocity_dps);
+  BOOST_TEST(std::isnan(generic.torque_Nm));
+  BOOST_TEST(planned.voltage == generic.voltage);
+  BOOST_TEST(planned.temperature_C == generic.temperature_C);
+  BOOST_TEST(planned.fault == generic.fault);
+}
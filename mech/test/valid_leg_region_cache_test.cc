@@ -0,0 +1,103 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/valid_leg_region_cache.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+namespace base = mjmech::base;
+namespace fs = boost::filesystem;
+using namespace mjmech::mech;
+
+namespace {
+ValidLegRegionCache::Leg MakeLeg() {
+  ValidLegRegionCache::Leg result;
+  result.ik.shoulder.pose = {0.020, 0.0, 0.0};
+  result.ik.shoulder.id = 1;
+  result.ik.femur.pose = {0.0, 0.0, 0.100};
+  result.ik.femur.id = 2;
+  result.ik.tibia.pose = {0.0, 0.0, 0.100};
+  result.ik.tibia.id = 3;
+  result.idle_G = {0.0, 0.0, 0.150};
+  result.lift_height = 0.030;
+  return result;
+}
+
+void CheckSame(const ValidLegRegion& lhs, const ValidLegRegion& rhs) {
+  const auto& lhs_points = lhs.bounds_G().outer();
+  const auto& rhs_points = rhs.bounds_G().outer();
+  BOOST_TEST_REQUIRE(lhs_points.size() == rhs_points.size());
+  for (size_t i = 0; i < lhs_points.size(); i++) {
+    BOOST_TEST(lhs_points[i].x() == rhs_points[i].x());
+    BOOST_TEST(lhs_points[i].y() == rhs_points[i].y());
+  }
+}
+}
+
+BOOST_AUTO_TEST_CASE(ValidLegRegionCacheHash) {
+  const auto leg = MakeLeg();
+  const auto base_hash = ValidLegRegionCache::Hash(leg);
+  BOOST_TEST(ValidLegRegionCache::Hash(MakeLeg()) == base_hash);
+
+  auto changed = leg;
+  changed.ik.tibia.pose.z() = 0.101;
+  BOOST_TEST(ValidLegRegionCache::Hash(changed) != base_hash);
+
+  changed = leg;
+  changed.idle_G.x() = 0.001;
+  BOOST_TEST(ValidLegRegionCache::Hash(changed) != base_hash);
+
+  changed = leg;
+  changed.lift_height = 0.040;
+  BOOST_TEST(ValidLegRegionCache::Hash(changed) != base_hash);
+
+  changed = leg;
+  changed.ik.invert = true;
+  BOOST_TEST(ValidLegRegionCache::Hash(changed) != base_hash);
+}
+
+BOOST_AUTO_TEST_CASE(ValidLegRegionCacheRoundTrip) {
+  const auto directory =
+      fs::temp_directory_path() / fs::unique_path("valid_leg_region_%%%%%%%%");
+
+  ValidLegRegionCache::Options options;
+  options.directory = directory.string();
+  const ValidLegRegionCache dut{options};
+
+  const auto leg = MakeLeg();
+  const ValidLegRegion expected(
+      MammalIk(leg.ik), leg.idle_G, leg.lift_height);
+  BOOST_TEST(expected.bounds_G().outer().size() > 3);
+
+  // The first request computes and stores the region.
+  const auto first = dut.Get({leg, leg});
+  BOOST_TEST_REQUIRE(first.size() == 2);
+  CheckSame(first[0], expected);
+  CheckSame(first[1], expected);
+  BOOST_TEST(fs::exists(directory));
+
+  // The second request is loaded from disk, and should give the same
+  // answers for points inside and outside.
+  const auto second = dut.Get({leg});
+  BOOST_TEST_REQUIRE(second.size() == 1);
+  CheckSame(second[0], expected);
+
+  const Eigen::Vector2d idle = leg.idle_G.head<2>();
+  const Eigen::Vector2d velocity(0.1, 0.05);
+  BOOST_TEST(second[0].TimeToLeave_G(idle, velocity, 0.0) ==
+             expected.TimeToLeave_G(idle, velocity, 0.0));
+
+  fs::remove_all(directory);
+}
@@ -0,0 +1,107 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/valid_leg_region.h"
+
+#include <array>
+#include <optional>
+#include <random>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mech/mammal_ik.h"
+
+using namespace mjmech::mech;
+
+namespace {
+ValidLegRegion MakeRegion() {
+  MammalIk::Config config;
+  config.shoulder.pose = {0.020, 0.0, 0.0};
+  config.shoulder.id = 1;
+  config.femur.pose = {0.0, 0.0, 0.100};
+  config.femur.id = 2;
+  config.tibia.pose = {0.0, 0.0, 0.100};
+  config.tibia.id = 3;
+
+  return ValidLegRegion(MammalIk(config), {0.0, 0.0, 0.150}, 0.030);
+}
+
+std::optional<double> Reference(const ValidLegRegion& region,
+                                const Eigen::Vector2d& point,
+                                const Eigen::Vector2d& velocity,
+                                double omega) {
+  try {
+    return region.ReferenceTimeToLeave_G(point, velocity, omega);
+  } catch (std::bad_optional_access&) {
+    return {};
+  }
+}
+}
+
+BOOST_AUTO_TEST_CASE(ValidLegRegionMatchesReference) {
+  const auto dut = MakeRegion();
+  BOOST_TEST_REQUIRE(dut.bounds_G().outer().size() > 3);
+
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<double> position(-0.15, 0.15);
+  std::uniform_real_distribution<double> speed(-0.5, 0.5);
+  std::uniform_real_distribution<double> rate(-2.0, 2.0);
+
+  int inside = 0;
+  int curved = 0;
+  for (int i = 0; i < 2000; i++) {
+    const Eigen::Vector2d point(position(rng), position(rng));
+    const Eigen::Vector2d velocity(speed(rng), speed(rng));
+    const double omega = (i % 2) ? rate(rng) : 0.0;
+
+    const auto expected = Reference(dut, point, velocity, omega);
+    const double actual = dut.TimeToLeave_G(point, velocity, omega);
+
+    if (!expected) {
+      // The reference throws when nothing is ahead of the point.
+      BOOST_TEST(std::isinf(actual));
+      continue;
+    }
+
+    if (*expected != 0.0) { inside++; }
+    if (omega != 0.0) { curved++; }
+    BOOST_TEST(actual == *expected, boost::test_tools::tolerance(1e-9));
+  }
+
+  BOOST_TEST(inside > 100);
+  BOOST_TEST(curved > 100);
+}
+
+BOOST_AUTO_TEST_CASE(ValidLegRegionBatch) {
+  const auto dut = MakeRegion();
+
+  std::array<ValidLegRegion::Query, 4> queries;
+  for (size_t i = 0; i < queries.size(); i++) {
+    auto& query = queries[i];
+    query.region = &dut;
+    query.point_G = Eigen::Vector2d(0.01 * i, -0.005 * i);
+    query.velocity = Eigen::Vector2d(0.1, 0.02 * i);
+    query.omega = (i == 3) ? 0.5 : 0.0;
+  }
+
+  std::array<double, 4> result = {};
+  ValidLegRegion::TimeToLeave_G(queries.data(), result.data(), queries.size());
+
+  for (size_t i = 0; i < queries.size(); i++) {
+    const auto& query = queries[i];
+    BOOST_TEST(result[i] == dut.TimeToLeave_G(
+                   query.point_G, query.velocity, query.omega));
+    BOOST_TEST(result[i] > 0.0);
+  }
+}
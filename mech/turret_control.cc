@@ -183,7 +183,7 @@ class TurretControl::Impl {
     if (!client_) { return; }
     if (outstanding_) { return; }
 
-    timing_ = ControlTiming(executor_, timing_.cycle_start());
+    timing_.StartCycle();
 
     outstanding_ = true;
 
@@ -654,7 +654,7 @@ class TurretControl::Impl {
   boost::signals2::signal<void (const ImageLog*)> image_signal_;
   boost::signals2::signal<void (const Weapon*)> weapon_signal_;
 
-  ControlTiming timing_{executor_, {}};
+  ControlTiming timing_{executor_};
 
   std::map<int, double> servo_sign_ = {
     { 1, 1.0 },
@@ -0,0 +1,175 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/valid_leg_region.h"
+
+#include <cmath>
+#include <limits>
+
+#include "base/common.h"
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+constexpr double kInf = std::numeric_limits<double>::infinity();
+
+// Within and StraightExit have no data dependent branches in their
+// inner loops, so that the compiler can vectorize them across edges.
+// CurvedExit skips edges the circle misses and only calls atan2 for
+// the rest, so it stays scalar.
+
+/// An even-odd crossing test, equivalent to boost::geometry::within
+/// except for points exactly on an edge.
+bool Within(const double* x1, const double* y1,
+            const double* x2, const double* y2,
+            size_t size, double px, double py) {
+  int crossings = 0;
+  for (size_t i = 0; i < size; i++) {
+    const bool straddles = (y1[i] > py) != (y2[i] > py);
+    const double dy = y2[i] - y1[i];
+    const double x_cross =
+        x1[i] + (py - y1[i]) * (x2[i] - x1[i]) / (straddles ? dy : 1.0);
+    crossings += (straddles && px < x_cross) ? 1 : 0;
+  }
+  return (crossings & 1) != 0;
+}
+
+/// The straight line case of TrajectoryLineIntersectTime, evaluated
+/// for every edge, returning the smallest non-negative time.
+double StraightExit(const double* x1, const double* y1,
+                    const double* x2, const double* y2,
+                    size_t size, double px, double py,
+                    double vx, double vy) {
+  double smallest = kInf;
+  for (size_t i = 0; i < size; i++) {
+    const double x3 = x1[i] - px;
+    const double y3 = y1[i] - py;
+    const double x4 = x2[i] - px;
+    const double y4 = y2[i] - py;
+
+    const double denom = (-vx) * (y3 - y4) - (-vy) * (x3 - x4);
+    const double numerator = (-x3) * (y3 - y4) - (-y3) * (x3 - x4);
+    const double t = (denom == 0.0) ? kInf : numerator / denom;
+
+    smallest = (t >= 0.0 && t < smallest) ? t : smallest;
+  }
+  return smallest;
+}
+
+/// The curved path case of TrajectoryLineIntersectTime, evaluated for
+/// every edge.  The circle parameters are computed once per query
+/// rather than once per edge, and angles are only evaluated for
+/// edges which the circle actually crosses.
+double CurvedExit(const double* x1, const double* y1,
+                  const double* x2, const double* y2,
+                  size_t size, double px, double py,
+                  double vx, double vy, double omega) {
+  const double speed = std::hypot(vx, vy);
+  const double radius = speed / omega;
+  const double cx = (1.0 / omega) * -vy;
+  const double cy = (1.0 / omega) * vx;
+  const double theta0 = std::atan2(-cy, -cx);
+
+  auto calct = [&](double x, double y) {
+    const double theta = std::atan2(y - cy, x - cx);
+    return base::WrapNegPiToPi(theta - theta0) * radius / speed;
+  };
+
+  double smallest = kInf;
+  for (size_t i = 0; i < size; i++) {
+    const double p1x = (x1[i] - px) - cx;
+    const double p1y = (y1[i] - py) - cy;
+    const double p2x = (x2[i] - px) - cx;
+    const double p2y = (y2[i] - py) - cy;
+    const double dx = p2x - p1x;
+    const double dy = p2y - p1y;
+    const double dr2 = dx * dx + dy * dy;
+    const double D = p1x * p2y - p2x * p1y;
+    const double discriminant2 = radius * radius * dr2 - D * D;
+    if (discriminant2 < 0.0) { continue; }
+
+    const double t = [&]() {
+      if (discriminant2 == 0.0) {
+        return calct(D * dy / dr2 + cx, -D * dx / dr2 + cy);
+      }
+      const double discriminant = std::sqrt(discriminant2);
+      const double sign_dy = dy < 0.0 ? -1.0 : 1.0;
+      const double t1 = calct(
+          (D * dy + sign_dy * dx * discriminant) / dr2 + cx,
+          (-D * dx + std::abs(dy) * discriminant) / dr2 + cy);
+      const double t2 = calct(
+          (D * dy - sign_dy * dx * discriminant) / dr2 + cx,
+          (-D * dx - std::abs(dy) * discriminant) / dr2 + cy);
+      return (std::abs(t1) < std::abs(t2)) ? t1 : t2;
+    }();
+
+    if (t >= 0.0 && t < smallest) { smallest = t; }
+  }
+  return smallest;
+}
+}
+
+void ValidLegRegion::CompileEdges() {
+  namespace bg = boost::geometry;
+
+  edges_ = {};
+  bg::for_each_segment(bounds_G_, [&](const auto& segment) {
+      edges_.x1.push_back(bg::get<0, 0>(segment));
+      edges_.y1.push_back(bg::get<0, 1>(segment));
+      edges_.x2.push_back(bg::get<1, 0>(segment));
+      edges_.y2.push_back(bg::get<1, 1>(segment));
+    });
+}
+
+double ValidLegRegion::TimeToLeave_G(const Eigen::Vector2d& point_G,
+                                     const Eigen::Vector2d& velocity,
+                                     double omega) const {
+  const double* const x1 = edges_.x1.data();
+  const double* const y1 = edges_.y1.data();
+  const double* const x2 = edges_.x2.data();
+  const double* const y2 = edges_.y2.data();
+  const size_t size = edges_.x1.size();
+
+  if (!Within(x1, y1, x2, y2, size, point_G.x(), point_G.y())) {
+    // This matches ReferenceTimeToLeave_G, which reports 0 for points
+    // that are already outside.
+    return 0.0;
+  }
+
+  if (velocity.norm() == 0.0 && omega == 0.0) {
+    return kInf;
+  }
+
+  // TrajectoryLineIntersectTime switches between the straight and
+  // curved solutions at the same threshold.
+  if (std::abs(omega) < 1e-6) {
+    return StraightExit(x1, y1, x2, y2, size, point_G.x(), point_G.y(),
+                        velocity.x(), velocity.y());
+  }
+  return CurvedExit(x1, y1, x2, y2, size, point_G.x(), point_G.y(),
+                    velocity.x(), velocity.y(), omega);
+}
+
+void ValidLegRegion::TimeToLeave_G(const Query* queries, double* result,
+                                   size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const auto& query = queries[i];
+    result[i] = query.region->TimeToLeave_G(
+        query.point_G, query.velocity, query.omega);
+  }
+}
+
+}
+}
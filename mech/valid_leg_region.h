@@ -63,8 +63,17 @@ class ValidLegRegion {
     // TODO: Shrink this so we get margin.
 
     boost::geometry::simplify(merged_G.front(), bounds_G_, kXStep);
+    CompileEdges();
   }
 
+  /// Construct from a previously computed bounding polygon, as
+  /// returned by bounds_G().
+  explicit ValidLegRegion(const Polygon& bounds_G) : bounds_G_(bounds_G) {
+    CompileEdges();
+  }
+
+  const Polygon& bounds_G() const { return bounds_G_; }
+
   /// For a point at the given location, moving at the given velocity
   /// and that velocity rotating at the given omega, determine when it
   /// will leave the bounding region.
@@ -72,9 +81,33 @@ class ValidLegRegion {
   /// Returns a negative value if it is outside the bounding region,
   /// and infinity (possibly negative) if it will never cross the
   /// bounding region.
+  ///
+  /// This evaluates the precompiled edge arrays, and is equivalent to
+  /// ReferenceTimeToLeave_G, except that it returns infinity rather
+  /// than throwing when no edge is ahead of the point.
   double TimeToLeave_G(const Eigen::Vector2d& point_G,
                        const Eigen::Vector2d& velocity,
-                       double omega) const {
+                       double omega) const;
+
+  struct Query {
+    const ValidLegRegion* region = nullptr;
+    Eigen::Vector2d point_G;
+    Eigen::Vector2d velocity;
+    double omega = 0.0;
+  };
+
+  /// Evaluate TimeToLeave_G for each of @p count queries, storing the
+  /// answers in @p result.  This is intended for evaluating every leg
+  /// in a single call each control cycle.
+  static void TimeToLeave_G(const Query* queries, double* result,
+                            size_t count);
+
+  /// The original implementation of TimeToLeave_G, using
+  /// boost::geometry directly on the polygon.  It is retained for
+  /// testing and benchmarking.
+  double ReferenceTimeToLeave_G(const Eigen::Vector2d& point_G,
+                                const Eigen::Vector2d& velocity,
+                                double omega) const {
     const bool within = boost::geometry::within(
         Point(point_G.x(), point_G.y()), bounds_G_);
 
@@ -111,6 +144,7 @@ class ValidLegRegion {
   }
 
  private:
+  void CompileEdges();
 
   Polygon SearchPlane(const IkSolver& ik, const base::Point3D& start_G) const {
     Plane plane;
@@ -177,6 +211,16 @@ class ValidLegRegion {
   }
 
   Polygon bounds_G_;
+
+  // The segments of bounds_G_ as flat arrays, so that the edge
+  // kernels in TimeToLeave_G can stream through them.
+  struct Edges {
+    std::vector<double> x1;
+    std::vector<double> y1;
+    std::vector<double> x2;
+    std::vector<double> y2;
+  };
+  Edges edges_;
 };
 
 }
@@ -0,0 +1,202 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/valid_leg_region_cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/base/json5_write_archive.h"
+#include "mjlib/base/visitor.h"
+
+namespace fs = boost::filesystem;
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+// Increment this whenever the search in ValidLegRegion changes in a
+// way that would produce a different polygon from the same inputs.
+constexpr uint64_t kVersion = 2;
+
+class Fnv1a {
+ public:
+  template <typename T>
+  Fnv1a& Add(const T& value) {
+    unsigned char bytes[sizeof(T)] = {};
+    std::memcpy(bytes, &value, sizeof(T));
+    for (auto byte : bytes) {
+      hash_ = (hash_ ^ byte) * 1099511628211ull;
+    }
+    return *this;
+  }
+
+  Fnv1a& Add(const base::Point3D& value) {
+    return Add(value.x()).Add(value.y()).Add(value.z());
+  }
+
+  Fnv1a& Add(const MammalIk::Config::Joint& joint) {
+    return Add(joint.pose).Add(joint.id);
+  }
+
+  uint64_t value() const { return hash_; }
+
+ private:
+  uint64_t hash_ = 14695981039346656037ull;
+};
+
+struct StoredRegion {
+  std::string key;
+  std::vector<double> x;
+  std::vector<double> y;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(key));
+    a->Visit(MJ_NVP(x));
+    a->Visit(MJ_NVP(y));
+  }
+};
+
+std::string FormatKey(uint64_t hash) {
+  return fmt::format("{:016x}", hash);
+}
+}
+
+std::vector<ValidLegRegion> ValidLegRegionCache::Get(
+    const std::vector<Leg>& legs) const {
+  std::vector<std::optional<ValidLegRegion>> regions;
+  for (const auto& leg : legs) {
+    regions.push_back(Load(Hash(leg)));
+  }
+
+  auto compute = [](const Leg& leg) {
+    return ValidLegRegion(MammalIk(leg.ik), leg.idle_G, leg.lift_height);
+  };
+
+  std::vector<std::future<ValidLegRegion>> computed(legs.size());
+  for (size_t i = 0; i < legs.size(); i++) {
+    if (regions[i]) { continue; }
+    computed[i] = std::async(
+        options_.parallel ? std::launch::async : std::launch::deferred,
+        compute, std::cref(legs[i]));
+  }
+
+  std::vector<ValidLegRegion> result;
+  for (size_t i = 0; i < legs.size(); i++) {
+    if (!regions[i]) {
+      regions[i] = computed[i].get();
+      Store(Hash(legs[i]), *regions[i]);
+    }
+    result.push_back(*regions[i]);
+  }
+  return result;
+}
+
+uint64_t ValidLegRegionCache::Hash(const Leg& leg) {
+  return Fnv1a()
+      .Add(kVersion)
+      .Add(ValidLegRegion::kXStep)
+      .Add(ValidLegRegion::kYStep)
+      .Add(leg.ik.shoulder)
+      .Add(leg.ik.femur)
+      .Add(leg.ik.tibia)
+      .Add(leg.ik.invert)
+      .Add(leg.idle_G)
+      .Add(leg.lift_height)
+      .value();
+}
+
+std::string ValidLegRegionCache::Filename(uint64_t hash) const {
+  return (fs::path(options_.directory) /
+          fmt::format("valid_leg_region_{}.json", FormatKey(hash))).string();
+}
+
+std::optional<ValidLegRegion> ValidLegRegionCache::Load(uint64_t hash) const {
+  if (options_.directory.empty()) { return {}; }
+
+  std::ifstream inf(Filename(hash));
+  if (!inf.is_open()) { return {}; }
+
+  std::ostringstream contents;
+  contents << inf.rdbuf();
+
+  StoredRegion stored;
+  try {
+    stored = mjlib::base::Json5ReadArchive::Read<StoredRegion>(
+        contents.str());
+  } catch (std::exception&) {
+    // A corrupt or truncated entry is treated as a miss, and will be
+    // overwritten.
+    return {};
+  }
+
+  if (stored.key != FormatKey(hash) ||
+      stored.x.size() != stored.y.size()) {
+    return {};
+  }
+
+  ValidLegRegion::Polygon bounds_G;
+  for (size_t i = 0; i < stored.x.size(); i++) {
+    boost::geometry::append(
+        bounds_G, ValidLegRegion::Point(stored.x[i], stored.y[i]));
+  }
+  return ValidLegRegion(bounds_G);
+}
+
+void ValidLegRegionCache::Store(
+    uint64_t hash, const ValidLegRegion& region) const {
+  if (options_.directory.empty()) { return; }
+
+  StoredRegion stored;
+  stored.key = FormatKey(hash);
+  for (const auto& point : region.bounds_G().outer()) {
+    stored.x.push_back(point.x());
+    stored.y.push_back(point.y());
+  }
+
+  // The cache is purely an optimization, so failing to write it is
+  // not an error.
+  boost::system::error_code ec;
+  fs::create_directories(options_.directory, ec);
+  if (ec) { return; }
+
+  // Write to a temporary file and rename it into place, so that
+  // concurrent processes never observe a partial entry.
+  const auto filename = Filename(hash);
+  const auto temp_filename =
+      fs::unique_path(filename + ".%%%%%%%%").string();
+  {
+    std::ofstream of(temp_filename);
+    if (!of.is_open()) { return; }
+    of << mjlib::base::Json5WriteArchive::Write(stored);
+    if (!of) {
+      of.close();
+      fs::remove(temp_filename, ec);
+      return;
+    }
+  }
+  fs::rename(temp_filename, filename, ec);
+  if (ec) { fs::remove(temp_filename, ec); }
+}
+
+}
+}
@@ -0,0 +1,69 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "mech/mammal_ik.h"
+#include "mech/valid_leg_region.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Computing a ValidLegRegion takes many thousands of inverse
+/// kinematics solutions.  This stores the resulting polygons on disk,
+/// keyed by a hash of everything that goes into them, so that each
+/// leg geometry only needs to be searched once.
+class ValidLegRegionCache {
+ public:
+  struct Options {
+    /// Where cached regions are stored.  If empty, nothing is loaded
+    /// or stored.
+    std::string directory;
+
+    /// Compute any regions missing from the cache concurrently, with
+    /// one thread per leg.
+    bool parallel = true;
+  };
+
+  struct Leg {
+    MammalIk::Config ik;
+    base::Point3D idle_G;
+    double lift_height = 0.0;
+  };
+
+  ValidLegRegionCache(const Options& options) : options_(options) {}
+
+  /// Return one region for each leg, loading those which are present
+  /// in the cache, and computing and storing the remainder.
+  std::vector<ValidLegRegion> Get(const std::vector<Leg>& legs) const;
+
+  /// The cache key for a leg.  It changes if any input to the search,
+  /// or the search resolution, changes.
+  static uint64_t Hash(const Leg&);
+
+ private:
+  std::string Filename(uint64_t hash) const;
+  std::optional<ValidLegRegion> Load(uint64_t hash) const;
+  void Store(uint64_t hash, const ValidLegRegion&) const;
+
+  const Options options_;
+};
+
+}
+}
@@ -71,6 +71,8 @@ class WebControl {
     return mjlib::base::ClippArchive().Accept(&parameters_).release();
   }
 
+  Parameters* parameters() { return &parameters_; }
+
   void AsyncStart(mjlib::io::ErrorCallback callback) {
     WebServer::Options server_options;
 
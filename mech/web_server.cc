@@ -26,6 +26,7 @@
 #include "mjlib/base/fail.h"
 
 #include "base/logging.h"
+#include "base/realtime.h"
 
 #include "mech/mime_type.h"
 
@@ -134,6 +135,8 @@ class WebServer::Impl {
   }
 
   void ChildRun() {
+    base::ConfigureRealtimeThread(base::RealtimeThread::kWeb);
+
     std::make_shared<Listener>(
         this, child_context_.get_executor(),
         tcp::endpoint(boost::asio::ip::make_address(options_.address),
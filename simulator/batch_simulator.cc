@@ -0,0 +1,391 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Run many independent headless simulations in parallel, one for
+/// each point in a grid of QuadrupedConfig overrides, and write a
+/// summary of each run.
+///
+/// The batch file is JSON5 of the form:
+///
+///  {
+///    grid : [
+///      { name : "walk.max_swing_time_s", values : [0.15, 0.20, 0.25] },
+///      { name : "walk.travel_ratio", values : [0.5, 0.7] },
+///    ],
+///    script : [
+///      { duration_s : 2.0, command : { mode : "rest" } },
+///      { duration_s : 5.0, command : { mode : "walk", v_R : [0.1, 0, 0] } },
+///    ],
+///  }
+///
+/// Each grid name is a '.' separated path into QuadrupedConfig.  The
+/// full cartesian product of the grid is run.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <dart/dynamics/BodyNode.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/clipp.h"
+#include "mjlib/base/fail.h"
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/base/system_error.h"
+#include "mjlib/base/visitor.h"
+
+#include "base/common.h"
+#include "base/logging.h"
+
+#include "simulator/simulation.h"
+
+namespace fs = boost::filesystem;
+
+using namespace mjmech;
+using namespace mjmech::simulator;
+
+namespace {
+
+struct Axis {
+  std::string name;
+  std::vector<double> values;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(name));
+    a->Visit(MJ_NVP(values));
+  }
+};
+
+struct ScriptStep {
+  double duration_s = 1.0;
+  mech::QuadrupedCommand command;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(duration_s));
+    a->Visit(MJ_NVP(command));
+  }
+};
+
+struct Batch {
+  std::vector<Axis> grid;
+  std::vector<ScriptStep> script;
+
+  // A run is considered to have fallen if the body tilts by more
+  // than this from its initial orientation.
+  double fall_tilt_deg = 60.0;
+
+  // Tracking errors are sampled at this interval.
+  double sample_period_s = 0.01;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(grid));
+    a->Visit(MJ_NVP(script));
+    a->Visit(MJ_NVP(fall_tilt_deg));
+    a->Visit(MJ_NVP(sample_period_s));
+  }
+};
+
+using Overrides = std::vector<std::pair<std::string, double>>;
+
+struct Result {
+  bool started = false;
+  bool fell = false;
+  double fall_time_s = 0.0;
+  std::string fault;
+  double speed_rms_error = 0.0;
+  double yaw_rate_rms_error = 0.0;
+  double max_cycle_s = 0.0;
+  double p99_cycle_s = 0.0;
+  double simulated_s = 0.0;
+  double wall_s = 0.0;
+};
+
+/// Express a vector in DART's body frame in the robot's B frame,
+/// using the same mapping as the simulated IMU.
+Eigen::Vector3d DartToB(const Eigen::Vector3d& v_D) {
+  return Eigen::Vector3d(-v_D.x(), -v_D.y(), v_D.z());
+}
+
+/// Quote a field for CSV, doubling any embedded quotes.
+std::string CsvQuote(const std::string& value) {
+  std::string result = "\"";
+  for (const char c : value) {
+    if (c == '"') { result += '"'; }
+    result += c;
+  }
+  result += '"';
+  return result;
+}
+
+/// Render a set of dotted path overrides as a nested JSON5 object,
+/// suitable for layering on top of a QuadrupedConfig.
+std::string FormatOverrides(const Overrides& overrides) {
+  struct Node {
+    std::map<std::string, Node> children;
+    std::optional<double> value;
+  };
+
+  Node root;
+  for (const auto& pair : overrides) {
+    Node* node = &root;
+    std::string remaining = pair.first;
+    while (true) {
+      const auto dot = remaining.find('.');
+      node = &node->children[remaining.substr(0, dot)];
+      if (dot == std::string::npos) { break; }
+      remaining = remaining.substr(dot + 1);
+    }
+    node->value = pair.second;
+  }
+
+  std::function<std::string (const Node&)> format = [&](const Node& node) {
+    if (node.value) { return fmt::format("{}", *node.value); }
+    std::string result = "{ ";
+    for (const auto& child : node.children) {
+      result += child.first + " : " + format(child.second) + ", ";
+    }
+    return result + "}";
+  };
+  return format(root) + "\n";
+}
+
+std::vector<Overrides> ExpandGrid(const std::vector<Axis>& grid) {
+  std::vector<Overrides> result = {{}};
+  for (const auto& axis : grid) {
+    std::vector<Overrides> next;
+    for (const auto& partial : result) {
+      for (const auto value : axis.values) {
+        next.push_back(partial);
+        next.back().push_back({axis.name, value});
+      }
+    }
+    result = std::move(next);
+  }
+  return result;
+}
+
+Result Run(const Batch& batch, const std::string& config,
+           const std::string& override_file) {
+  Result result;
+
+  base::Context context;
+  Simulation simulation(context);
+
+  simulation.options()->config = config;
+  auto& m = *simulation.quadruped()->m();
+  m.quadruped_control->parameters()->config = config + " " + override_file;
+  // Every instance gets an ephemeral port so they do not collide.
+  m.web_control->parameters()->port = 0;
+
+  simulation.AsyncStart([&](const mjlib::base::error_code& ec) {
+      mjlib::base::FailIf(ec);
+    });
+
+  const auto wall_start = std::chrono::steady_clock::now();
+
+  while (!simulation.started()) { simulation.Step(); }
+  result.started = true;
+
+  auto* const body = simulation.robot()->getBodyNode("robot");
+  // The body frame's notion of "up" when it was placed in the world.
+  const Eigen::Vector3d up_B =
+      body->getTransform().linear().transpose() * Eigen::Vector3d::UnitZ();
+  const double fall_cos = std::cos(base::Radians(batch.fall_tilt_deg));
+
+  double speed_error2 = 0.0;
+  double yaw_rate_error2 = 0.0;
+  int samples = 0;
+
+  std::vector<double> cycle_s;
+  boost::posix_time::ptime last_cycle;
+
+  const double start_s = simulation.time_s();
+  double next_sample_s = start_s;
+  double step_end_s = start_s;
+  const auto& status = m.quadruped_control->status();
+
+  for (const auto& step : batch.script) {
+    m.quadruped_control->Command(step.command);
+    step_end_s += step.duration_s;
+
+    while (simulation.time_s() < step_end_s) {
+      simulation.Step();
+
+      if (status.timestamp != last_cycle) {
+        last_cycle = status.timestamp;
+        cycle_s.push_back(status.timing.cycle_s);
+      }
+
+      const double now_s = simulation.time_s();
+      if (now_s < next_sample_s) { continue; }
+      next_sample_s += batch.sample_period_s;
+
+      const Eigen::Vector3d up_W = body->getTransform().linear() * up_B;
+      if (!result.fell && up_W.z() < fall_cos) {
+        result.fell = true;
+        result.fall_time_s = now_s - start_s;
+      }
+
+      // Express the body velocity in the robot frame, so that it can
+      // be compared directly with the command.
+      const auto& robot = status.state.robot;
+      const Eigen::Matrix3d R_WD = body->getTransform().linear();
+      const Eigen::Vector3d v_R =
+          robot.frame_RB.pose.so3() *
+          DartToB(R_WD.transpose() * body->getLinearVelocity());
+      const Eigen::Vector3d w_R =
+          robot.frame_RB.pose.so3() *
+          DartToB(R_WD.transpose() * body->getAngularVelocity());
+      const double speed_error =
+          (v_R.head<2>() - robot.desired_R.v.head<2>()).norm();
+      const double yaw_rate_error = w_R.z() - robot.desired_R.w.z();
+      speed_error2 += speed_error * speed_error;
+      yaw_rate_error2 += yaw_rate_error * yaw_rate_error;
+      samples++;
+    }
+  }
+
+  result.wall_s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - wall_start).count();
+  result.simulated_s = simulation.time_s();
+  result.fault = status.fault;
+  if (samples) {
+    result.speed_rms_error = std::sqrt(speed_error2 / samples);
+    result.yaw_rate_rms_error = std::sqrt(yaw_rate_error2 / samples);
+  }
+  if (!cycle_s.empty()) {
+    const auto p99 = cycle_s.begin() + (cycle_s.size() - 1) * 99 / 100;
+    std::nth_element(cycle_s.begin(), p99, cycle_s.end());
+    result.p99_cycle_s = *p99;
+    result.max_cycle_s = *std::max_element(p99, cycle_s.end());
+  }
+
+  return result;
+}
+
+}
+
+int main(int argc, char** argv) {
+  std::string batch_file;
+  std::string config = "configs/quada1.cfg";
+  std::string output = "batch_summary.csv";
+  int jobs = 0;
+
+  auto group = (
+      (clipp::option("b", "batch") & clipp::value("", batch_file)) %
+      "JSON5 batch description",
+      (clipp::option("config") & clipp::value("", config)) %
+      "base quadruped config",
+      (clipp::option("o", "output") & clipp::value("", output)) %
+      "summary file to write",
+      (clipp::option("j", "jobs") & clipp::value("", jobs)) %
+      "number of parallel simulations, 0 for one per core"
+  );
+
+  group.push_back(base::MakeLoggingOptions());
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  base::InitLogging();
+
+  Batch batch;
+  {
+    std::ifstream inf(batch_file);
+    mjlib::base::system_error::throw_if(
+        !inf.is_open(), "opening " + batch_file);
+    mjlib::base::Json5ReadArchive(inf).Accept(&batch);
+  }
+
+  const auto runs = ExpandGrid(batch.grid);
+
+  const auto directory =
+      fs::temp_directory_path() / fs::unique_path("mjmech_batch_%%%%%%%%");
+  fs::create_directories(directory);
+
+  std::vector<std::string> override_files;
+  for (size_t i = 0; i < runs.size(); i++) {
+    const auto filename = (directory / fmt::format("run{}.cfg", i)).string();
+    std::ofstream of(filename);
+    mjlib::base::system_error::throw_if(
+        !of.is_open(), "opening " + filename);
+    of << FormatOverrides(runs[i]);
+    override_files.push_back(filename);
+  }
+
+  if (jobs <= 0) {
+    jobs = std::max<int>(1, std::thread::hardware_concurrency());
+  }
+
+  std::vector<Result> results(runs.size());
+  std::atomic<size_t> next{0};
+  std::mutex progress_mutex;
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < std::min<int>(jobs, runs.size()); i++) {
+    threads.emplace_back([&]() {
+        while (true) {
+          const size_t index = next++;
+          if (index >= runs.size()) { return; }
+
+          results[index] = Run(batch, config, override_files[index]);
+
+          std::lock_guard<std::mutex> guard(progress_mutex);
+          std::cout << fmt::format(
+              "run {}/{} {:.1f}x real time{}\n",
+              index + 1, runs.size(),
+              results[index].simulated_s / results[index].wall_s,
+              results[index].fell ? " FELL" : "");
+        }
+      });
+  }
+  for (auto& thread : threads) { thread.join(); }
+
+  fs::remove_all(directory);
+
+  std::ofstream of(output);
+  mjlib::base::system_error::throw_if(!of.is_open(), "opening " + output);
+
+  for (const auto& axis : batch.grid) { of << axis.name << ","; }
+  of << "started,fell,fall_time_s,fault,speed_rms_error,"
+     << "yaw_rate_rms_error,max_cycle_s,p99_cycle_s,simulated_s,wall_s\n";
+
+  for (size_t i = 0; i < runs.size(); i++) {
+    for (const auto& pair : runs[i]) { of << pair.second << ","; }
+    const auto& r = results[i];
+    of << fmt::format("{},{},{},{},{},{},{},{},{},{}\n",
+                      r.started ? 1 : 0, r.fell ? 1 : 0, r.fall_time_s,
+                      CsvQuote(r.fault), r.speed_rms_error,
+                      r.yaw_rate_rms_error, r.max_cycle_s, r.p99_cycle_s,
+                      r.simulated_s, r.wall_s);
+  }
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Run the simulator without any display, stepping the world as fast
+/// as the CPU allows.
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <optional>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/clipp.h"
+#include "mjlib/base/fail.h"
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/base/system_error.h"
+
+#include "base/logging.h"
+#include "base/telemetry_registry.h"
+#include "base/timestamped_log.h"
+
+#include "simulator/simulation.h"
+
+using namespace mjmech;
+using namespace mjmech::simulator;
+
+int main(int argc, char** argv) {
+  std::string config_file;
+  std::string log_file;
+  std::string command_file;
+  double duration_s = 10.0;
+
+  auto group = (
+      (clipp::option("c", "config") & clipp::value("", config_file)) %
+      "read options from file",
+      (clipp::option("l", "log") & clipp::value("", log_file)) %
+      "write to log file",
+      (clipp::option("command") & clipp::value("", command_file)) %
+      "JSON5 QuadrupedCommand to issue once started",
+      (clipp::option("duration_s") & clipp::value("", duration_s)) %
+      "simulated time to run for"
+  );
+
+  group.push_back(base::MakeLoggingOptions());
+
+  base::Context context;
+  Simulation simulation(context);
+
+  group.push_back(simulation.program_options());
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  base::InitLogging();
+
+  if (!config_file.empty()) {
+    std::ifstream inf(config_file);
+    mjlib::base::system_error::throw_if(
+        !inf.is_open(), "opening "  + config_file);
+    mjlib::base::ClippParseIni(inf, group);
+
+    mjlib::base::ClippParse(argc, argv, group);
+  }
+
+  if (!log_file.empty()) {
+    mjmech::base::OpenMaybeTimestampedLog(
+        context.telemetry_registry->log(),
+        log_file,
+        mjmech::base::kTimestamped);
+  }
+
+  std::optional<mech::QuadrupedCommand> command;
+  if (!command_file.empty()) {
+    std::ifstream inf(command_file);
+    mjlib::base::system_error::throw_if(
+        !inf.is_open(), "opening " + command_file);
+    command.emplace();
+    mjlib::base::Json5ReadArchive(inf).Accept(&*command);
+  }
+
+  simulation.AsyncStart([&](const mjlib::base::error_code& ec) {
+      mjlib::base::FailIf(ec);
+      if (command) {
+        simulation.quadruped()->m()->quadruped_control->Command(*command);
+      }
+    });
+
+  const auto start = std::chrono::steady_clock::now();
+
+  while (simulation.time_s() < duration_s) {
+    simulation.Step();
+  }
+
+  const double wall_s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  const auto& status =
+      simulation.quadruped()->m()->quadruped_control->status();
+
+  std::cout << fmt::format(
+      "simulated {:.3f}s in {:.3f}s wall ({:.1f}x real time) "
+      "mode={} fault='{}'\n",
+      simulation.time_s(), wall_s, simulation.time_s() / wall_s,
+      static_cast<int>(status.mode), status.fault);
+
+  return simulation.started() ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+
+#include <boost/noncopyable.hpp>
+
+#include <dart/dynamics/Skeleton.hpp>
+#include <dart/simulation/World.hpp>
+
+#include <clipp/clipp.h>
+
+#include "mjlib/io/async_types.h"
+
+#include "base/context.h"
+
+#include "mech/quadruped.h"
+
+namespace mjmech {
+namespace simulator {
+
+/// Owns the DART world, the simulated pi3hat and servos, and a
+/// complete mech::Quadruped.  Time is driven exclusively by Step(),
+/// which installs a DebugDeadlineService on the context, so the
+/// simulation runs exactly as fast as Step() is called.  It has no
+/// dependence on any display.
+class Simulation : boost::noncopyable {
+ public:
+  Simulation(base::Context&);
+  ~Simulation();
+
+  struct Options {
+    std::string config = "configs/quada1.cfg";
+    double torque_scale = 1.0;
+    double ramp_height = 0.1;
+    int ramp = 1;
+    double time_step_s = 0.0001;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(config));
+      a->Visit(MJ_NVP(torque_scale));
+      a->Visit(MJ_NVP(ramp_height));
+      a->Visit(MJ_NVP(ramp));
+      a->Visit(MJ_NVP(time_step_s));
+    }
+  };
+
+  /// These may only be modified before AsyncStart.
+  Options* options();
+
+  clipp::group program_options();
+
+  /// Load the configuration and start the quadruped.  The callback is
+  /// only invoked from within Step().
+  void AsyncStart(mjlib::io::ErrorCallback);
+
+  /// Advance simulated time by one world time step, process any
+  /// events which became ready, run the servo models, and then step
+  /// the physics.
+  void Step();
+
+  /// The total amount of simulated time since construction.
+  double time_s() const;
+
+  /// True once the AsyncStart callback has been invoked successfully.
+  bool started() const;
+
+  dart::simulation::WorldPtr world();
+  dart::dynamics::SkeletonPtr robot();
+  mech::Quadruped* quadruped();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -19,6 +19,7 @@
 #include "mjlib/base/clipp.h"
 
 #include "base/logging.h"
+#include "base/telemetry_registry.h"
 #include "base/timestamped_log.h"
 
 #include "simulator/simulator_window.h"
@@ -59,7 +60,7 @@ int main(int argc, char** argv) {
 
   if (!log_file.empty()) {
     mjmech::base::OpenMaybeTimestampedLog(
-        context.telemetry_log.get(),
+        context.telemetry_registry->log(),
         log_file,
         mjmech::base::kTimestamped);
   }
@@ -15,6 +15,7 @@
 # limitations under the License.
 
 load("//tools/workspace/bazel_deps:repository.bzl", "bazel_deps_repository")
+load("//tools/workspace/google_benchmark:repository.bzl", "google_benchmark_repository")
 load("//tools/workspace/gst-rpicamsrc:repository.bzl", "gst_rpicamsrc_repository")
 load("//tools/workspace/i2c-tools:repository.bzl", "i2c_tools_repository")
 load("//tools/workspace/implot:repository.bzl", "implot_repository")
@@ -30,6 +31,8 @@ load("//tools/workspace/sophus:repository.bzl", "sophus_repository")
 def add_default_repositories(excludes = []):
     if not native.existing_rule("com_github_mjbots_bazel_deps"):
         bazel_deps_repository(name = "com_github_mjbots_bazel_deps")
+    if not native.existing_rule("com_github_google_benchmark"):
+        google_benchmark_repository(name = "com_github_google_benchmark")
     if not native.existing_rule("gst-rpicamsrc"):
         gst_rpicamsrc_repository(name = "gst-rpicamsrc")
     if not native.existing_rule("i2c-tools"):
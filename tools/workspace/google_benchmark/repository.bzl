@@ -0,0 +1,25 @@
+# -*- python -*-
+
+# Copyright 2020 Josh Pieper, jjp@pobox.com.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+load("//tools/workspace:github_archive.bzl", "github_archive")
+
+def google_benchmark_repository(name):
+    # v1.5.2, whose archive includes its own BUILD file.
+    github_archive(
+        name = name,
+        repo = "google/benchmark",
+        commit = "73d4d5e8d6d449fc8663765a42aa8aeeee844489",
+    )
@@ -0,0 +1,577 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utils/column_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/base/json5_write_archive.h"
+#include "mjlib/base/system_error.h"
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/telemetry/file_reader.h"
+
+#include "base/system_fd.h"
+#include "base/system_mmap.h"
+
+#include "utils/leaf_tree.h"
+
+namespace fs = boost::filesystem;
+
+namespace mjmech {
+namespace utils {
+
+namespace {
+using FileReader = mjlib::telemetry::FileReader;
+
+// Increment this whenever the file layout, or the value any leaf
+// decodes to, changes.
+constexpr uint64_t kVersion = 1;
+constexpr char kMagic[8] = {'T', 'P', 'L', 'T', 'C', 'O', 'L', 'S'};
+
+/// The fixed portion at the very start of the file.  Everything after
+/// it is 8 byte aligned column data, followed by a JSON directory.
+struct Header {
+  char magic[8] = {};
+  uint64_t version = 0;
+  uint64_t source_size = 0;
+  int64_t source_mtime = 0;
+  int64_t log_start_us = 0;
+  uint64_t directory_offset = 0;
+  uint64_t directory_size = 0;
+};
+
+struct StoredColumn {
+  std::string name;
+  uint64_t offset = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(name));
+    a->Visit(MJ_NVP(offset));
+  }
+};
+
+struct StoredRecord {
+  std::string name;
+  uint64_t rows = 0;
+  uint64_t timestamps_offset = 0;
+  std::vector<StoredColumn> columns;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(name));
+    a->Visit(MJ_NVP(rows));
+    a->Visit(MJ_NVP(timestamps_offset));
+    a->Visit(MJ_NVP(columns));
+  }
+};
+
+struct StoredDirectory {
+  std::vector<StoredRecord> records;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(records));
+  }
+};
+
+int64_t ToEpochMicroseconds(boost::posix_time::ptime timestamp) {
+  static const boost::posix_time::ptime kEpoch(
+      boost::gregorian::date(1970, 1, 1));
+  return (timestamp - kEpoch).total_microseconds();
+}
+
+uint64_t Align(uint64_t offset) {
+  return (offset + 7) & ~static_cast<uint64_t>(7);
+}
+
+struct Cancelled : std::runtime_error {
+  Cancelled() : std::runtime_error("cancelled") {}
+};
+
+/// A contiguous range of items in the log file.  An empty start is
+/// the beginning of the file, and an empty end is the end.
+struct Region {
+  std::optional<FileReader::Index> start;
+  std::optional<FileReader::Index> end;
+};
+
+/// What pass 1 found in one region for one record.
+struct RegionRecord {
+  uint64_t rows = 0;
+  std::unique_ptr<LeafNode> root;
+};
+
+using RegionResult = std::map<std::string, RegionRecord>;
+
+/// Everything about one record needed for pass 2.
+struct LayoutRecord {
+  std::unique_ptr<LeafNode> root;
+  uint64_t rows = 0;
+
+  // The first row written by each region.
+  std::vector<uint64_t> region_start;
+
+  int64_t* timestamps = nullptr;
+  std::vector<double*> columns;
+};
+}
+
+class ColumnCache::Impl {
+ public:
+  Impl(const std::string& log_filename, const Options& options)
+      : log_filename_(log_filename),
+        filename_(options.filename.empty() ?
+                  (log_filename + kExtension) : options.filename),
+        options_(options),
+        threads_(options.threads > 0 ? options.threads :
+                 std::max(1u, std::thread::hardware_concurrency())) {
+    thread_ = std::thread([this]() { Run(); });
+  }
+
+  ~Impl() {
+    stop_ = true;
+    thread_.join();
+  }
+
+  void Run() {
+    boost::system::error_code ec;
+    source_size_ = fs::file_size(log_filename_, ec);
+    if (!ec) { source_mtime_ = fs::last_write_time(log_filename_, ec); }
+
+    // The cache is purely an optimization, so failing to read or
+    // write it is not an error.
+    if (!ec) {
+      try {
+        if (options_.rebuild || !Open()) {
+          Build();
+          Open();
+        }
+      } catch (Cancelled&) {
+      } catch (std::exception& e) {
+        std::cerr << "tplot2: column cache unavailable: " << e.what() << "\n";
+        records_.clear();
+        mmap_ = {};
+      }
+    }
+
+    ready_.store(true, std::memory_order_release);
+  }
+
+  bool Open() {
+    base::SystemFd fd{::open(filename_.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd < 0) { return false; }
+
+    struct stat st = {};
+    if (::fstat(fd, &st) < 0) { return false; }
+    const uint64_t size = st.st_size;
+    if (size < sizeof(Header)) { return false; }
+
+    base::SystemMmap mmap(fd, size, 0, PROT_READ);
+    const char* const base = static_cast<const char*>(mmap.ptr());
+
+    Header header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion ||
+        header.source_size != source_size_ ||
+        header.source_mtime != source_mtime_ ||
+        header.directory_offset + header.directory_size != size) {
+      return false;
+    }
+
+    StoredDirectory directory;
+    try {
+      directory = mjlib::base::Json5ReadArchive::Read<StoredDirectory>(
+          std::string(base + header.directory_offset,
+                      header.directory_size));
+    } catch (std::exception&) {
+      return false;
+    }
+
+    std::map<std::string, Record, std::less<>> records;
+    for (const auto& stored : directory.records) {
+      auto in_bounds = [&](uint64_t offset, uint64_t element_size) {
+        return offset + stored.rows * element_size <= header.directory_offset;
+      };
+      if (!in_bounds(stored.timestamps_offset, sizeof(int64_t))) {
+        return false;
+      }
+
+      Record& record = records[stored.name];
+      record.rows = stored.rows;
+      record.timestamps_us = reinterpret_cast<const int64_t*>(
+          base + stored.timestamps_offset);
+      for (const auto& column : stored.columns) {
+        if (!in_bounds(column.offset, sizeof(double))) { return false; }
+        record.columns.insert(
+            std::make_pair(column.name, reinterpret_cast<const double*>(
+                               base + column.offset)));
+      }
+    }
+
+    log_start_ = mjlib::base::ConvertEpochMicrosecondsToPtime(
+        header.log_start_us);
+    records_ = std::move(records);
+    mmap_ = std::move(mmap);
+    return true;
+  }
+
+  /// Split the log into regions of about equal duration, at item
+  /// boundaries.
+  std::vector<Region> MakeRegions(FileReader* reader, size_t count) {
+    const auto start = log_start_;
+    auto final_items = reader->items([&]() {
+        FileReader::ItemsOptions options;
+        options.start = reader->final_item();
+        return options;
+      }());
+    const auto final_it = final_items.begin();
+    if (final_it == final_items.end()) { return {Region{}}; }
+    const auto end = (*final_it).timestamp;
+
+    std::vector<FileReader::Index> splits;
+    for (size_t i = 1; i < count; i++) {
+      const auto seek = reader->Seek(start + (end - start) * i / count);
+      if (seek.empty()) { continue; }
+      const auto index = std::max_element(
+          seek.begin(), seek.end(),
+          [](const auto& lhs, const auto& rhs) {
+            return lhs.second < rhs.second;
+          })->second;
+      if (splits.empty() || splits.back() < index) {
+        splits.push_back(index);
+      }
+    }
+
+    std::vector<Region> result(splits.size() + 1);
+    for (size_t i = 0; i < splits.size(); i++) {
+      result[i].end = splits[i];
+      result[i + 1].start = splits[i];
+    }
+    return result;
+  }
+
+  /// Call @p handler(thread, region, item) for every item in the log.
+  /// Regions are handed out to threads_ threads in turn, and each
+  /// thread reads through its own FileReader.
+  template <typename Handler>
+  void ForEachItem(Handler handler) {
+    std::atomic<size_t> next_region{0};
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(threads_);
+
+    for (size_t thread = 0; thread < threads_; thread++) {
+      threads.emplace_back([&, thread]() {
+        try {
+          FileReader* const reader = readers_[thread].get();
+          while (true) {
+            const size_t region_index = next_region++;
+            if (region_index >= regions_.size()) { break; }
+
+            const auto& region = regions_[region_index];
+            FileReader::ItemsOptions options;
+            if (region.start) { options.start = *region.start; }
+            for (const auto& item : reader->items(options)) {
+              if (region.end && !(item.index < *region.end)) { break; }
+              if (stop_) { throw Cancelled(); }
+              handler(thread, region_index, item);
+            }
+            regions_done_++;
+          }
+        } catch (...) {
+          errors[thread] = std::current_exception();
+          stop_ = true;
+        }
+      });
+    }
+    for (auto& thread : threads) { thread.join(); }
+
+    // The first thread to fail cancels the others, so report its
+    // error in preference to their cancellation.
+    std::exception_ptr cancelled;
+    for (const auto& error : errors) {
+      if (!error) { continue; }
+      try {
+        std::rethrow_exception(error);
+      } catch (Cancelled&) {
+        cancelled = error;
+      }
+    }
+    if (cancelled) { std::rethrow_exception(cancelled); }
+  }
+
+  void Build() {
+    std::cout << "tplot2: building column cache " << filename_ << "\n";
+
+    // Every thread reads through its own FileReader, which stays
+    // open until the build finishes, since the decode trees refer to
+    // its schema.
+    readers_.clear();
+    for (size_t i = 0; i < threads_; i++) {
+      readers_.push_back(std::make_unique<FileReader>(log_filename_));
+    }
+
+    auto items = readers_.front()->items();
+    const auto first = items.begin();
+    // An empty log leaves the cache empty, and so not valid.
+    if (first == items.end()) { return; }
+    log_start_ = (*first).timestamp;
+    regions_ = MakeRegions(readers_.front().get(), 4 * threads_);
+    regions_total_ = 2 * regions_.size();
+
+    // Pass 1: find every column, and count the rows of each record
+    // in each region.
+    std::vector<RegionResult> region_results(regions_.size());
+    ForEachItem([&](size_t, size_t region_index, const FileReader::Item& item) {
+        auto& region_record = region_results[region_index][item.record->name];
+        if (!region_record.root) {
+          region_record.root = std::make_unique<LeafNode>(
+              item.record->schema->root());
+        }
+        mjlib::base::BufferReadStream stream{item.data};
+        DiscoverLeaves visitor;
+        WalkLeaves(region_record.root.get(), stream, log_start_, visitor);
+        region_record.rows++;
+      });
+
+    // Merge the regions, in order, so that each record's rows are
+    // laid out in file order.
+    std::map<std::string, LayoutRecord> layout;
+    for (size_t region_index = 0; region_index < regions_.size();
+         region_index++) {
+      for (auto& pair : region_results[region_index]) {
+        auto& record = layout[pair.first];
+        if (!record.root) {
+          record.root = std::make_unique<LeafNode>(pair.second.root->element);
+          record.region_start.resize(regions_.size());
+        }
+        record.region_start[region_index] = record.rows;
+        record.rows += pair.second.rows;
+        MergeLeaves(record.root.get(), std::move(pair.second.root));
+      }
+    }
+    region_results.clear();
+
+    // Lay out the columns, then the directory.
+    StoredDirectory directory;
+    uint64_t offset = Align(sizeof(Header));
+    for (auto& pair : layout) {
+      auto& record = pair.second;
+      directory.records.push_back({});
+      auto& stored = directory.records.back();
+      stored.name = pair.first;
+      stored.rows = record.rows;
+      stored.timestamps_offset = offset;
+      offset += record.rows * sizeof(int64_t);
+
+      std::vector<std::string> names;
+      NumberLeaves(record.root.get(), "", &names);
+      for (const auto& name : names) {
+        stored.columns.push_back({name, offset});
+        offset += record.rows * sizeof(double);
+      }
+    }
+    const std::string directory_json =
+        mjlib::base::Json5WriteArchive::Write(directory);
+
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.source_size = source_size_;
+    header.source_mtime = source_mtime_;
+    header.log_start_us = ToEpochMicroseconds(log_start_);
+    header.directory_offset = offset;
+    header.directory_size = directory_json.size();
+    const uint64_t total_size = offset + directory_json.size();
+
+    // Write to a temporary file and rename it into place, so that a
+    // concurrent or interrupted build never leaves a partial cache.
+    // The file starts zero filled, which is the value of any array
+    // element an item does not have.
+    const auto temp_filename =
+        fs::unique_path(filename_ + ".%%%%%%%%").string();
+    try {
+      {
+        base::SystemFd fd{::open(temp_filename.c_str(),
+                                 O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                 0644)};
+        mjlib::base::system_error::throw_if(fd < 0, temp_filename);
+        mjlib::base::system_error::throw_if(
+            ::ftruncate(fd, total_size) < 0, temp_filename);
+
+        base::SystemMmap mmap(fd, total_size, 0);
+        char* const base = static_cast<char*>(mmap.ptr());
+
+        auto stored = directory.records.begin();
+        for (auto& pair : layout) {
+          auto& record = pair.second;
+          record.timestamps =
+              reinterpret_cast<int64_t*>(base + stored->timestamps_offset);
+          for (const auto& column : stored->columns) {
+            record.columns.push_back(
+                reinterpret_cast<double*>(base + column.offset));
+          }
+          ++stored;
+        }
+
+        // Pass 2: store every value.  Each region writes its own
+        // rows, so no locking is needed.
+        struct Cursor {
+          size_t region = std::numeric_limits<size_t>::max();
+          std::map<const LayoutRecord*, uint64_t> rows;
+        };
+        std::vector<Cursor> cursors(threads_);
+        ForEachItem([&](size_t thread, size_t region_index,
+                        const FileReader::Item& item) {
+            auto& cursor = cursors[thread];
+            if (cursor.region != region_index) {
+              cursor.region = region_index;
+              cursor.rows.clear();
+            }
+
+            auto& record = layout.at(item.record->name);
+            const auto it = cursor.rows.insert(
+                std::make_pair(&record,
+                               record.region_start[region_index])).first;
+            const uint64_t row = it->second++;
+
+            record.timestamps[row] = ToEpochMicroseconds(item.timestamp);
+
+            mjlib::base::BufferReadStream stream{item.data};
+            StoreLeaves visitor;
+            visitor.columns = record.columns.data();
+            visitor.row = row;
+            WalkLeaves(record.root.get(), stream, log_start_, visitor);
+          });
+
+        std::memcpy(base + offset, directory_json.data(),
+                    directory_json.size());
+        std::memcpy(base, &header, sizeof(header));
+      }
+      fs::rename(temp_filename, filename_);
+    } catch (...) {
+      boost::system::error_code ec;
+      fs::remove(temp_filename, ec);
+      throw;
+    }
+
+    layout.clear();
+    readers_.clear();
+  }
+
+  std::optional<Series> Find(std::string_view record_name,
+                             std::string_view name) const {
+    if (!ready_.load(std::memory_order_acquire)) { return {}; }
+
+    const auto it = records_.find(record_name);
+    if (it == records_.end()) { return {}; }
+    const auto& record = it->second;
+
+    Series result;
+    result.size = record.rows;
+    result.timestamps_us = record.timestamps_us;
+    if (name.empty()) { return result; }
+
+    const auto column_it = record.columns.find(std::string(name));
+    if (column_it == record.columns.end()) { return {}; }
+    result.values = column_it->second;
+    return result;
+  }
+
+  struct Record {
+    uint64_t rows = 0;
+    const int64_t* timestamps_us = nullptr;
+    std::unordered_map<std::string, const double*> columns;
+  };
+
+  const std::string log_filename_;
+  const std::string filename_;
+  const Options options_;
+  const size_t threads_;
+
+  uint64_t source_size_ = 0;
+  int64_t source_mtime_ = 0;
+
+  // Only used while building.
+  std::vector<std::unique_ptr<FileReader>> readers_;
+  std::vector<Region> regions_;
+
+  std::atomic<bool> stop_{false};
+  std::atomic<size_t> regions_done_{0};
+  std::atomic<size_t> regions_total_{0};
+
+  // These are written by the background thread, and only read once
+  // ready_ is set.
+  base::SystemMmap mmap_;
+  boost::posix_time::ptime log_start_;
+  std::map<std::string, Record, std::less<>> records_;
+
+  std::atomic<bool> ready_{false};
+
+  // Last, so that everything above exists when it starts.
+  std::thread thread_;
+};
+
+ColumnCache::ColumnCache(const std::string& log_filename,
+                         const Options& options)
+    : impl_(std::make_unique<Impl>(log_filename, options)) {}
+
+ColumnCache::~ColumnCache() {}
+
+bool ColumnCache::ready() const {
+  return impl_->ready_.load(std::memory_order_acquire);
+}
+
+bool ColumnCache::valid() const {
+  return ready() && !impl_->records_.empty();
+}
+
+double ColumnCache::progress() const {
+  if (ready()) { return 1.0; }
+  const size_t total = impl_->regions_total_;
+  if (total == 0) { return 0.0; }
+  return std::min(1.0, static_cast<double>(impl_->regions_done_) / total);
+}
+
+boost::posix_time::ptime ColumnCache::log_start() const {
+  return impl_->log_start_;
+}
+
+std::optional<ColumnCache::Series> ColumnCache::Find(
+    std::string_view record, std::string_view name) const {
+  return impl_->Find(record, name);
+}
+
+}
+}
@@ -0,0 +1,106 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace mjmech {
+namespace utils {
+
+/// A columnar copy of every numeric leaf in a telemetry log, stored
+/// in a memory mapped sidecar file next to the log.
+///
+/// Each record gets one column of timestamps, plus one float64 column
+/// for each scalar field, named with the same dotted tokens that the
+/// tree view produces.  Values match what tplot2 decodes from the log
+/// directly: booleans are 0 or 1, durations are in seconds,
+/// timestamps are seconds since the first item in the log, array
+/// elements absent from a given item are 0, and fields beneath a null
+/// optional are NaN.  Strings, bytes, and maps are not stored.
+///
+/// The file is built in the background with two passes over the log
+/// the first time it is opened, and reused as long as the log's size
+/// and modification time are unchanged.  Each pass splits the log
+/// into time regions at item boundaries and decodes them on several
+/// threads, each with its own FileReader.
+class ColumnCache {
+ public:
+  struct Options {
+    /// If empty, the cache is stored at the log filename with
+    /// kExtension appended.
+    std::string filename;
+
+    /// Always rebuild, even if an up to date cache exists.
+    bool rebuild = false;
+
+    /// The number of decode threads to build with.  0 uses one per
+    /// hardware thread.
+    size_t threads = 0;
+  };
+
+  static constexpr const char* kExtension = ".tplot2cache";
+
+  /// Start opening or building the cache for @p log_filename on a
+  /// background thread.  Any failure leaves the cache empty, in which
+  /// case valid() is false and every lookup fails.
+  ColumnCache(const std::string& log_filename, const Options& options);
+
+  /// Cancels any build in progress.
+  ~ColumnCache();
+
+  /// True once the cache has been opened or built, or has failed.
+  /// Until then, every lookup fails.
+  bool ready() const;
+
+  /// True when ready() and the cache has records.
+  bool valid() const;
+
+  /// The fraction of the build which is complete, from 0 to 1.
+  double progress() const;
+
+  /// The timestamp of the first item in the log, which timestamp
+  /// fields are relative to.  Only meaningful once ready().
+  boost::posix_time::ptime log_start() const;
+
+  struct Series {
+    size_t size = 0;
+
+    /// Microseconds since the epoch.
+    const int64_t* timestamps_us = nullptr;
+
+    /// nullptr when only the timestamps were requested.
+    const double* values = nullptr;
+  };
+
+  /// Look up one field of @p record, where @p name is the token with
+  /// the record name removed.  An empty @p name returns just the
+  /// timestamps.  Both pointers reference the mapped file, and remain
+  /// valid for the life of this object.
+  std::optional<Series> Find(std::string_view record,
+                             std::string_view name) const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -0,0 +1,247 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/telemetry/binary_schema_parser.h"
+
+namespace mjmech {
+namespace utils {
+
+/// Mirrors the layout of one record's schema, with array elements
+/// added as they are first seen.  Each scalar leaf owns a column.
+///
+/// Leaves decode to the same values tplot2 plots: booleans are 0 or
+/// 1, durations are in seconds, timestamps are seconds since
+/// log_start, and fields beneath a null optional are NaN.
+struct LeafNode {
+  using Element = mjlib::telemetry::BinarySchemaParser::Element;
+  using FT = mjlib::telemetry::Format::Type;
+
+  explicit LeafNode(const Element* element_in) : element(element_in) {}
+
+  const Element* element = nullptr;
+  int column = -1;
+  std::vector<std::unique_ptr<LeafNode>> children;
+};
+
+inline bool IsOptionalElement(const LeafNode::Element* element) {
+  using FT = LeafNode::FT;
+  return element->children.size() == 2 &&
+      element->children.front()->type == FT::kNull;
+}
+
+/// Decode one item against a LeafNode tree.  The Visitor decides
+/// whether missing nodes are created, and what happens to each leaf
+/// value.
+template <typename Visitor>
+void WalkLeaves(LeafNode* node, mjlib::base::BufferReadStream& stream,
+                boost::posix_time::ptime log_start, Visitor& visitor) {
+  using FT = LeafNode::FT;
+  const LeafNode::Element* const element = node->element;
+  auto walk_child = [&](size_t index, const LeafNode::Element* child_element) {
+    LeafNode* const child = visitor.Child(node, index, child_element);
+    if (child) {
+      WalkLeaves(child, stream, log_start, visitor);
+    } else {
+      child_element->Ignore(stream);
+    }
+  };
+
+  switch (element->type) {
+    case FT::kFinal:
+    case FT::kNull: {
+      visitor.Leaf(node, std::numeric_limits<double>::quiet_NaN());
+      return;
+    }
+    case FT::kBoolean: {
+      visitor.Leaf(node, element->ReadBoolean(stream) ? 1.0 : 0.0);
+      return;
+    }
+    case FT::kFixedInt:
+    case FT::kVarint: {
+      visitor.Leaf(node, element->ReadIntLike(stream));
+      return;
+    }
+    case FT::kFixedUInt:
+    case FT::kVaruint: {
+      visitor.Leaf(node, element->ReadUIntLike(stream));
+      return;
+    }
+    case FT::kFloat32:
+    case FT::kFloat64: {
+      visitor.Leaf(node, element->ReadFloatLike(stream));
+      return;
+    }
+    case FT::kDuration: {
+      visitor.Leaf(node, element->ReadIntLike(stream) / 1000000.0);
+      return;
+    }
+    case FT::kTimestamp: {
+      visitor.Leaf(node, mjlib::base::ConvertDurationToSeconds(
+                       mjlib::base::ConvertEpochMicrosecondsToPtime(
+                           element->ReadIntLike(stream)) - log_start));
+      return;
+    }
+    case FT::kEnum: {
+      visitor.Leaf(node, element->children.front()->ReadUIntLike(stream));
+      return;
+    }
+    case FT::kBytes:
+    case FT::kString:
+    case FT::kMap: {
+      element->Ignore(stream);
+      return;
+    }
+    case FT::kObject: {
+      for (size_t i = 0; i < element->fields.size(); i++) {
+        walk_child(i, element->fields[i].element);
+      }
+      return;
+    }
+    case FT::kArray:
+    case FT::kFixedArray: {
+      const uint64_t size =
+          (element->type == FT::kArray) ?
+          element->ReadArraySize(stream) : element->array_size;
+      const auto* child = element->children.front();
+      for (uint64_t i = 0; i < size; i++) {
+        walk_child(i, child);
+      }
+      return;
+    }
+    case FT::kUnion: {
+      // Like tplot2's plots, only optionals are supported.
+      if (!IsOptionalElement(element)) {
+        element->Ignore(stream);
+        return;
+      }
+      const auto union_index = element->ReadUnionIndex(stream);
+      if (union_index == 0) {
+        visitor.Null(node);
+        return;
+      }
+      walk_child(0, element->children[1]);
+      return;
+    }
+  }
+}
+
+/// Creates nodes for everything seen, and marks each leaf with a
+/// placeholder column.
+struct DiscoverLeaves {
+  LeafNode* Child(LeafNode* node, size_t index, const LeafNode::Element* element) {
+    while (node->children.size() <= index) {
+      node->children.push_back(std::make_unique<LeafNode>(element));
+    }
+    return node->children[index].get();
+  }
+
+  void Leaf(LeafNode* node, double) {
+    node->column = 0;
+  }
+
+  void Null(LeafNode*) {}
+};
+
+/// Writes values into the columns of an existing tree, at one row.
+struct StoreLeaves {
+  LeafNode* Child(LeafNode* node, size_t index, const LeafNode::Element*) {
+    return index < node->children.size() ? node->children[index].get() :
+        nullptr;
+  }
+
+  void Leaf(LeafNode* node, double value) {
+    if (node->column >= 0) { columns[node->column][row] = value; }
+  }
+
+  void Null(LeafNode* node) {
+    for (auto& child : node->children) { FillNaN(child.get()); }
+  }
+
+  void FillNaN(LeafNode* node) {
+    Leaf(node, std::numeric_limits<double>::quiet_NaN());
+    for (auto& child : node->children) { FillNaN(child.get()); }
+  }
+
+  double* const* columns = nullptr;
+  uint64_t row = 0;
+};
+
+/// Add everything in @p src to @p dst.
+inline void MergeLeaves(LeafNode* dst, std::unique_ptr<LeafNode> src) {
+  if (src->column >= 0) { dst->column = 0; }
+  for (size_t i = 0; i < src->children.size(); i++) {
+    if (i >= dst->children.size()) {
+      dst->children.push_back(std::move(src->children[i]));
+    } else {
+      MergeLeaves(dst->children[i].get(), std::move(src->children[i]));
+    }
+  }
+}
+
+/// Assign columns in tree order, and return their names.
+inline void NumberLeaves(LeafNode* node, const std::string& prefix,
+                         std::vector<std::string>* names) {
+  using FT = LeafNode::FT;
+  auto join = [&](const std::string& name) {
+    return prefix.empty() ? name : (prefix + "." + name);
+  };
+
+  if (node->column >= 0) {
+    node->column = names->size();
+    names->push_back(prefix);
+  }
+
+  const LeafNode::Element* const element = node->element;
+  switch (element->type) {
+    case FT::kObject: {
+      for (size_t i = 0; i < node->children.size(); i++) {
+        NumberLeaves(node->children[i].get(),
+                     join(element->fields[i].name), names);
+      }
+      break;
+    }
+    case FT::kArray:
+    case FT::kFixedArray: {
+      for (size_t i = 0; i < node->children.size(); i++) {
+        NumberLeaves(node->children[i].get(), join(std::to_string(i)), names);
+      }
+      break;
+    }
+    case FT::kUnion: {
+      // Optionals do not contribute a token of their own.
+      for (const auto& child : node->children) {
+        NumberLeaves(child.get(), prefix, names);
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+}
+}
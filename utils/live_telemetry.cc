@@ -0,0 +1,338 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utils/live_telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <map>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/base/json5_write_archive.h"
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/telemetry/binary_schema_parser.h"
+
+#include "base/telemetry_stream_frame.h"
+
+#include "utils/leaf_tree.h"
+
+namespace mjmech {
+namespace utils {
+
+namespace {
+using udp = boost::asio::ip::udp;
+
+/// The server drops streams which are not renewed, by default after
+/// 10s.
+constexpr auto kRenewPeriod = std::chrono::seconds(2);
+
+constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
+
+/// Records the value of every leaf in one item, adding nodes as they
+/// are first seen.
+struct CollectLeaves {
+  LeafNode* Child(LeafNode* node, size_t index,
+                  const LeafNode::Element* element) {
+    while (node->children.size() <= index) {
+      node->children.push_back(std::make_unique<LeafNode>(element));
+    }
+    return node->children[index].get();
+  }
+
+  void Leaf(LeafNode* node, double value) {
+    if (node->column < 0) {
+      node->column = 0;
+      changed = true;
+    }
+    values.push_back({node, value});
+  }
+
+  void Null(LeafNode* node) {
+    for (auto& child : node->children) { FillNaN(child.get()); }
+  }
+
+  void FillNaN(LeafNode* node) {
+    if (node->column >= 0) { values.push_back({node, kNaN}); }
+    for (auto& child : node->children) { FillNaN(child.get()); }
+  }
+
+  bool changed = false;
+  std::vector<std::pair<LeafNode*, double>> values;
+};
+
+struct Command {
+  std::string command;
+  std::vector<std::string> names;
+  double rate_hz = 0.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(command));
+    a->Visit(MJ_NVP(names));
+    a->Visit(MJ_NVP(rate_hz));
+  }
+};
+
+struct Reply {
+  std::string type;
+  std::vector<std::string> names;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(type));
+    a->Visit(MJ_NVP(names));
+  }
+};
+}
+
+class LiveTelemetry::Impl {
+ public:
+  Impl(const Options& options)
+      : options_(options),
+        names_(options.records),
+        server_(boost::asio::ip::make_address(options.host), options.port) {
+    socket_.open(udp::v4());
+    socket_.non_blocking(true);
+  }
+
+  void Poll() {
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= next_renew_) {
+      next_renew_ = now + kRenewPeriod;
+      Renew();
+    }
+
+    while (true) {
+      boost::system::error_code ec;
+      udp::endpoint from;
+      const auto size = socket_.receive_from(
+          boost::asio::buffer(receive_buffer_), from, 0, ec);
+      if (ec) { break; }
+      if (from != server_) { continue; }
+
+      HandleDatagram(std::string_view(receive_buffer_, size));
+    }
+  }
+
+  void Renew() {
+    Command command;
+    if (names_.empty()) {
+      command.command = "enumerate";
+    } else {
+      command.command = "stream";
+      command.names = names_;
+      command.rate_hz = options_.rate_hz;
+    }
+
+    const auto data = mjlib::base::Json5WriteArchive::Write(command);
+    boost::system::error_code ec;
+    socket_.send_to(boost::asio::buffer(data), server_, 0, ec);
+  }
+
+  void HandleDatagram(std::string_view data) {
+    if (!data.empty() && data[0] == '{') {
+      HandleReply(data);
+      return;
+    }
+
+    const auto maybe_frame = base::TelemetryStreamFrame::Parse(data);
+    if (!maybe_frame) { return; }
+    const auto& frame = *maybe_frame;
+
+    if (frame.type == base::TelemetryStreamFrame::kSchema) {
+      HandleSchema(frame);
+    } else {
+      HandleData(frame);
+    }
+  }
+
+  void HandleReply(std::string_view data) {
+    Reply reply;
+    try {
+      reply = mjlib::base::Json5ReadArchive::Read<Reply>(std::string(data));
+    } catch (std::exception&) {
+      return;
+    }
+    if (reply.type != "enumerate" || !names_.empty()) { return; }
+
+    names_ = reply.names;
+    next_renew_ = {};
+  }
+
+  void HandleSchema(const base::TelemetryStreamFrame& frame) {
+    auto& record = records_[frame.identifier];
+    // The schema is resent every time the stream is renewed.
+    if (record && record->schema == frame.payload) { return; }
+
+    record = std::make_unique<Record>();
+    record->name = frame.name;
+    record->schema = std::string(frame.payload);
+    record->parser = std::make_unique<mjlib::telemetry::BinarySchemaParser>(
+        record->schema, record->name);
+    record->root = std::make_unique<LeafNode>(record->parser->root());
+    record->time.resize(options_.capacity);
+  }
+
+  void HandleData(const base::TelemetryStreamFrame& frame) {
+    const auto it = records_.find(frame.identifier);
+    if (it == records_.end() || !it->second) { return; }
+    auto& record = *it->second;
+
+    if (start_.is_not_a_date_time()) { start_ = frame.timestamp; }
+
+    collect_.changed = false;
+    collect_.values.clear();
+    try {
+      mjlib::base::BufferReadStream stream{frame.payload};
+      WalkLeaves(record.root.get(), stream, start_, collect_);
+    } catch (std::exception&) {
+      // A datagram which doesn't match its schema is dropped.
+      return;
+    }
+    if (collect_.changed) { Renumber(&record); }
+
+    const size_t row = record.next;
+    record.time[row] =
+        mjlib::base::ConvertDurationToSeconds(frame.timestamp - start_);
+    // Array elements absent from this item read as 0.
+    for (auto& column : record.columns) { column[row] = 0.0; }
+    for (const auto& pair : collect_.values) {
+      record.columns[pair.first->column][row] = pair.second;
+    }
+
+    record.next = (record.next + 1) % options_.capacity;
+    record.count = std::min(record.count + 1, options_.capacity);
+    latest_ = std::max(latest_, record.time[row]);
+  }
+
+  struct Record {
+    std::string name;
+    std::string schema;
+    std::unique_ptr<mjlib::telemetry::BinarySchemaParser> parser;
+    std::unique_ptr<LeafNode> root;
+
+    std::vector<std::string> fields;
+    std::vector<std::vector<double>> columns;
+    std::vector<double> time;
+
+    // The next row to write, and how many are valid.
+    size_t next = 0;
+    size_t count = 0;
+  };
+
+  /// Reassign columns after new leaves appear, keeping the samples
+  /// of existing ones.
+  void Renumber(Record* record) {
+    std::map<std::string, std::vector<double>> old_columns;
+    for (size_t i = 0; i < record->fields.size(); i++) {
+      old_columns[record->fields[i]] = std::move(record->columns[i]);
+    }
+
+    record->fields.clear();
+    NumberLeaves(record->root.get(), "", &record->fields);
+
+    record->columns.clear();
+    for (const auto& field : record->fields) {
+      auto it = old_columns.find(field);
+      if (it != old_columns.end()) {
+        record->columns.push_back(std::move(it->second));
+      } else {
+        // The new leaf was not seen in earlier samples.
+        record->columns.push_back(
+            std::vector<double>(options_.capacity, kNaN));
+      }
+    }
+  }
+
+  const Record* FindRecord(std::string_view name) const {
+    for (const auto& pair : records_) {
+      if (pair.second && pair.second->name == name) {
+        return pair.second.get();
+      }
+    }
+    return nullptr;
+  }
+
+  const Options options_;
+  std::vector<std::string> names_;
+
+  boost::asio::io_context context_;
+  udp::socket socket_{context_};
+  const udp::endpoint server_;
+  char receive_buffer_[65536] = {};
+  std::chrono::steady_clock::time_point next_renew_;
+
+  std::map<uint32_t, std::unique_ptr<Record>> records_;
+  boost::posix_time::ptime start_;
+  double latest_ = 0.0;
+
+  // Reused for each item, so that steady state decoding does not
+  // allocate.
+  CollectLeaves collect_;
+};
+
+LiveTelemetry::LiveTelemetry(const Options& options)
+    : impl_(std::make_unique<Impl>(options)) {}
+
+LiveTelemetry::~LiveTelemetry() {}
+
+void LiveTelemetry::Poll() {
+  impl_->Poll();
+}
+
+double LiveTelemetry::latest() const {
+  return impl_->latest_;
+}
+
+std::vector<std::string> LiveTelemetry::records() const {
+  std::vector<std::string> result;
+  for (const auto& pair : impl_->records_) {
+    if (pair.second) { result.push_back(pair.second->name); }
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+std::vector<std::string> LiveTelemetry::fields(std::string_view name) const {
+  const auto* record = impl_->FindRecord(name);
+  if (!record) { return {}; }
+  return record->fields;
+}
+
+std::optional<LiveTelemetry::Series> LiveTelemetry::Find(
+    std::string_view name, std::string_view field) const {
+  const auto* record = impl_->FindRecord(name);
+  if (!record) { return {}; }
+
+  const auto it = std::find(
+      record->fields.begin(), record->fields.end(), field);
+  if (it == record->fields.end()) { return {}; }
+
+  Series result;
+  result.x = record->time.data();
+  result.y = record->columns[it - record->fields.begin()].data();
+  result.count = record->count;
+  result.offset =
+      (record->count < impl_->options_.capacity) ? 0 : record->next;
+  return result;
+}
+
+}
+}
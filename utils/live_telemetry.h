@@ -0,0 +1,85 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mjmech {
+namespace utils {
+
+/// Receives the binary telemetry stream from a robot's
+/// TelemetryRemoteDebugServer, and keeps the most recent samples of
+/// every numeric leaf in fixed size ring buffers.
+///
+/// Leaves are named and valued just as in ColumnCache, except that
+/// timestamp fields and sample times are in seconds since the first
+/// sample received.
+class LiveTelemetry {
+ public:
+  struct Options {
+    /// An IP address.
+    std::string host;
+    int port = 13380;
+
+    /// If empty, every record the server has is streamed.
+    std::vector<std::string> records;
+
+    /// Requested per record.  The server applies its own limit too.
+    double rate_hz = 100.0;
+
+    /// The number of samples kept for each record.
+    size_t capacity = 20000;
+  };
+
+  LiveTelemetry(const Options&);
+  ~LiveTelemetry();
+
+  /// Handle every datagram which has arrived, and renew the stream
+  /// when due.  This never blocks.
+  void Poll();
+
+  /// Seconds since the first sample, of the latest sample.
+  double latest() const;
+
+  /// The names of the records whose schema has arrived.
+  std::vector<std::string> records() const;
+
+  /// The leaves of @p record seen so far, in schema order.
+  std::vector<std::string> fields(std::string_view record) const;
+
+  /// The samples of one leaf, laid out as ImPlot expects for a ring
+  /// buffer: @p offset is the index of the oldest sample.  The
+  /// pointers are valid until the next Poll.
+  struct Series {
+    const double* x = nullptr;
+    const double* y = nullptr;
+    int count = 0;
+    int offset = 0;
+  };
+
+  std::optional<Series> Find(std::string_view record,
+                             std::string_view field) const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -0,0 +1,125 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <charconv>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/base/visit_archive.h"
+
+namespace mjmech {
+namespace utils {
+
+/// Reads the field named by a dotted token, as rendered by
+/// ImGuiTreeArchive, out of a serializable structure as a double.
+///
+/// Only the fields along the token's path are descended into, and
+/// nothing is formatted as text.  Fields which are missing, or are
+/// not numeric, read as NaN.
+class NumericValueArchive
+    : public mjlib::base::VisitArchive<NumericValueArchive> {
+ public:
+  template <typename Serializable>
+  static double Read(std::string_view token, const Serializable& value) {
+    NumericValueArchive archive(token);
+    archive.Accept(const_cast<Serializable*>(&value));
+    return archive.result_;
+  }
+
+  template <typename NameValuePair>
+  void VisitScalar(const NameValuePair& nvp) {
+    if (!rest_.empty() || head_ != nvp.name()) { return; }
+    result_ = ToDouble(nvp.get_value());
+  }
+
+  template <typename NameValuePair>
+  void VisitSerializable(const NameValuePair& nvp) {
+    if (head_ != nvp.name()) { return; }
+    NumericValueArchive sub_archive(rest_);
+    sub_archive.Accept(nvp.value());
+    result_ = sub_archive.result_;
+  }
+
+  template <typename NameValuePair>
+  void VisitArray(const NameValuePair& nvp) {
+    if (head_ != nvp.name()) { return; }
+
+    const auto index_str = Split(rest_).first;
+    size_t index = 0;
+    const auto parsed = std::from_chars(
+        index_str.data(), index_str.data() + index_str.size(), index);
+    if (parsed.ec != std::errc()) { return; }
+
+    size_t i = 0;
+    for (const auto& item : *nvp.value()) {
+      if (i == index) {
+        NumericValueArchive sub_archive(rest_);
+        sub_archive.Value(index_str, item);
+        result_ = sub_archive.result_;
+        return;
+      }
+      i++;
+    }
+  }
+
+ private:
+  explicit NumericValueArchive(std::string_view token) {
+    std::tie(head_, rest_) = Split(token);
+  }
+
+  template <typename Serializable>
+  void Accept(Serializable* serializable) {
+    mjlib::base::VisitArchive<NumericValueArchive>::Accept(serializable);
+  }
+
+  template <typename ValueType>
+  void Value(std::string_view name, const ValueType& value) {
+    // ReferenceNameValuePair needs a NUL terminated name.
+    name_storage_ = std::string(name);
+    mjlib::base::ReferenceNameValuePair nvp(
+        const_cast<ValueType*>(&value), name_storage_.c_str());
+    mjlib::base::VisitArchive<NumericValueArchive>::Visit(nvp);
+  }
+
+  static std::pair<std::string_view, std::string_view> Split(
+      std::string_view token) {
+    const auto dot = token.find('.');
+    if (dot == std::string_view::npos) { return {token, {}}; }
+    return {token.substr(0, dot), token.substr(dot + 1)};
+  }
+
+  template <typename T>
+  static double ToDouble(const T& value) {
+    if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+      return static_cast<double>(value);
+    } else {
+      return std::numeric_limits<double>::quiet_NaN();
+    }
+  }
+
+  std::string_view head_;
+  std::string_view rest_;
+  std::string name_storage_;
+  double result_ = std::numeric_limits<double>::quiet_NaN();
+};
+
+}
+}
@@ -44,6 +44,7 @@ void AddQuadrupedDerived(mjlib::telemetry::FileReader* file_reader,
         file_reader->record("qc_status")->schema->root());
   tree_view->AddDerived(
       "control_CoM_N",
+      {"qc_control"},
       [qc_reader](const CurrentLogData& data) {
         const auto maybe_d = data.get("qc_control");
         if (!maybe_d) { return Force(); }
@@ -62,6 +63,7 @@ void AddQuadrupedDerived(mjlib::telemetry::FileReader* file_reader,
       });
   tree_view->AddDerived(
       "status_CoM_N",
+      {"qc_control", "qc_status"},
       [qc_reader, qs_reader](const CurrentLogData& data) {
         const auto maybe_c = data.get("qc_control");
         const auto maybe_s = data.get("qc_status");
@@ -0,0 +1,340 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utils/column_cache.h"
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cmath>
+#include <optional>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/file_writer.h"
+#include "mjlib/telemetry/mapped_binary_reader.h"
+
+namespace fs = boost::filesystem;
+using mjmech::utils::ColumnCache;
+using mjlib::telemetry::FileReader;
+
+namespace {
+struct Inner {
+  double v = 0.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(v));
+  }
+};
+
+struct Data {
+  double x = 0.0;
+  bool flag = false;
+  std::vector<double> arr;
+  std::optional<Inner> opt;
+  std::string s;
+  boost::posix_time::ptime t;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(x));
+    a->Visit(MJ_NVP(flag));
+    a->Visit(MJ_NVP(arr));
+    a->Visit(MJ_NVP(opt));
+    a->Visit(MJ_NVP(s));
+    a->Visit(MJ_NVP(t));
+  }
+};
+
+struct Other {
+  int32_t y = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(y));
+  }
+};
+
+const boost::posix_time::ptime kStart(boost::gregorian::date(2020, 1, 1));
+
+/// Write @p count items of record "a", each followed by one of
+/// record "b", 10ms apart.
+void WriteLog(const std::string& filename, int count, double scale = 1.0) {
+  mjlib::telemetry::FileWriter writer;
+  writer.Open(filename);
+
+  const auto a_id = writer.AllocateIdentifier("a");
+  writer.WriteSchema(
+      a_id, mjlib::telemetry::BinarySchemaArchive::schema<Data>());
+  const auto b_id = writer.AllocateIdentifier("b");
+  writer.WriteSchema(
+      b_id, mjlib::telemetry::BinarySchemaArchive::schema<Other>());
+
+  auto write = [&](auto id, auto timestamp, const auto& value) {
+    auto buffer = writer.GetBuffer();
+    mjlib::telemetry::BinaryWriteArchive(*buffer).Accept(&value);
+    writer.WriteData(timestamp, id, std::move(buffer));
+  };
+
+  for (int i = 0; i < count; i++) {
+    const auto timestamp = kStart + boost::posix_time::milliseconds(10 * i);
+
+    Data data;
+    data.x = scale * i;
+    data.flag = (i % 2) == 1;
+    for (int j = 0; j < i % 3; j++) { data.arr.push_back(100 + i + j); }
+    if (i % 2) { data.opt = Inner{-scale * i}; }
+    data.s = "abc";
+    data.t = kStart + boost::posix_time::milliseconds(i);
+    write(a_id, timestamp, data);
+
+    Other other;
+    other.y = 7 * i;
+    write(b_id, timestamp + boost::posix_time::milliseconds(5), other);
+  }
+
+  writer.Close();
+}
+
+void WaitReady(const ColumnCache& cache) {
+  const auto start = std::chrono::steady_clock::now();
+  while (!cache.ready() &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(30)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  BOOST_TEST_REQUIRE(cache.ready());
+}
+
+int64_t ToEpochMicroseconds(boost::posix_time::ptime timestamp) {
+  return (timestamp - boost::posix_time::ptime(
+              boost::gregorian::date(1970, 1, 1))).total_microseconds();
+}
+
+std::vector<FileReader::Item> ReadItems(FileReader* reader,
+                                        const std::string& record) {
+  FileReader::ItemsOptions options;
+  options.records.push_back(record);
+  std::vector<FileReader::Item> result;
+  for (const auto& item : reader->items(options)) {
+    result.push_back(item);
+  }
+  return result;
+}
+
+/// Compare every column of @p cache against decoding @p log_filename
+/// directly.
+void CheckCache(const ColumnCache& cache, const std::string& log_filename) {
+  BOOST_TEST_REQUIRE(cache.valid());
+
+  FileReader reader{log_filename};
+  const auto a_items = ReadItems(&reader, "a");
+  const auto b_items = ReadItems(&reader, "b");
+  BOOST_TEST_REQUIRE(!a_items.empty());
+  BOOST_TEST(cache.log_start() == a_items.front().timestamp);
+
+  const auto timestamps = cache.Find("a", "");
+  BOOST_TEST_REQUIRE(!!timestamps);
+  BOOST_TEST(timestamps->values == nullptr);
+  BOOST_TEST_REQUIRE(timestamps->size == a_items.size());
+
+  auto find = [&](const std::string& name) {
+    const auto result = cache.Find("a", name);
+    BOOST_TEST_REQUIRE(!!result);
+    BOOST_TEST_REQUIRE(result->size == a_items.size());
+    return result->values;
+  };
+  const double* const x = find("x");
+  const double* const flag = find("flag");
+  const double* const arr0 = find("arr.0");
+  const double* const arr1 = find("arr.1");
+  const double* const opt_v = find("opt.v");
+  const double* const t = find("t");
+
+  // Strings are not stored, and no item has a third element.
+  BOOST_TEST(!cache.Find("a", "s"));
+  BOOST_TEST(!cache.Find("a", "arr.2"));
+  BOOST_TEST(!cache.Find("a", "missing"));
+  BOOST_TEST(!cache.Find("missing", ""));
+
+  mjlib::telemetry::MappedBinaryReader<Data> a_reader(
+      reader.record("a")->schema->root());
+  for (size_t i = 0; i < a_items.size(); i++) {
+    const auto data = a_reader.Read(a_items[i].data);
+    BOOST_TEST(timestamps->timestamps_us[i] ==
+               ToEpochMicroseconds(a_items[i].timestamp));
+    BOOST_TEST(x[i] == data.x);
+    BOOST_TEST(flag[i] == (data.flag ? 1.0 : 0.0));
+    BOOST_TEST(arr0[i] == (data.arr.size() > 0 ? data.arr[0] : 0.0));
+    BOOST_TEST(arr1[i] == (data.arr.size() > 1 ? data.arr[1] : 0.0));
+    if (data.opt) {
+      BOOST_TEST(opt_v[i] == data.opt->v);
+    } else {
+      BOOST_TEST(std::isnan(opt_v[i]));
+    }
+    BOOST_TEST(t[i] == mjlib::base::ConvertDurationToSeconds(
+                   data.t - cache.log_start()));
+  }
+
+  const auto y = cache.Find("b", "y");
+  BOOST_TEST_REQUIRE(!!y);
+  BOOST_TEST_REQUIRE(y->size == b_items.size());
+  mjlib::telemetry::MappedBinaryReader<Other> b_reader(
+      reader.record("b")->schema->root());
+  for (size_t i = 0; i < b_items.size(); i++) {
+    BOOST_TEST(y->timestamps_us[i] ==
+               ToEpochMicroseconds(b_items[i].timestamp));
+    BOOST_TEST(y->values[i] == b_reader.Read(b_items[i].data).y);
+  }
+}
+
+ino_t Inode(const std::string& filename) {
+  struct stat st = {};
+  BOOST_TEST_REQUIRE(::stat(filename.c_str(), &st) == 0);
+  return st.st_ino;
+}
+
+class Fixture {
+ public:
+  Fixture()
+      : directory_(fs::temp_directory_path() /
+                   fs::unique_path("column_cache_%%%%%%%%")) {
+    fs::create_directories(directory_);
+  }
+
+  ~Fixture() {
+    fs::remove_all(directory_);
+  }
+
+  std::string log() const { return (directory_ / "test.log").string(); }
+  std::string cache() const { return log() + ColumnCache::kExtension; }
+
+ private:
+  const fs::path directory_;
+};
+}
+
+BOOST_FIXTURE_TEST_CASE(ColumnCacheMatchesLog, Fixture) {
+  WriteLog(log(), 300);
+
+  // A single thread builds one region, and several split the log
+  // into many.
+  for (const size_t threads : {1, 3}) {
+    ColumnCache::Options options;
+    options.threads = threads;
+    options.rebuild = true;
+    ColumnCache dut{log(), options};
+    WaitReady(dut);
+    BOOST_TEST(dut.progress() == 1.0);
+    CheckCache(dut, log());
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(ColumnCacheReuse, Fixture) {
+  WriteLog(log(), 100);
+
+  ColumnCache::Options options;
+  options.threads = 2;
+
+  {
+    ColumnCache dut{log(), options};
+    WaitReady(dut);
+    CheckCache(dut, log());
+  }
+  const auto built = Inode(cache());
+
+  // An up to date cache is opened rather than rebuilt.  A rebuild
+  // always renames a new file into place.
+  {
+    ColumnCache dut{log(), options};
+    WaitReady(dut);
+    CheckCache(dut, log());
+  }
+  BOOST_TEST(Inode(cache()) == built);
+}
+
+BOOST_FIXTURE_TEST_CASE(ColumnCacheRejectsTruncated, Fixture) {
+  WriteLog(log(), 100);
+
+  ColumnCache::Options options;
+  options.threads = 2;
+
+  {
+    ColumnCache dut{log(), options};
+    WaitReady(dut);
+  }
+  const auto full_size = fs::file_size(cache());
+
+  // Cut off in the column data, and then within the header.
+  for (const uintmax_t size : {full_size / 2, uintmax_t{4}}) {
+    fs::resize_file(cache(), size);
+    const auto truncated = Inode(cache());
+
+    ColumnCache dut{log(), options};
+    WaitReady(dut);
+    CheckCache(dut, log());
+    BOOST_TEST(Inode(cache()) != truncated);
+    BOOST_TEST(fs::file_size(cache()) == full_size);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(ColumnCacheRejectsStale, Fixture) {
+  WriteLog(log(), 100);
+
+  ColumnCache::Options options;
+  options.threads = 2;
+
+  {
+    ColumnCache dut{log(), options};
+    WaitReady(dut);
+  }
+
+  // A log with different contents must not be served the old
+  // columns.
+  WriteLog(log(), 150, 2.0);
+  {
+    ColumnCache dut{log(), options};
+    WaitReady(dut);
+    CheckCache(dut, log());
+    BOOST_TEST(dut.Find("a", "x")->size == 150);
+  }
+
+  // Only the modification time changing is enough to rebuild.
+  const auto built = Inode(cache());
+  fs::last_write_time(log(), fs::last_write_time(log()) + 10);
+  {
+    ColumnCache dut{log(), options};
+    WaitReady(dut);
+    CheckCache(dut, log());
+  }
+  BOOST_TEST(Inode(cache()) != built);
+}
+
+BOOST_FIXTURE_TEST_CASE(ColumnCacheEmptyLog, Fixture) {
+  WriteLog(log(), 0);
+
+  ColumnCache::Options options;
+  options.threads = 2;
+  ColumnCache dut{log(), options};
+  WaitReady(dut);
+  BOOST_TEST(!dut.valid());
+  BOOST_TEST(!dut.Find("a", ""));
+  BOOST_TEST(!dut.Find("a", "x"));
+}
@@ -38,6 +38,7 @@
 
 
 #include <fstream>
+#include <set>
 #include <string>
 #include <variant>
 
@@ -49,6 +50,7 @@
 #include <implot.h>
 
 #include "base/aspect_ratio.h"
+#include "base/min_max_pyramid.h"
 
 #include "mjlib/base/buffer_stream.h"
 #include "mjlib/base/clipp.h"
@@ -83,6 +85,8 @@
 #include "mech/attitude_data.h"
 #include "mech/quadruped_control.h"
 
+#include "utils/column_cache.h"
+#include "utils/live_telemetry.h"
 #include "utils/quadruped_tplot2.h"
 #include "utils/tree_view.h"
 
@@ -414,6 +418,10 @@ class PlotRetrieve {
     return y_(item);
   }
 
+  const std::string& record() const { return root_.record; }
+  const std::string& x_name() const { return root_.x_name; }
+  const std::string& y_name() const { return root_.y_name; }
+
   FileReader::ItemsOptions items() const {
     FileReader::ItemsOptions result;
     result.records.push_back(root_.record);
@@ -518,36 +526,26 @@ class PlotView {
 
   PlotView(FileReader* reader,
            TreeView* tree_view,
+           const ColumnCache* column_cache,
            boost::posix_time::ptime log_start,
            const State& initial)
       : reader_(reader),
         tree_view_(tree_view),
+        column_cache_(column_cache),
         log_start_(log_start) {
-    for (const auto& plot : initial.plots) {
-      current_axis_ = plot.axis;
-      if (plot.deriv) {
-        AddDerivPlot(plot.y_token);
-      } else {
-        AddLogPlot(plot.x_token, plot.y_token);
-      }
-    }
-
-    if (std::isfinite(initial.x_axis.min) &&
-        std::isfinite(initial.x_axis.max)) {
-      ImPlot::SetNextPlotLimitsX(
-          initial.x_axis.min, initial.x_axis.max, ImGuiCond_Always);
-    }
-    for (size_t i = 0; i < initial.y_axis.size(); i++) {
-      const auto& y = initial.y_axis[i];
-      if (std::isfinite(y.min) && std::isfinite(y.max)) {
-        ImPlot::SetNextPlotLimitsY(y.min, y.max, ImGuiCond_Always, i);
-      }
+    // Saved plots are read from the column cache once it is ready, so
+    // that a large log opens without waiting on the cache build.
+    if (column_cache_ && !column_cache_->ready()) {
+      pending_ = initial;
+    } else {
+      Restore(initial);
     }
-
-    fit_plot_ = {};
   }
 
   State state() {
+    // Keep the saved plots if the cache never became ready.
+    if (pending_) { return *pending_; }
+
     State result;
     for (const auto& plot : plots_) {
       State::Plot out;
@@ -577,6 +575,14 @@ class PlotView {
     ImGui::SetNextWindowSize(ImVec2(800, 620), ImGuiCond_FirstUseEver);
     gl::ImGuiWindow file_window("Plot");
 
+    if (column_cache_ && !column_cache_->ready()) {
+      ImGui::ProgressBar(column_cache_->progress(), ImVec2(-1, 0),
+                         "Indexing log");
+    } else if (pending_) {
+      Restore(*pending_);
+      pending_.reset();
+    }
+
     if (fit_plot_) {
       const auto& p = **fit_plot_;
       double xmin = std::numeric_limits<float>::infinity();
@@ -600,6 +606,11 @@ class PlotView {
       }
       return result;
     }();
+
+    // Draw about one min/max pair per pixel column, using the limits
+    // from the previous frame.
+    const size_t max_points = 2 * static_cast<size_t>(
+        std::max(1.0f, ImGui::GetContentRegionAvail().x));
     if (ImPlot::BeginPlot("Plot", "time", nullptr, ImVec2(-1, -25),
                          ImPlotFlags_Default | extra_flags)) {
       for (const auto& plot : plots_) {
@@ -610,10 +621,10 @@ class PlotView {
         for (const auto& pair : plot.int_styles) {
           ImPlot::PushStyleVar(pair.first, pair.second);
         }
-        ImPlot::PlotLine(
-            plot.legend.c_str(),
-            plot.xvals.data(), plot.yvals.data(),
-            plot.xvals.size());
+        const auto view = plot.lod.Select(
+            plot.xvals.data(), plot.yvals.data(), plot.xvals.size(),
+            x_limits_.X.Min, x_limits_.X.Max, max_points);
+        ImPlot::PlotLine(plot.legend.c_str(), view.x, view.y, view.size);
         ImPlot::PopStyleVar(plot.float_styles.size() + plot.int_styles.size());
 
         const auto it = std::upper_bound(
@@ -715,6 +726,9 @@ class PlotView {
     std::vector<double> xvals;
     std::vector<double> yvals;
 
+    // Decimated versions of xvals and yvals for drawing.
+    base::MinMaxPyramid lod;
+
     double min_x = {};
     double max_x = {};
     double min_y = {};
@@ -766,10 +780,12 @@ class PlotView {
 
     plot.legend = MakeLegend(x_token, y_token);
 
-    for (auto item : reader_->items(getter.items())) {
-      plot.timestamps.push_back(item.timestamp);
-      plot.xvals.push_back(getter.x(item));
-      plot.yvals.push_back(getter.y(item));
+    if (!ReadCachedPlot(getter, &plot)) {
+      for (auto item : reader_->items(getter.items())) {
+        plot.timestamps.push_back(item.timestamp);
+        plot.xvals.push_back(getter.x(item));
+        plot.yvals.push_back(getter.y(item));
+      }
     }
 
     if (plot.xvals.empty()) {
@@ -780,6 +796,67 @@ class PlotView {
     FinishPlot(&plot);
   }
 
+  void Restore(const State& state) {
+    for (const auto& plot : state.plots) {
+      current_axis_ = plot.axis;
+      if (plot.deriv) {
+        AddDerivPlot(plot.y_token);
+      } else {
+        AddLogPlot(plot.x_token, plot.y_token);
+      }
+    }
+
+    if (std::isfinite(state.x_axis.min) &&
+        std::isfinite(state.x_axis.max)) {
+      ImPlot::SetNextPlotLimitsX(
+          state.x_axis.min, state.x_axis.max, ImGuiCond_Always);
+    }
+    for (size_t i = 0; i < state.y_axis.size(); i++) {
+      const auto& y = state.y_axis[i];
+      if (std::isfinite(y.min) && std::isfinite(y.max)) {
+        ImPlot::SetNextPlotLimitsY(y.min, y.max, ImGuiCond_Always, i);
+      }
+    }
+
+    fit_plot_ = {};
+  }
+
+  /// Fill @p plot from the column cache, if it has every field.
+  bool ReadCachedPlot(const PlotRetrieve& getter, Plot* plot) {
+    if (!column_cache_ || !column_cache_->valid() ||
+        column_cache_->log_start() != log_start_) {
+      return false;
+    }
+
+    const auto x = column_cache_->Find(getter.record(), getter.x_name());
+    const auto y = column_cache_->Find(getter.record(), getter.y_name());
+    if (!x || !y) { return false; }
+
+    const auto size = x->size;
+    plot->timestamps.resize(size);
+    for (size_t i = 0; i < size; i++) {
+      plot->timestamps[i] =
+          mjlib::base::ConvertEpochMicrosecondsToPtime(x->timestamps_us[i]);
+    }
+
+    auto fill = [&](const ColumnCache::Series& series,
+                    std::vector<double>* values) {
+      if (series.values) {
+        values->assign(series.values, series.values + size);
+        return;
+      }
+      // An empty name means the time since the start of the log.
+      values->resize(size);
+      for (size_t i = 0; i < size; i++) {
+        (*values)[i] = mjlib::base::ConvertDurationToSeconds(
+            plot->timestamps[i] - log_start_);
+      }
+    };
+    fill(*x, &plot->xvals);
+    fill(*y, &plot->yvals);
+    return true;
+  }
+
   void AddDerivPlot(const std::string& token) {
     plots_.push_back({});
     auto& plot = plots_.back();
@@ -815,6 +892,9 @@ class PlotView {
       }
     }
 
+    plot->lod = base::MinMaxPyramid(
+        plot->xvals.data(), plot->yvals.data(), plot->xvals.size());
+
     plot->min_x = *std::min_element(plot->xvals.begin(), plot->xvals.end());
     plot->max_x = *std::max_element(plot->xvals.begin(), plot->xvals.end());
     plot->min_y = *std::min_element(plot->yvals.begin(), plot->yvals.end());
@@ -840,6 +920,7 @@ class PlotView {
 
   FileReader* const reader_;
   TreeView* const tree_view_;
+  const ColumnCache* const column_cache_;
   boost::posix_time::ptime log_start_;
 
   static inline constexpr const char * kAxisNames[] = {
@@ -849,6 +930,7 @@ class PlotView {
   };
 
   std::vector<Plot> plots_;
+  std::optional<State> pending_;
   std::optional<Plot*> fit_plot_;
   size_t current_plot_index_ = 0;
   int current_axis_ = 0;
@@ -1607,6 +1689,100 @@ class MechRender {
 
 constexpr const char* kIniFileName = "tplot2.ini";
 
+/// Plots telemetry streamed from a running robot.  Each selected
+/// field scrolls with the latest sample, and only the most recent
+/// samples are kept.
+class LivePlot {
+ public:
+  LivePlot(const LiveTelemetry::Options& options)
+      : live_(options) {
+    ImGui::GetIO().ConfigFlags |=
+        ImGuiConfigFlags_DockingEnable;
+    ImGui::GetIO().ConfigWindowsMoveFromTitleBarOnly = true;
+  }
+
+  void Run() {
+    while (!app_.should_close()) {
+      app_.PollEvents();
+      app_.NewFrame();
+
+      glClearColor(0.45f, 0.55f, 0.60f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT);
+
+      live_.Poll();
+      UpdateFields();
+      UpdatePlot();
+
+      app_.Render();
+      app_.SwapBuffers();
+    }
+  }
+
+ private:
+  void UpdateFields() {
+    ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowSize(ImVec2(400, 720), ImGuiCond_FirstUseEver);
+    gl::ImGuiWindow fields_window("Live");
+
+    for (const auto& record : live_.records()) {
+      if (!ImGui::TreeNode(record.c_str())) { continue; }
+      for (const auto& field : live_.fields(record)) {
+        const auto key = std::make_pair(record, field);
+        bool selected = selected_.count(key) != 0;
+        if (ImGui::Checkbox(field.c_str(), &selected)) {
+          if (selected) {
+            selected_.insert(key);
+          } else {
+            selected_.erase(key);
+          }
+        }
+      }
+      ImGui::TreePop();
+    }
+  }
+
+  void UpdatePlot() {
+    ImGui::SetNextWindowPos(ImVec2(400, 0), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowSize(ImVec2(880, 720), ImGuiCond_FirstUseEver);
+    gl::ImGuiWindow plot_window("Plot");
+
+    ImGui::Checkbox("Follow", &follow_);
+    ImGui::SameLine(0, 20.0);
+    ImGui::SetNextItemWidth(200);
+    ImGui::SliderFloat("History", &history_s_, 1.0f, 60.0f, "%.0f s");
+
+    if (follow_) {
+      const double latest = live_.latest();
+      ImPlot::SetNextPlotLimitsX(
+          latest - history_s_, latest, ImGuiCond_Always);
+    }
+
+    if (ImPlot::BeginPlot("Live", "time", nullptr, ImVec2(-1, -1))) {
+      for (const auto& key : selected_) {
+        const auto series = live_.Find(key.first, key.second);
+        if (!series) { continue; }
+        const auto legend = key.first + "." + key.second;
+        ImPlot::PlotLine(legend.c_str(), series->x, series->y,
+                         series->count, series->offset);
+      }
+      ImPlot::EndPlot();
+    }
+  }
+
+  LiveTelemetry live_;
+  mjlib::imgui::ImguiApplication app_{
+    [&]() {
+      mjlib::imgui::ImguiApplication::Options options;
+      options.persist_settings = false;
+      options.title = "tplot2 live";
+      return options;
+    }()};
+
+  std::set<std::pair<std::string, std::string>> selected_;
+  bool follow_ = true;
+  float history_s_ = 10.0f;
+};
+
 class Tplot2 {
  public:
   struct Options {
@@ -1614,19 +1790,38 @@ class Tplot2 {
     std::string config_filename;
     std::string video_filename;
     double video_time_offset_s = 0.0;
+    bool no_cache = false;
+    bool rebuild_cache = false;
+
+    /// When live.host is set, plot the telemetry stream from the robot
+    /// at that address instead of a log.
+    LiveTelemetry::Options live;
   };
 
   static Options Parse(int argc, char** argv) {
     Options result;
 
     auto group = clipp::group(
-        clipp::value("log file", result.log_filename),
+        clipp::opt_value("log file", result.log_filename),
         clipp::option("c", "config") &
         clipp::value("CONFIG", result.config_filename),
         clipp::option("v", "video") &
         clipp::value("video", result.video_filename),
         clipp::option("voffset") &
-        clipp::value("OFF", result.video_time_offset_s)
+        clipp::value("OFF", result.video_time_offset_s),
+        clipp::option("no-cache").set(result.no_cache),
+        clipp::option("rebuild-cache").set(result.rebuild_cache),
+        clipp::option("l", "live") &
+        clipp::value("HOST", result.live.host),
+        clipp::option("live-port") &
+        clipp::value("PORT", result.live.port),
+        clipp::repeatable(
+            clipp::option("live-record") &
+            clipp::value("NAME").call([&](auto v) {
+                result.live.records.push_back(v);
+              })),
+        clipp::option("live-rate") &
+        clipp::value("HZ", result.live.rate_hz)
     );
 
     mjlib::base::ClippParse(argc, argv, group);
@@ -1634,8 +1829,8 @@ class Tplot2 {
     return result;
   }
 
-  Tplot2(int argc, char** argv)
-      : options_(Parse(argc, argv)) {
+  Tplot2(const Options& options)
+      : options_(options) {
     ImGui::GetIO().ConfigFlags |=
         ImGuiConfigFlags_DockingEnable;
     ImGui::GetIO().ConfigWindowsMoveFromTitleBarOnly = true;
@@ -1765,9 +1960,21 @@ class Tplot2 {
 
   const boost::posix_time::ptime log_start_ =
       (*file_reader_.items().begin()).timestamp;
+  std::optional<ColumnCache> column_cache_;
+  const bool column_cache_register_ = [&]() {
+    if (!options_.no_cache) {
+      ColumnCache::Options options;
+      options.rebuild = options_.rebuild_cache;
+      column_cache_.emplace(options_.log_filename, options);
+    }
+    return true;
+  }();
+
   Timeline timeline_{&file_reader_};
   TreeView tree_view_{&file_reader_, log_start_};
-  PlotView plot_view_{&file_reader_, &tree_view_, log_start_, initial_save_.plot};
+  PlotView plot_view_{&file_reader_, &tree_view_,
+        column_cache_ ? &*column_cache_ : nullptr,
+        log_start_, initial_save_.plot};
 
   std::optional<Video> video_;
   std::optional<MechRender> mech_render_;
@@ -1793,7 +2000,19 @@ class Tplot2 {
 }
 
 int do_main(int argc, char** argv) {
-  Tplot2 tplot2(argc, argv);
+  const auto options = Tplot2::Parse(argc, argv);
+  if (!options.live.host.empty()) {
+    LivePlot live_plot(options.live);
+    live_plot.Run();
+    return 0;
+  }
+
+  if (options.log_filename.empty()) {
+    std::cerr << "tplot2: a log file or --live is required\n";
+    return 1;
+  }
+
+  Tplot2 tplot2(options);
   tplot2.Run();
 
   return 0;
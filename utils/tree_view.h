@@ -14,10 +14,14 @@
 
 #pragma once
 
+#include <algorithm>
+#include <deque>
+#include <future>
 #include <map>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 #include <boost/date_time/posix_time/posix_time_types.hpp>
@@ -26,10 +30,12 @@
 
 #include "mjlib/base/buffer_stream.h"
 #include "mjlib/base/fail.h"
-#include "mjlib/micro/serializable_handler.h"
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/base/tokenizer.h"
 #include "mjlib/telemetry/file_reader.h"
 
 #include "utils/imgui_tree_archive.h"
+#include "utils/numeric_value_archive.h"
 
 #include "gl/gl_imgui.h"
 
@@ -65,10 +71,26 @@ class TreeView {
     }
   }
 
+  /// Add a value computed from the log data, which is shown in the
+  /// tree and may be plotted.  @p inputs names the records which
+  /// @p derived_operator reads.  When plotting, the value is only
+  /// evaluated when one of them changes, so the plot only has samples
+  /// at the timestamps of those records' items.  If @p inputs is
+  /// empty, it is evaluated at every item in the log.
+  ///
+  /// @p derived_operator may be called from multiple threads at once.
   template <typename DerivedOperator>
-  void AddDerived(std::string_view name, DerivedOperator derived_operator) {
+  void AddDerived(std::string_view name,
+                  std::vector<std::string> inputs,
+                  DerivedOperator derived_operator) {
     derived_.push_back(std::make_unique<Concrete<DerivedOperator>>(
-                           name, std::move(derived_operator)));
+                           name, std::move(inputs),
+                           std::move(derived_operator)));
+  }
+
+  template <typename DerivedOperator>
+  void AddDerived(std::string_view name, DerivedOperator derived_operator) {
+    AddDerived(name, {}, std::move(derived_operator));
   }
 
   std::optional<std::string> data(const std::string& name) {
@@ -361,26 +383,94 @@ class TreeView {
     std::vector<double> yvals;
   };
 
+  /// Evaluate one field of a derived value over the whole log.
+  ///
+  /// The log is read in order on this thread, and split into chunks
+  /// of consecutive items.  Each chunk starts from a snapshot of the
+  /// input records, and is evaluated on a worker thread while the
+  /// following chunks are read.  No more chunks than there are cores
+  /// are evaluated at once.
   ExtractResult ExtractDeriv(const std::string& token) {
     mjlib::base::Tokenizer tokenizer(token, ".");
-    auto prefix = tokenizer.next();
-    for (const auto& derived : derived_) {
-      if (derived->name() != prefix) { continue; }
+    const auto prefix = tokenizer.next();
+    const auto it = std::find_if(
+        derived_.begin(), derived_.end(),
+        [&](const auto& derived) { return derived->name() == prefix; });
+    if (it == derived_.end()) { return {}; }
+
+    const DerivedBase* const derived = it->get();
+    const std::string field(tokenizer.remaining());
+
+    struct Chunk {
+      CurrentLogData start;
+      std::vector<boost::posix_time::ptime> timestamps;
+      std::vector<const FileReader::Record*> records;
+      std::vector<std::string> data;
+    };
 
+    auto evaluate = [this, derived, &field](Chunk chunk) {
       ExtractResult result;
-      auto current_data = data_;
-      current_data.data = {};
-      for (const auto& item : reader_->items()) {
-        current_data.data[item.record] = item.data;
-        result.timestamps.push_back(item.timestamp);
+      CurrentLogData current = std::move(chunk.start);
+      for (size_t i = 0; i < chunk.timestamps.size(); i++) {
+        current.data[chunk.records[i]].swap(chunk.data[i]);
+        result.timestamps.push_back(chunk.timestamps[i]);
         result.xvals.push_back(
-            mjlib::base::ConvertDurationToSeconds(item.timestamp - log_start_));
-        result.yvals.push_back(
-            derived->Extract(tokenizer.remaining(), current_data));
+            mjlib::base::ConvertDurationToSeconds(
+                chunk.timestamps[i] - log_start_));
+        result.yvals.push_back(derived->Extract(field, current));
       }
       return result;
+    };
+
+    ExtractResult result;
+    auto append = [&](ExtractResult&& part) {
+      auto move = [](auto* to, auto& from) {
+        to->insert(to->end(), std::make_move_iterator(from.begin()),
+                   std::make_move_iterator(from.end()));
+      };
+      move(&result.timestamps, part.timestamps);
+      move(&result.xvals, part.xvals);
+      move(&result.yvals, part.yvals);
+    };
+
+    const size_t max_in_flight =
+        std::max(1u, std::thread::hardware_concurrency());
+    std::deque<std::future<ExtractResult>> in_flight;
+
+    CurrentLogData current = data_;
+    current.data = {};
+    Chunk chunk;
+    auto dispatch = [&]() {
+      if (chunk.timestamps.empty()) { return; }
+      if (in_flight.size() >= max_in_flight) {
+        append(in_flight.front().get());
+        in_flight.pop_front();
+      }
+      in_flight.push_back(
+          std::async(std::launch::async, evaluate, std::move(chunk)));
+      chunk = {};
+      chunk.start = current;
+    };
+    chunk.start = current;
+
+    FileReader::ItemsOptions options;
+    for (const auto& input : derived->inputs()) {
+      if (reader_->record(input)) { options.records.push_back(input); }
+    }
+    if (!derived->inputs().empty() && options.records.empty()) { return {}; }
+
+    for (const auto& item : reader_->items(options)) {
+      chunk.timestamps.push_back(item.timestamp);
+      chunk.records.push_back(item.record);
+      chunk.data.emplace_back(item.data);
+      current.data[item.record] = item.data;
+
+      if (chunk.timestamps.size() >= kExtractChunkSize) { dispatch(); }
     }
-    return {};
+    dispatch();
+
+    for (auto& future : in_flight) { append(future.get()); }
+    return result;
   }
 
  private:
@@ -389,34 +479,29 @@ class TreeView {
     virtual ~DerivedBase() {}
     virtual std::string_view name() const = 0;
 
+    virtual const std::vector<std::string>& inputs() const = 0;
+
     virtual void Visit(const CurrentLogData&) const = 0;
     virtual double Extract(std::string_view token,
                            const CurrentLogData& log_data) const = 0;
   };
 
-  class StringStream : public mjlib::micro::AsyncWriteStream {
-   public:
-    void AsyncWriteSome(const std::string_view& data,
-                        const mjlib::micro::SizeCallback& cbk) {
-      ostr_.write(data.data(), data.size());
-      cbk({}, data.size());
-    }
-
-    std::string str() const { return ostr_.str(); }
-
-   private:
-    std::ostringstream ostr_;
-  };
-
   template <typename DerivedOperator>
   class Concrete : public DerivedBase {
    public:
-    Concrete(std::string_view name, DerivedOperator derived_operator) :
+    Concrete(std::string_view name,
+             std::vector<std::string> inputs,
+             DerivedOperator derived_operator) :
         name_(name),
+        inputs_(std::move(inputs)),
         derived_operator_(std::move(derived_operator)) {}
 
     std::string_view name() const override { return name_; }
 
+    const std::vector<std::string>& inputs() const override {
+      return inputs_;
+    }
+
     void Visit(const CurrentLogData& log_data) const override {
       auto result = derived_operator_(log_data);
       const bool expanded = ImGui::TreeNode(name_.c_str());
@@ -431,18 +516,17 @@ class TreeView {
 
     double Extract(std::string_view token,
                    const CurrentLogData& log_data) const override {
-      auto result = derived_operator_(log_data);
-      char buf[256] = {};
-      StringStream streambuf;
-      mjlib::micro::SerializableHandler handler(&result);
-      handler.Read(token, buf, streambuf, [](auto&&) {});
-      return std::stod(streambuf.str());
+      const auto result = derived_operator_(log_data);
+      return NumericValueArchive::Read(token, result);
     };
 
     const std::string name_;
+    const std::vector<std::string> inputs_;
     DerivedOperator derived_operator_;
   };
 
+  static constexpr size_t kExtractChunkSize = 4096;
+
   FileReader* const reader_;
   boost::posix_time::ptime log_start_;
   boost::posix_time::ptime last_timestamp_;